@@ -1,12 +1,20 @@
 #version 330 core
 in vec2 TexCoords;
+in vec3 TextColor;
+flat in vec2 Layer;
 out vec4 color;
 
-uniform sampler2D text;
-uniform vec3 textColor;
+uniform sampler2DArray text;
 
 void main()
 {
-	vec4 sampled = vec4(1.0, 1.0, 1.0, texture(text, TexCoords).r);
-	color = vec4(textColor, 1.0) * sampled;
+	float value = texture(text, vec3(TexCoords, Layer.x)).r;
+	// Derivatives are taken outside of the branch, as it is per glyph
+	float width = fwidth(value);
+	if (Layer.y > 0.5)
+	{
+		// Distance fields store 0.5 on the outline of the glyph
+		value = smoothstep(0.5 - width, 0.5 + width, value);
+	}
+	color = vec4(TextColor, value);
 }
\ No newline at end of file
@@ -1,6 +1,10 @@
 #version 330 core
 layout(location = 0) in vec4 vertex; // <vec2 pos, vec2 tex>
+layout(location = 1) in vec3 color;
+layout(location = 2) in vec2 layer; // <atlas page, sdf>
 out vec2 TexCoords;
+out vec3 TextColor;
+flat out vec2 Layer;
 
 uniform mat4 projection;
 
@@ -8,4 +12,6 @@ void main()
 {
 	gl_Position = projection * vec4(vertex.xy, 0.0, 1.0);
 	TexCoords = vertex.zw;
+	TextColor = color;
+	Layer = layer;
 }
\ No newline at end of file
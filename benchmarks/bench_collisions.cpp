@@ -0,0 +1,125 @@
+#include <cmath>
+
+#include "benchmark.h"
+
+#include "main/game/gameobject2d.h"
+#include "main/wisteria_engine/controlledscene3d.h"
+
+using namespace engine;
+
+
+/*
+ *  Narrow phase, for each pair of hit areas: the argument is 0 for two
+ *  objects apart, 1 for two that overlap
+ */
+
+static void CollidesPair2D(BenchmarkState &state, bool rect1, bool rect2)
+{
+    GameObject2D first(glm::vec2(0), glm::vec2(1), 0.3f);
+    GameObject2D second(glm::vec2(state.GetArgument() ? 0.8f : 5.f, 0.4f), glm::vec2(1), -0.2f);
+    if (rect1)
+        first.SetRectHitArea(1, 1);
+    else
+        first.SetCircleHitArea(0.5f);
+    if (rect2)
+        second.SetRectHitArea(1, 1);
+    else
+        second.SetCircleHitArea(0.5f);
+
+    while (state.KeepRunning())
+        DoNotOptimize(first.Collides(&second));
+}
+
+
+static void CollidesRectRect(BenchmarkState &state) { CollidesPair2D(state, true, true); }
+static void CollidesRectCircle(BenchmarkState &state) { CollidesPair2D(state, true, false); }
+static void CollidesCircleRect(BenchmarkState &state) { CollidesPair2D(state, false, true); }
+static void CollidesCircleCircle(BenchmarkState &state) { CollidesPair2D(state, false, false); }
+BENCHMARK(CollidesRectRect, 0, 1);
+BENCHMARK(CollidesRectCircle, 0, 1);
+BENCHMARK(CollidesCircleRect, 0, 1);
+BENCHMARK(CollidesCircleCircle, 0, 1);
+
+
+static void CollidesPair(BenchmarkState &state, bool box1, bool box2)
+{
+    GameObject *first = new GameObject(glm::vec3(0), glm::vec3(1), glm::quat(glm::vec3(0, 0.3f, 0)));
+    GameObject *second = new GameObject(glm::vec3(state.GetArgument() ? 0.8f : 5.f, 0.4f, 0.1f),
+                                        glm::vec3(1), glm::quat(glm::vec3(0.2f, 0, 0)));
+    if (box1)
+        first->SetBoxHitArea(1, 1, 1);
+    else
+        first->SetSphereHitArea(0.5f);
+    if (box2)
+        second->SetBoxHitArea(1, 1, 1);
+    else
+        second->SetSphereHitArea(0.5f);
+
+    CollisionEventPtr event, otherEvent;
+    while (state.KeepRunning())
+        DoNotOptimize(first->Collides(second, event, otherEvent));
+
+    // The hit areas are held by children, which GameObject does not delete
+    for (GameObject *gameObject : { first, second })
+    {
+        std::vector<GameObject *> children(gameObject->GetChildren().begin(), gameObject->GetChildren().end());
+        for (GameObject *child : children)
+            delete child;
+        delete gameObject;
+    }
+}
+
+
+static void CollidesBoxBox(BenchmarkState &state) { CollidesPair(state, true, true); }
+static void CollidesBoxSphere(BenchmarkState &state) { CollidesPair(state, true, false); }
+static void CollidesSphereBox(BenchmarkState &state) { CollidesPair(state, false, true); }
+static void CollidesSphereSphere(BenchmarkState &state) { CollidesPair(state, false, false); }
+BENCHMARK(CollidesBoxBox, 0, 1);
+BENCHMARK(CollidesBoxSphere, 0, 1);
+BENCHMARK(CollidesSphereBox, 0, 1);
+BENCHMARK(CollidesSphereSphere, 0, 1);
+
+
+/*
+ *  ControlledScene3D::CheckCollisions with `argument` objects on one layer
+ */
+
+// The scene itself needs a context: its constructor sets up the framework's resources
+class CollisionScene : public ControlledScene3D
+{
+ public:
+    explicit CollisionScene(int64_t nrObjects)
+    {
+        // A cube of spheres and boxes, each overlapping its neighbors
+        int side = static_cast<int>(std::ceil(std::cbrt(static_cast<double>(nrObjects))));
+        for (int64_t i = 0; i < nrObjects; i++)
+        {
+            glm::vec3 position(i % side, (i / side) % side, i / (side * side));
+            GameObject *gameObject = new GameObject(position);
+            if (i % 2)
+                gameObject->SetBoxHitArea(1.2f, 1.2f, 1.2f);
+            else
+                gameObject->SetSphereHitArea(0.6f);
+
+            AddToScene(gameObject);
+            AddToLayer(gameObject, 0);
+        }
+        collisionMasks[0] = 1;
+    }
+
+    void Check()
+    {
+        CheckCollisions();
+    }
+};
+
+
+// Every pair is tested and remembered in a set, in both orders: the memory
+// grows with the square of the number of objects, about 5 GB for 10000
+static void CheckCollisions(BenchmarkState &state)
+{
+    CollisionScene scene(state.GetArgument());
+    while (state.KeepRunning())
+        scene.Check();
+}
+BENCHMARK_GL(CheckCollisions, 100, 1000, 3000);
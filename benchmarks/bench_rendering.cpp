@@ -0,0 +1,92 @@
+#include <string>
+
+#include "benchmark.h"
+
+#include "core/engine.h"
+#include "core/gpu/mesh.h"
+#include "core/gpu/shader.h"
+#include "core/managers/resource_path.h"
+#include "main/wisteria_engine/material.h"
+
+
+/*
+ *  Material::Use with `argument` uniforms, floats, vec3s and mat4s in turn
+ */
+
+static std::string UniformType(int64_t index)
+{
+    const char *types[] = { "float", "vec3", "mat4" };
+    return types[index % 3];
+}
+
+
+static void MaterialUse(BenchmarkState &state)
+{
+    // Every uniform is read, so that the driver keeps them all
+    std::string uniforms, sum;
+    for (int64_t i = 0; i < state.GetArgument(); i++)
+    {
+        std::string name = "U" + std::to_string(i);
+        uniforms += "uniform " + UniformType(i) + " " + name + ";\n";
+        const char *read[] = { "", ".x", "[0][0]" };
+        sum += " + " + name + read[i % 3];
+    }
+
+    Shader *shader = new Shader("MaterialUse");
+    shader->AddShaderCode("#version 330\n"
+                          "layout(location = 0) in vec3 v_position;\n"
+                          "void main() { gl_Position = vec4(v_position, 1); }\n", GL_VERTEX_SHADER);
+    shader->AddShaderCode("#version 330\n" + uniforms +
+                          "layout(location = 0) out vec4 out_color;\n"
+                          "void main() { out_color = vec4(0.0" + sum + "); }\n", GL_FRAGMENT_SHADER);
+    shader->CreateAndLink();
+
+    engine::Material material(shader);
+    for (int64_t i = 0; i < state.GetArgument(); i++)
+    {
+        std::string name = "U" + std::to_string(i);
+        if (i % 3 == 0)
+            material.SetFloat(name, 0.5f);
+        else if (i % 3 == 1)
+            material.SetVec3(name, glm::vec3(0.5f));
+        else
+            material.SetMat4(name, glm::mat4(0.5f));
+    }
+
+    while (state.KeepRunning())
+        material.Use();
+    glFinish();
+
+    delete shader;
+}
+BENCHMARK_GL(MaterialUse, 0, 4, 16);
+
+
+/*
+ *  Mesh::LoadMesh, with the default settings (the LODs included), on a few
+ *  of the models in assets/models, from small to large
+ */
+
+static const char *models[][2] = {
+    { "primitives", "box.obj" },
+    { "primitives", "teapot.obj" },
+    { "animals", "bunny.obj" },
+    { "tema2", "tank-base.fbx" },
+    { "characters/archer", "Archer.fbx" },
+};
+
+
+static void MeshLoadMesh(BenchmarkState &state)
+{
+    const char *location = models[state.GetArgument()][0];
+    const char *fileName = models[state.GetArgument()][1];
+    state.SetLabel(std::string(location) + "/" + fileName);
+
+    std::string directory = PATH_JOIN(Engine::GetWindow()->props.selfDir, RESOURCE_PATH::MODELS, location);
+    while (state.KeepRunning())
+    {
+        Mesh mesh(fileName);
+        DoNotOptimize(mesh.LoadMesh(directory, fileName));
+    }
+}
+BENCHMARK_GL(MeshLoadMesh, 0, 1, 2, 3, 4);
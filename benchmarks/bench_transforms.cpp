@@ -0,0 +1,193 @@
+#include <vector>
+
+#include "benchmark.h"
+
+#include "main/game/gameobject2d.h"
+#include "main/wisteria_engine/gameobject3d.h"
+
+using namespace engine;
+
+
+// GameObject does not delete its children
+static void DeleteTree(GameObject *gameObject)
+{
+    std::vector<GameObject *> children(gameObject->GetChildren().begin(), gameObject->GetChildren().end());
+    for (GameObject *child : children)
+        DeleteTree(child);
+    delete gameObject;
+}
+
+
+// A chain of `depth` objects under `root`; returns the last one
+static GameObject2D *CreateChain2D(GameObject2D *root, int64_t depth)
+{
+    GameObject2D *last = root;
+    for (int64_t i = 0; i < depth; i++)
+        last = GameObject2D::CreateChild(last, glm::vec2(1, 0), glm::vec2(1.01f), 0.1f);
+    return last;
+}
+
+
+static GameObject *CreateChain(GameObject *root, int64_t depth)
+{
+    GameObject *last = root;
+    for (int64_t i = 0; i < depth; i++)
+        last = last->CreateChild(glm::vec3(1, 0, 0), glm::vec3(1.01f), glm::quat(glm::vec3(0, 0.1f, 0)));
+    return last;
+}
+
+
+/*
+ *  Setters of an object without children
+ */
+
+static void GameObject2DSetters(BenchmarkState &state)
+{
+    GameObject2D gameObject(glm::vec2(0));
+    float t = 0;
+    while (state.KeepRunning())
+    {
+        t += 0.001f;
+        gameObject.SetPosition(glm::vec2(t, -t));
+        gameObject.SetRotation(t);
+        gameObject.SetPseudoScale(glm::vec2(1 + t));
+    }
+    DoNotOptimize(gameObject.GetPosition());
+}
+BENCHMARK(GameObject2DSetters);
+
+
+static void GameObjectSetters(BenchmarkState &state)
+{
+    GameObject gameObject(glm::vec3(0));
+    float t = 0;
+    while (state.KeepRunning())
+    {
+        t += 0.001f;
+        gameObject.SetPosition(glm::vec3(t, 0, -t));
+        gameObject.SetRotation(glm::quat(glm::vec3(0, t, 0)));
+        gameObject.SetPseudoScale(glm::vec3(1 + t));
+        DoNotOptimize(gameObject.GetPosition());
+    }
+}
+BENCHMARK(GameObjectSetters);
+
+
+/*
+ *  Moving the top of a hierarchy and reading where its bottom ended up
+ */
+
+static void GameObject2DHierarchy(BenchmarkState &state)
+{
+    GameObject2D *root = new GameObject2D(glm::vec2(0));
+    GameObject2D *leaf = CreateChain2D(root, state.GetArgument());
+    float t = 0;
+    while (state.KeepRunning())
+    {
+        t += 0.001f;
+        root->SetLocalPosition(glm::vec2(t, 0));
+        root->SetLocalRotation(t);
+        DoNotOptimize(leaf->GetPosition());
+    }
+    delete root;
+}
+BENCHMARK(GameObject2DHierarchy, 1, 8, 64);
+
+
+static void GameObjectHierarchy(BenchmarkState &state)
+{
+    GameObject *root = new GameObject(glm::vec3(0));
+    GameObject *leaf = CreateChain(root, state.GetArgument());
+    float t = 0;
+    while (state.KeepRunning())
+    {
+        t += 0.001f;
+        root->SetLocalPosition(glm::vec3(t, 0, 0));
+        root->SetLocalRotation(glm::quat(glm::vec3(0, t, 0)));
+        DoNotOptimize(leaf->GetPosition());
+    }
+    DeleteTree(root);
+}
+BENCHMARK(GameObjectHierarchy, 1, 8, 64);
+
+
+// One parent and `argument` children, all of them read after each move
+static void GameObject2DFanOut(BenchmarkState &state)
+{
+    GameObject2D *root = new GameObject2D(glm::vec2(0));
+    for (int64_t i = 0; i < state.GetArgument(); i++)
+        GameObject2D::CreateChild(root, glm::vec2(static_cast<float>(i), 1));
+    float t = 0;
+    while (state.KeepRunning())
+    {
+        t += 0.001f;
+        root->SetLocalPosition(glm::vec2(t, 0));
+        for (GameObject2D *child : root->GetChildren())
+            DoNotOptimize(child->GetPosition());
+    }
+    delete root;
+}
+BENCHMARK(GameObject2DFanOut, 16, 256, 4096);
+
+
+static void GameObjectFanOut(BenchmarkState &state)
+{
+    GameObject *root = new GameObject(glm::vec3(0));
+    for (int64_t i = 0; i < state.GetArgument(); i++)
+        root->CreateChild(glm::vec3(static_cast<float>(i), 1, 0));
+    float t = 0;
+    while (state.KeepRunning())
+    {
+        t += 0.001f;
+        root->SetLocalPosition(glm::vec3(t, 0, 0));
+        for (GameObject *child : root->GetChildren())
+            DoNotOptimize(child->GetPosition());
+    }
+    DeleteTree(root);
+}
+BENCHMARK(GameObjectFanOut, 16, 256, 4096);
+
+
+/*
+ *  ObjectToWorldMatrix of an object `argument` levels deep
+ */
+
+// Computed from the whole chain on every call
+static void ObjectToWorldMatrix2D(BenchmarkState &state)
+{
+    GameObject2D *root = new GameObject2D(glm::vec2(0));
+    GameObject2D *leaf = CreateChain2D(root, state.GetArgument());
+    while (state.KeepRunning())
+        DoNotOptimize(leaf->ObjectToWorldMatrix());
+    delete root;
+}
+BENCHMARK(ObjectToWorldMatrix2D, 0, 8, 64);
+
+
+// Cached while the transform does not change
+static void ObjectToWorldMatrix(BenchmarkState &state)
+{
+    GameObject *root = new GameObject(glm::vec3(0));
+    GameObject *leaf = CreateChain(root, state.GetArgument());
+    while (state.KeepRunning())
+        DoNotOptimize(leaf->ObjectToWorldMatrix());
+    DeleteTree(root);
+}
+BENCHMARK(ObjectToWorldMatrix, 0, 8, 64);
+
+
+// After its own transform changed: recomputed, from the cached transform of its parent
+static void ObjectToWorldMatrixDirty(BenchmarkState &state)
+{
+    GameObject *root = new GameObject(glm::vec3(0));
+    GameObject *leaf = CreateChain(root, state.GetArgument());
+    float t = 0;
+    while (state.KeepRunning())
+    {
+        t += 0.001f;
+        leaf->SetLocalRotation(glm::quat(glm::vec3(t, 0, 0)));
+        DoNotOptimize(leaf->ObjectToWorldMatrix());
+    }
+    DeleteTree(root);
+}
+BENCHMARK(ObjectToWorldMatrixDirty, 0, 8, 64);
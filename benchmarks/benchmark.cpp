@@ -0,0 +1,135 @@
+#include "benchmark.h"
+
+#include <cstdio>
+#include <thread>
+#include <iostream>
+#include <algorithm>
+
+
+// Past it, even a benchmark that takes no measurable time is done
+#define MAX_ITERATIONS      (1000000000ull)
+
+
+int Benchmarks::Register(const char *name, Function function, bool needsGL, std::vector<int64_t> arguments)
+{
+    if (arguments.empty())
+    {
+        GetCases().push_back({ name, function, needsGL, false, 0 });
+        return 0;
+    }
+
+    for (int64_t argument : arguments)
+        GetCases().push_back({ std::string(name) + "/" + std::to_string(argument), function, needsGL, true, argument });
+    return 0;
+}
+
+
+bool Benchmarks::Run(const Options &options)
+{
+    std::vector<Result> results;
+    printf("%-48s %16s %16s %12s\n", "Benchmark", "Time (ns)", "CPU (ns)", "Iterations");
+
+    for (const Case &benchmarkCase : GetCases())
+    {
+        if (benchmarkCase.needsGL && !options.runGL)
+            continue;
+        if (benchmarkCase.name.find(options.filter) == std::string::npos)
+            continue;
+
+        Result result = RunCase(benchmarkCase, options.minTime);
+        printf("%-48s %16.1f %16.1f %12llu %s\n", result.name.c_str(), result.realTime, result.cpuTime,
+               static_cast<unsigned long long>(result.iterations), result.label.c_str());
+        fflush(stdout);
+        results.push_back(result);
+    }
+
+    if (!Write(options.outputFile, results))
+    {
+        std::cout << "Benchmarks: cannot write " << options.outputFile << std::endl;
+        return false;
+    }
+    return true;
+}
+
+
+std::vector<Benchmarks::Case> &Benchmarks::GetCases()
+{
+    static std::vector<Case> cases;
+    return cases;
+}
+
+
+Benchmarks::Result Benchmarks::RunCase(const Case &benchmarkCase, double minTime)
+{
+    // Same as Google Benchmark: grow the number of iterations until a run
+    // takes long enough, and keep that run
+    uint64_t iterations = 1;
+    while (true)
+    {
+        BenchmarkState state(iterations, benchmarkCase.argument);
+        benchmarkCase.function(state);
+        state.PauseTiming();
+
+        if (state.realTime >= minTime || iterations >= MAX_ITERATIONS)
+        {
+            return { benchmarkCase.name, state.label, iterations,
+                     state.realTime * 1e9 / iterations, state.cpuTime * 1e9 / iterations };
+        }
+
+        double multiplier = minTime * 1.4 / std::max(state.realTime, 1e-9);
+        multiplier = std::min(multiplier, 10.0);
+        iterations = std::max(iterations + 1, static_cast<uint64_t>(iterations * multiplier));
+        iterations = std::min<uint64_t>(iterations, MAX_ITERATIONS);
+    }
+}
+
+
+static std::string Escape(const std::string &text)
+{
+    std::string escaped;
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+            escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+
+bool Benchmarks::Write(const std::string &fileName, const std::vector<Result> &results)
+{
+    FILE *file = fopen(fileName.c_str(), "w");
+    if (!file)
+        return false;
+
+    char date[32];
+    std::time_t now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+    fprintf(file, "{\n  \"context\": {\n");
+    fprintf(file, "    \"date\": \"%s\",\n", date);
+    fprintf(file, "    \"num_cpus\": %u,\n", std::thread::hardware_concurrency());
+#ifdef NDEBUG
+    fprintf(file, "    \"library_build_type\": \"release\"\n");
+#else
+    fprintf(file, "    \"library_build_type\": \"debug\"\n");
+#endif
+    fprintf(file, "  },\n  \"benchmarks\": [");
+
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const Result &result = results[i];
+        fprintf(file, "%s\n    {\"name\": \"%s\", \"run_name\": \"%s\", \"run_type\": \"iteration\", "
+                      "\"iterations\": %llu, \"real_time\": %.3f, \"cpu_time\": %.3f, \"time_unit\": \"ns\"",
+                i ? "," : "", Escape(result.name).c_str(), Escape(result.name).c_str(),
+                static_cast<unsigned long long>(result.iterations), result.realTime, result.cpuTime);
+        if (!result.label.empty())
+            fprintf(file, ", \"label\": \"%s\"", Escape(result.label).c_str());
+        fprintf(file, "}");
+    }
+    fprintf(file, "\n  ]\n}\n");
+
+    fclose(file);
+    return true;
+}
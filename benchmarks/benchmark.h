@@ -0,0 +1,169 @@
+#pragma once
+
+#include <chrono>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+
+// Microbenchmarks, registered with BENCHMARK (CPU only) or BENCHMARK_GL (run with
+// the OpenGL context of a hidden window), once per argument if any are given:
+//
+//     static void SetPosition(BenchmarkState &state)
+//     {
+//         engine::GameObject2D gameObject;    // not timed
+//         while (state.KeepRunning())
+//             gameObject.SetPosition(glm::vec2(1, 2));
+//     }
+//     BENCHMARK(SetPosition);
+//
+// Each one is repeated until it ran for the minimum time, and the results are
+// written as JSON in the format of Google Benchmark, so that two runs can be
+// compared with its tools (compare.py).
+//
+// The function and its arguments are all taken by the `...`, which ISO C++ (before
+// C++20) wants to be given at least one argument.
+#define BENCHMARK_CONCAT_INNER(a, b)    a##b
+#define BENCHMARK_CONCAT(a, b)          BENCHMARK_CONCAT_INNER(a, b)
+
+#define BENCHMARK(...)                  static const int BENCHMARK_CONCAT(benchmark, __LINE__) = \
+                                            Benchmarks::Register(false, #__VA_ARGS__, __VA_ARGS__)
+#define BENCHMARK_GL(...)               static const int BENCHMARK_CONCAT(benchmark, __LINE__) = \
+                                            Benchmarks::Register(true, #__VA_ARGS__, __VA_ARGS__)
+
+
+// Keeps the compiler from optimizing away the computation of `value`
+template <typename T>
+inline void DoNotOptimize(const T &value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    const volatile char *sink = reinterpret_cast<const volatile char *>(&value);
+    (void)*sink;
+#endif
+}
+
+
+class BenchmarkState
+{
+ public:
+    BenchmarkState(uint64_t iterations, int64_t argument)
+        : iterations(iterations), done(0), argument(argument), running(false),
+          realTime(0), cpuTime(0)
+    {
+    }
+
+    // Times the loop it is the condition of; what comes before is the setup
+    bool KeepRunning()
+    {
+        if (done < iterations)
+        {
+            if (done++ == 0)
+                ResumeTiming();
+            return true;
+        }
+        PauseTiming();
+        return false;
+    }
+
+    // For the work of an iteration that should not be measured
+    void PauseTiming()
+    {
+        if (!running)
+            return;
+        realTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - realBegin).count();
+        cpuTime += static_cast<double>(std::clock() - cpuBegin) / CLOCKS_PER_SEC;
+        running = false;
+    }
+
+    void ResumeTiming()
+    {
+        if (running)
+            return;
+        running = true;
+        cpuBegin = std::clock();
+        realBegin = std::chrono::steady_clock::now();
+    }
+
+    int64_t GetArgument() const { return argument; }
+    uint64_t GetIterations() const { return iterations; }
+    // Shown next to the results, for instance the file an argument stands for
+    void SetLabel(const std::string &label) { this->label = label; }
+
+ private:
+    friend class Benchmarks;
+
+    uint64_t iterations;
+    uint64_t done;
+    int64_t argument;
+    std::string label;
+
+    bool running;
+    std::chrono::steady_clock::time_point realBegin;
+    std::clock_t cpuBegin;
+    // Seconds
+    double realTime;
+    double cpuTime;
+};
+
+
+class Benchmarks
+{
+ public:
+    typedef void (*Function)(BenchmarkState &state);
+
+    struct Options
+    {
+        // Only the benchmarks whose name contains it
+        std::string filter;
+        bool runGL = true;
+        double minTime = 0.5;
+        std::string outputFile = "benchmark_results.json";
+    };
+
+    static int Register(const char *name, Function function, bool needsGL, std::vector<int64_t> arguments);
+    // Through BENCHMARK and BENCHMARK_GL: `spelling` is the text of their arguments,
+    // so the name of the function is what comes before the first comma
+    template <typename... Arguments>
+    static int Register(bool needsGL, const char *spelling, Function function, Arguments... arguments)
+    {
+        std::string name(spelling);
+        name = name.substr(0, name.find(','));
+        return Register(name.c_str(), function, needsGL, { static_cast<int64_t>(arguments)... });
+    }
+
+    // Runs them in the order they were registered, returns whether the results were written
+    static bool Run(const Options &options);
+
+ protected:
+    Benchmarks() = delete;
+    ~Benchmarks() = delete;
+
+ private:
+    struct Case
+    {
+        std::string name;
+        Function function;
+        bool needsGL;
+        bool hasArgument;
+        int64_t argument;
+    };
+
+    struct Result
+    {
+        std::string name;
+        std::string label;
+        uint64_t iterations;
+        // Nanoseconds per iteration
+        double realTime;
+        double cpuTime;
+    };
+
+    // Not a static member, so that registering from other translation units
+    // does not depend on the order they are initialized in
+    static std::vector<Case> &GetCases();
+    static Result RunCase(const Case &benchmarkCase, double minTime);
+    static bool Write(const std::string &fileName, const std::vector<Result> &results);
+};
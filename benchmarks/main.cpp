@@ -0,0 +1,84 @@
+#include <cstdlib>
+#include <iostream>
+
+#include "benchmark.h"
+
+#include "core/engine.h"
+#include "core/job_system.h"
+#include "core/gpu/mesh.h"
+#include "core/managers/resource_path.h"
+
+
+std::string GetParentDir(const std::string &filePath)
+{
+    size_t pos = filePath.find_last_of("\\/");
+    return (std::string::npos == pos) ? "." : filePath.substr(0, pos);
+}
+
+
+// GFXBenchmarks [--out <file>] [--filter <text>] [--min-time <seconds>] [--no-gl]
+//               [--mesh-report <file>]
+//
+// --mesh-report also writes what the import optimizations do to each model of
+// assets/models (see Mesh::WriteOptimizationReport), as CSV. It loads the models
+// with an OpenGL context, so it cannot be used with --no-gl.
+//
+// The GL cases draw nothing on screen, but still need a display. Without a GPU,
+// run them on Mesa's software rasterizer, for instance:
+//
+//     LIBGL_ALWAYS_SOFTWARE=1 xvfb-run -a ./GFXBenchmarks --out results.json
+int main(int argc, char **argv)
+{
+    Benchmarks::Options options;
+    std::string meshReport;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--no-gl")
+            options.runGL = false;
+        else if (arg == "--out" && i + 1 < argc)
+            options.outputFile = argv[++i];
+        else if (arg == "--filter" && i + 1 < argc)
+            options.filter = argv[++i];
+        else if (arg == "--min-time" && i + 1 < argc)
+            options.minTime = atof(argv[++i]);
+        else if (arg == "--mesh-report" && i + 1 < argc)
+            meshReport = argv[++i];
+        else
+        {
+            std::cout << "Unknown argument " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    if (!meshReport.empty() && !options.runGL)
+    {
+        std::cout << "--mesh-report needs an OpenGL context, it cannot be used with --no-gl" << std::endl;
+        return 1;
+    }
+
+    bool written;
+    if (options.runGL)
+    {
+        // The scenes and the assets are looked up next to the executable, as for the framework
+        WindowProperties wp;
+        wp.resolution = glm::ivec2(1280, 720);
+        wp.visible = false;
+        wp.vSync = false;
+        wp.selfDir = GetParentDir(std::string(argv[0]));
+
+        (void)Engine::Init(wp);
+        written = Benchmarks::Run(options);
+        if (!meshReport.empty())
+            written &= Mesh::WriteOptimizationReport(PATH_JOIN(wp.selfDir, RESOURCE_PATH::MODELS), meshReport);
+        Engine::Exit();
+    }
+    else
+    {
+        JobSystem::Init();
+        written = Benchmarks::Run(options);
+        JobSystem::Exit();
+    }
+
+    return written ? 0 : 1;
+}
@@ -0,0 +1,400 @@
+#include "components/glyph_cache.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "utils/gl_utils.h"
+
+#include "ft2build.h"
+#include FT_FREETYPE_H
+
+
+// Empty pixels left between two glyphs, so that linear filtering does not bleed
+#define ATLAS_PADDING       (1)
+// Distance (in pixels) covered by the [0, 1] range of a signed distance field
+#define SDF_SPREAD          (6)
+// Distance fields serve every font size, they are stored at this one and scaled
+#define SDF_REFERENCE_SIZE  (48)
+// and built from a bitmap rasterized this many times larger, for smooth edges
+#define SDF_SUPERSAMPLE     (4)
+
+
+namespace
+{
+    // Packs the cache key into a single integer: 12 bits for the font,
+    // 12 bits for the size, 1 bit for the SDF flag and 21 for the codepoint
+    unsigned long long GlyphKey(int fontID, GLuint fontSize, bool sdf, char32_t codepoint)
+    {
+        return (static_cast<unsigned long long>(fontID & 0xFFF) << 34) |
+               (static_cast<unsigned long long>(fontSize & 0xFFF) << 22) |
+               (static_cast<unsigned long long>(sdf) << 21) |
+               (static_cast<unsigned long long>(codepoint) & 0x1FFFFF);
+    }
+
+
+    // Runs the two passes of the 8SSEDT algorithm. Each cell of `grid` holds the
+    // offset to the closest seed cell, seeds start at (0, 0) and the rest of the
+    // cells start "infinitely" far away.
+    void DistanceTransform(std::vector<glm::ivec2> &grid, int w, int h)
+    {
+        auto compare = [&](glm::ivec2 &cell, int x, int y, int ox, int oy)
+        {
+            if (x + ox < 0 || x + ox >= w || y + oy < 0 || y + oy >= h)
+                return;
+            glm::ivec2 other = grid[(y + oy) * w + x + ox] + glm::ivec2(ox, oy);
+            if (other.x * other.x + other.y * other.y < cell.x * cell.x + cell.y * cell.y)
+                cell = other;
+        };
+
+        for (int y = 0; y < h; y++)
+        {
+            for (int x = 0; x < w; x++)
+            {
+                glm::ivec2 &cell = grid[y * w + x];
+                compare(cell, x, y, -1, 0);
+                compare(cell, x, y, 0, -1);
+                compare(cell, x, y, -1, -1);
+                compare(cell, x, y, 1, -1);
+            }
+            for (int x = w - 1; x >= 0; x--)
+                compare(grid[y * w + x], x, y, 1, 0);
+        }
+
+        for (int y = h - 1; y >= 0; y--)
+        {
+            for (int x = w - 1; x >= 0; x--)
+            {
+                glm::ivec2 &cell = grid[y * w + x];
+                compare(cell, x, y, 1, 0);
+                compare(cell, x, y, 0, 1);
+                compare(cell, x, y, -1, 1);
+                compare(cell, x, y, 1, 1);
+            }
+            for (int x = 0; x < w; x++)
+                compare(grid[y * w + x], x, y, -1, 0);
+        }
+    }
+
+
+    // Converts a coverage bitmap, rasterized `supersample` times larger than the field,
+    // into a signed distance field padded by `spread` pixels (of the field) on each side.
+    // The bitmap starts `offset` pixels into the first block of pixels of the field.
+    // Values above 0.5 (128) are inside the glyph.
+    std::vector<unsigned char> BuildSignedDistanceField(const unsigned char *coverage, int width, int height,
+                                                        int pitch, glm::ivec2 offset, int supersample,
+                                                        int spread, glm::ivec2 &outSize)
+    {
+        const glm::ivec2 far(9999, 9999);
+        outSize = (offset + glm::ivec2(width, height) + glm::ivec2(supersample - 1)) / supersample +
+                  glm::ivec2(2 * spread);
+        glm::ivec2 gridSize = outSize * supersample;
+        glm::ivec2 origin = glm::ivec2(spread * supersample) + offset;
+        size_t count = static_cast<size_t>(gridSize.x) * gridSize.y;
+
+        std::vector<glm::ivec2> toInside(count, far);
+        std::vector<glm::ivec2> toOutside(count, far);
+
+        for (int y = 0; y < gridSize.y; y++)
+        {
+            for (int x = 0; x < gridSize.x; x++)
+            {
+                int bx = x - origin.x, by = y - origin.y;
+                bool inside = bx >= 0 && bx < width && by >= 0 && by < height &&
+                              coverage[by * pitch + bx] >= 128;
+                (inside ? toInside : toOutside)[y * gridSize.x + x] = glm::ivec2(0);
+            }
+        }
+
+        DistanceTransform(toInside, gridSize.x, gridSize.y);
+        DistanceTransform(toOutside, gridSize.x, gridSize.y);
+
+        // Each pixel of the field averages the distances of its block
+        std::vector<unsigned char> field(static_cast<size_t>(outSize.x) * outSize.y);
+        for (int y = 0; y < outSize.y; y++)
+        {
+            for (int x = 0; x < outSize.x; x++)
+            {
+                float distance = 0;
+                for (int sy = 0; sy < supersample; sy++)
+                {
+                    for (int sx = 0; sx < supersample; sx++)
+                    {
+                        size_t i = static_cast<size_t>(y * supersample + sy) * gridSize.x + x * supersample + sx;
+                        distance += glm::length(glm::vec2(toOutside[i])) - glm::length(glm::vec2(toInside[i]));
+                    }
+                }
+                distance /= static_cast<float>(supersample * supersample * supersample);
+
+                float value = 0.5f + distance / (2.0f * spread);
+                field[y * outSize.x + x] = static_cast<unsigned char>(glm::clamp(value, 0.0f, 1.0f) * 255.0f);
+            }
+        }
+
+        return field;
+    }
+
+
+    // Rounds towards negative infinity, unlike the division
+    int FloorDiv(int value, int divisor)
+    {
+        return value >= 0 ? value / divisor : -((-value + divisor - 1) / divisor);
+    }
+}
+
+
+gfxc::GlyphCache::GlyphCache(GLsizei pageSize, GLsizei maxPages)
+{
+    this->pageSize = pageSize;
+    this->useCounter = 0;
+    this->library = nullptr;
+
+    // Initialize the freetype library once, it is kept alive with all the
+    // opened faces until the cache is destroyed
+    if (FT_Init_FreeType(&this->library))
+    {
+        std::cout << "ERROR::FREETYPE: Could not init FreeType Library" << std::endl;
+        this->library = nullptr;
+    }
+
+    Page empty = { glm::ivec2(ATLAS_PADDING), 0, 0 };
+    this->pages.assign(maxPages, empty);
+
+    // Allocate all the pages upfront, they are filled in on demand
+    std::vector<unsigned char> zeros(static_cast<size_t>(pageSize) * pageSize * maxPages, 0);
+    glGenTextures(1, &this->textureID);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, this->textureID);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R8, pageSize, pageSize, maxPages, 0, GL_RED, GL_UNSIGNED_BYTE, zeros.data());
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    CheckOpenGLError();
+}
+
+
+gfxc::GlyphCache::~GlyphCache()
+{
+    glDeleteTextures(1, &this->textureID);
+
+    for (auto face : this->faces)
+    {
+        FT_Done_Face(face);
+    }
+    if (this->library)
+    {
+        FT_Done_FreeType(this->library);
+    }
+}
+
+
+int gfxc::GlyphCache::OpenFont(const std::string &font)
+{
+    auto it = std::find(this->fontPaths.begin(), this->fontPaths.end(), font);
+    if (it != this->fontPaths.end())
+    {
+        return static_cast<int>(it - this->fontPaths.begin());
+    }
+
+    // Load font as face
+    FT_Face face;
+    if (!this->library || FT_New_Face(this->library, font.c_str(), 0, &face))
+    {
+        std::cout << "ERROR::FREETYPE: Failed to load font" << std::endl;
+        return -1;
+    }
+
+    this->faces.push_back(face);
+    this->fontPaths.push_back(font);
+    this->faceSizes.push_back(0);
+    return static_cast<int>(this->faces.size() - 1);
+}
+
+
+const gfxc::Character *gfxc::GlyphCache::GetGlyph(int fontID, GLuint fontSize, bool sdf, char32_t codepoint)
+{
+    if (fontID < 0 || fontID >= static_cast<int>(this->faces.size()))
+    {
+        return nullptr;
+    }
+
+    // Distance fields are rasterized once, at the reference size, for all the sizes
+    GLuint rasterSize = GetRasterSize(fontSize, sdf);
+    unsigned long long key = GlyphKey(fontID, sdf ? 0 : fontSize, sdf, codepoint);
+    auto it = this->glyphs.find(key);
+    if (it != this->glyphs.end())
+    {
+        this->pages[it->second.Page].lastUse = ++this->useCounter;
+        return &it->second;
+    }
+
+    // Set size to load glyphs as, only when it changes
+    FT_Face face = this->faces[fontID];
+    GLuint loadSize = sdf ? rasterSize * SDF_SUPERSAMPLE : rasterSize;
+    if (this->faceSizes[fontID] != loadSize)
+    {
+        FT_Set_Pixel_Sizes(face, 0, loadSize);
+        this->faceSizes[fontID] = loadSize;
+    }
+
+    // Load character glyph
+    if (FT_Load_Char(face, codepoint, FT_LOAD_RENDER))
+    {
+        std::cout << "ERROR::FREETYTPE: Failed to load Glyph" << std::endl;
+        return nullptr;
+    }
+
+    const FT_Bitmap &bitmap = face->glyph->bitmap;
+    glm::ivec2 size(bitmap.width, bitmap.rows);
+    glm::ivec2 bearing(face->glyph->bitmap_left, face->glyph->bitmap_top);
+    GLuint advance = (GLuint)face->glyph->advance.x;
+
+    // Distance fields are built at the supersampled size, and need some room around
+    // the glyph for the falloff. The bitmap is aligned to the pixels of the field,
+    // so that the bearing stays a whole number of them.
+    std::vector<unsigned char> pixels;
+    int pitch = bitmap.pitch;
+    const unsigned char *source = bitmap.buffer;
+    if (sdf)
+    {
+        advance /= SDF_SUPERSAMPLE;
+        glm::ivec2 block(FloorDiv(bearing.x, SDF_SUPERSAMPLE), -FloorDiv(-bearing.y, SDF_SUPERSAMPLE));
+        glm::ivec2 offset(bearing.x - block.x * SDF_SUPERSAMPLE, block.y * SDF_SUPERSAMPLE - bearing.y);
+        bearing = block + glm::ivec2(-SDF_SPREAD, SDF_SPREAD);
+        if (size.x > 0 && size.y > 0)
+        {
+            pixels = BuildSignedDistanceField(bitmap.buffer, size.x, size.y, bitmap.pitch, offset, SDF_SUPERSAMPLE,
+                                              SDF_SPREAD, size);
+            pitch = size.x;
+            source = pixels.data();
+        }
+    }
+
+    GLuint page = 0;
+    glm::ivec2 position(0);
+    if (size.x > 0 && size.y > 0)
+    {
+        if (!Allocate(size, page, position))
+        {
+            std::cout << "ERROR::FREETYTPE: Glyph does not fit in the atlas" << std::endl;
+            return nullptr;
+        }
+
+        // Upload the glyph to its page. Disable byte-alignment restriction.
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, pitch);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, this->textureID);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, position.x, position.y, page, size.x, size.y, 1,
+                        GL_RED, GL_UNSIGNED_BYTE, source);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        CheckOpenGLError();
+    }
+
+    // Now store character for later use
+    Character character = {
+        glm::vec2(position) / static_cast<float>(this->pageSize),
+        glm::vec2(position + size) / static_cast<float>(this->pageSize),
+        size,
+        bearing,
+        advance,
+        page,
+        sdf
+    };
+
+    this->pages[page].lastUse = ++this->useCounter;
+    return &this->glyphs.emplace(key, character).first->second;
+}
+
+
+GLuint gfxc::GlyphCache::GetRasterSize(GLuint fontSize, bool sdf)
+{
+    return sdf ? SDF_REFERENCE_SIZE : fontSize;
+}
+
+
+void gfxc::GlyphCache::OnEvict(std::function<void()> onEvict)
+{
+    this->onEvict = onEvict;
+}
+
+
+GLuint gfxc::GlyphCache::GetTextureID() const
+{
+    return this->textureID;
+}
+
+
+bool gfxc::GlyphCache::Allocate(glm::ivec2 size, GLuint &page, glm::ivec2 &position)
+{
+    if (size.x + 2 * ATLAS_PADDING > this->pageSize || size.y + 2 * ATLAS_PADDING > this->pageSize)
+    {
+        return false;
+    }
+
+    // Pages are packed in rows ("shelves") of glyphs. A glyph either fits at the end of
+    // the current shelf, or on a new shelf right below it.
+    auto fits = [&](Page &p)
+    {
+        if (p.cursor.x + size.x + ATLAS_PADDING > this->pageSize)
+        {
+            if (p.cursor.y + p.shelfHeight + ATLAS_PADDING + size.y + ATLAS_PADDING > this->pageSize)
+                return false;
+            p.cursor = glm::ivec2(ATLAS_PADDING, p.cursor.y + p.shelfHeight + ATLAS_PADDING);
+            p.shelfHeight = 0;
+        }
+        return p.cursor.y + size.y + ATLAS_PADDING <= this->pageSize;
+    };
+
+    GLuint candidate = 0;
+    for (; candidate < this->pages.size(); candidate++)
+    {
+        if (fits(this->pages[candidate]))
+            break;
+    }
+
+    // All the pages are full, so the least recently used one is recycled
+    if (candidate == this->pages.size())
+    {
+        auto lru = std::min_element(this->pages.begin(), this->pages.end(),
+            [](const Page &a, const Page &b) { return a.lastUse < b.lastUse; });
+        candidate = static_cast<GLuint>(lru - this->pages.begin());
+        Evict(candidate);
+    }
+
+    Page &p = this->pages[candidate];
+    page = candidate;
+    position = p.cursor;
+    p.cursor.x += size.x + ATLAS_PADDING;
+    p.shelfHeight = std::max(p.shelfHeight, size.y);
+    return true;
+}
+
+
+void gfxc::GlyphCache::Evict(GLuint page)
+{
+    // Let the users draw whatever still references the page
+    if (this->onEvict)
+    {
+        this->onEvict();
+    }
+
+    for (auto it = this->glyphs.begin(); it != this->glyphs.end();)
+    {
+        if (it->second.Page == page && it->second.Size.x > 0 && it->second.Size.y > 0)
+            it = this->glyphs.erase(it);
+        else
+            ++it;
+    }
+
+    // Clear the page, so that the padding around the new glyphs is empty
+    std::vector<unsigned char> zeros(static_cast<size_t>(this->pageSize) * this->pageSize, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, this->textureID);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, page, this->pageSize, this->pageSize, 1,
+                    GL_RED, GL_UNSIGNED_BYTE, zeros.data());
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    CheckOpenGLError();
+
+    this->pages[page] = { glm::ivec2(ATLAS_PADDING), 0, 0 };
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+
+#include "GL/glew.h"
+#include "glm/glm.hpp"
+
+
+// Forward declarations of the FreeType handles, so that users of the
+// cache do not need the FreeType headers
+typedef struct FT_LibraryRec_ *FT_Library;
+typedef struct FT_FaceRec_ *FT_Face;
+
+
+namespace gfxc
+{
+    /// Holds all state information relevant to a character as loaded using FreeType
+    struct Character
+    {
+        glm::vec2 UVMin;    // Top-left corner of the glyph inside its atlas page
+        glm::vec2 UVMax;    // Bottom-right corner of the glyph inside its atlas page
+        glm::ivec2 Size;    // Size of glyph
+        glm::ivec2 Bearing; // Offset from baseline to left/top of glyph
+        GLuint Advance;     // Horizontal offset to advance to next glyph
+        GLuint Page;        // Layer of the atlas texture array holding the glyph
+        bool SDF;           // Whether the glyph is stored as a signed distance field
+    };
+
+
+    // A cache of rasterized glyphs, keyed by (font, size, codepoint). Glyphs are
+    // rasterized on demand into the layers ("pages") of a single texture array.
+    // Signed distance fields are kept once per codepoint, at a reference size
+    // (see GetRasterSize), and scaled to the size of the text when drawn.
+    // The number of pages is fixed, so memory stays bounded: when all pages are
+    // full, the least recently used page is cleared and its glyphs are dropped.
+    class GlyphCache
+    {
+     public:
+        GlyphCache(GLsizei pageSize = 512, GLsizei maxPages = 4);
+        ~GlyphCache();
+
+        // Opens a font face (or returns the already opened one).
+        // Returns the font ID, or -1 if the font could not be loaded.
+        int OpenFont(const std::string &font);
+
+        // Returns the glyph, rasterizing it if it isn't cached yet. The returned
+        // pointer is only valid until the next call, as it may trigger an eviction.
+        const Character *GetGlyph(int fontID, GLuint fontSize, bool sdf, char32_t codepoint);
+
+        // The size the glyphs of `fontSize` are rasterized at: their metrics are in
+        // its pixels, and are scaled by fontSize / GetRasterSize when drawn
+        static GLuint GetRasterSize(GLuint fontSize, bool sdf);
+
+        // Called right before a page is overwritten. Whoever still has quads
+        // referencing the page should draw them.
+        void OnEvict(std::function<void()> onEvict);
+
+        GLuint GetTextureID() const;
+
+     private:
+        struct Page
+        {
+            glm::ivec2 cursor;
+            int shelfHeight;
+            unsigned long long lastUse;
+        };
+
+        bool Allocate(glm::ivec2 size, GLuint &page, glm::ivec2 &position);
+        void Evict(GLuint page);
+
+     private:
+        FT_Library library;
+        std::vector<FT_Face> faces;
+        std::vector<std::string> fontPaths;
+        std::vector<GLuint> faceSizes;
+
+        GLuint textureID;
+        GLsizei pageSize;
+        std::vector<Page> pages;
+        unsigned long long useCounter;
+
+        std::unordered_map<unsigned long long, Character> glyphs;
+        std::function<void()> onEvict;
+    };
+}
@@ -0,0 +1,71 @@
+#include "components/profiler_overlay.h"
+
+#include <cstdio>
+
+#include "components/text_renderer.h"
+#include "core/gpu/gpu_profiler.h"
+#include "core/managers/resource_path.h"
+
+
+#define OVERLAY_FONT_SIZE   (16)
+#define OVERLAY_LINE_HEIGHT (20.0f)
+
+
+gfxc::ProfilerOverlay::ProfilerOverlay(const std::string &selfDir)
+{
+    this->selfDir = selfDir;
+    textRenderer = nullptr;
+    resolution = glm::ivec2(0);
+}
+
+
+gfxc::ProfilerOverlay::~ProfilerOverlay()
+{
+    delete textRenderer;
+}
+
+
+void gfxc::ProfilerOverlay::Draw(const glm::ivec2 &resolution, double frameSeconds)
+{
+    if (resolution.x <= 0 || resolution.y <= 0)
+        return;
+
+    if (!textRenderer || resolution != this->resolution)
+    {
+        delete textRenderer;
+        textRenderer = new TextRenderer(selfDir, resolution.x, resolution.y);
+        textRenderer->Load(PATH_JOIN(selfDir, RESOURCE_PATH::FONTS, "Hack-Bold.ttf"), OVERLAY_FONT_SIZE);
+        this->resolution = resolution;
+    }
+
+    GPUProfiler::Begin("Profiler overlay");
+
+    GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_SCISSOR_TEST);
+    glViewport(0, 0, resolution.x, resolution.y);
+
+    char line[128];
+    float y = 10;
+    textRenderer->BeginBatch();
+
+    snprintf(line, sizeof(line), "CPU frame %7.2f ms", frameSeconds * 1000);
+    textRenderer->RenderText(line, 10, y, 1, glm::vec3(1));
+    y += OVERLAY_LINE_HEIGHT;
+
+    // A few frames old, see GPUProfiler
+    for (const auto &range : GPUProfiler::GetLastFrame())
+    {
+        snprintf(line, sizeof(line), "GPU %*s%-24s %7.3f ms", static_cast<int>(2 * range.depth), "",
+                 range.name.c_str(), range.milliseconds);
+        textRenderer->RenderText(line, 10, y, 1, glm::vec3(1, 0.85f, 0.3f));
+        y += OVERLAY_LINE_HEIGHT;
+    }
+
+    textRenderer->EndBatch();
+
+    if (depthTest)
+        glEnable(GL_DEPTH_TEST);
+
+    GPUProfiler::End();
+}
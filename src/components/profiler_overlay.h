@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+
+#include "utils/glm_utils.h"
+
+
+namespace gfxc
+{
+    class TextRenderer;
+
+    // Draws the frame time and the GPU ranges of the last frame read back by
+    // GPUProfiler in the top left corner, over whatever was drawn before.
+    // Only used with the OpenGL context current.
+    class ProfilerOverlay
+    {
+     public:
+        explicit ProfilerOverlay(const std::string &selfDir);
+        ~ProfilerOverlay();
+
+        void Draw(const glm::ivec2 &resolution, double frameSeconds);
+
+     private:
+        std::string selfDir;
+        // Recreated when the resolution changes, its projection is fixed
+        TextRenderer *textRenderer;
+        glm::ivec2 resolution;
+    };
+}
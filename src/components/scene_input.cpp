@@ -3,6 +3,8 @@
 #include <iostream>
 
 #include "components/simple_scene.h"
+#include "core/profiler.h"
+#include "core/gpu/frame_capture.h"
 
 
 gfxc::SceneInput::SceneInput(SimpleScene *scene)
@@ -20,7 +22,31 @@ void gfxc::SceneInput::OnKeyPress(int key, int mods)
 
     if (key == GLFW_KEY_F5)
     {
-        scene->ReloadShaders();
+        // The input may be handled without the context, see World::RunWithContext
+        SimpleScene *scene = this->scene;
+        scene->RunWithContext([scene]() { scene->ReloadShaders(); });
+    }
+
+    if (key == GLFW_KEY_F9)
+    {
+        // Open with ui.perfetto.dev or chrome://tracing
+        Profiler::Capture("profile_trace.json", 120);
+    }
+
+    if (key == GLFW_KEY_F10)
+    {
+        scene->SetProfilerOverlay(!scene->IsProfilerOverlayShown());
+    }
+
+    if (key == GLFW_KEY_F12)
+    {
+        // Shift+F12 records every frame instead, as capture_<frame>.qoi
+        if (!(mods & GLFW_MOD_SHIFT))
+            FrameCapture::Capture("screenshot.png");
+        else if (FrameCapture::IsRecording())
+            FrameCapture::StopRecording();
+        else
+            FrameCapture::StartRecording("capture", FrameCapture::Format::QOI);
     }
 
     if (key == GLFW_KEY_ESCAPE)
@@ -73,7 +73,7 @@ void SimpleScene::InitResources()
         Shader *shader = new Shader("Simple");
         shader->AddShader(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS, "MVP.Texture.VS.glsl"), GL_VERTEX_SHADER);
         shader->AddShader(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS, "Default.FS.glsl"), GL_FRAGMENT_SHADER);
-        shader->CreateAndLink();
+        shader->Submit();
         shaders[shader->GetName()] = shader;
     }
 
@@ -82,7 +82,7 @@ void SimpleScene::InitResources()
         Shader *shader = new Shader("Color");
         shader->AddShader(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS, "MVP.Texture.VS.glsl"), GL_VERTEX_SHADER);
         shader->AddShader(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS, "Color.FS.glsl"), GL_FRAGMENT_SHADER);
-        shader->CreateAndLink();
+        shader->Submit();
         shaders[shader->GetName()] = shader;
     }
 
@@ -91,7 +91,7 @@ void SimpleScene::InitResources()
         Shader *shader = new Shader("VertexNormal");
         shader->AddShader(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS, "MVP.Texture.VS.glsl"), GL_VERTEX_SHADER);
         shader->AddShader(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS, "Normals.FS.glsl"), GL_FRAGMENT_SHADER);
-        shader->CreateAndLink();
+        shader->Submit();
         shaders[shader->GetName()] = shader;
     }
 
@@ -100,10 +100,13 @@ void SimpleScene::InitResources()
         Shader *shader = new Shader("VertexColor");
         shader->AddShader(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS, "MVP.Texture.VS.glsl"), GL_VERTEX_SHADER);
         shader->AddShader(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS, "VertexColor.FS.glsl"), GL_FRAGMENT_SHADER);
-        shader->CreateAndLink();
+        shader->Submit();
         shaders[shader->GetName()] = shader;
     }
 
+    // The shaders above were compiled in parallel, if the driver can
+    Shader::FinishAll(true);
+
     // Default rendering mode will use depth buffer
     glDepthMask(GL_TRUE);
     glEnable(GL_DEPTH_TEST);
@@ -8,18 +8,25 @@
 ******************************************************************/
 #include "components/text_renderer.h"
 
+#include <algorithm>
+#include <cstddef>
 #include <iostream>
 
 #include "utils/text_utils.h"
 #include "glm/gtc/matrix_transform.hpp"
 #include "core/managers/resource_path.h"
 
-#include "ft2build.h"
-#include FT_FREETYPE_H
-
-
 gfxc::TextRenderer::TextRenderer(const std::string &selfDir, GLuint width, GLuint height)
 {
+    fontID = -1;
+    fontSize = 0;
+    sdf = false;
+    bufferCapacity = 0;
+    batching = false;
+
+    // Quads queued before an eviction reference the old content of the page
+    glyphCache.OnEvict([this]() { Flush(); });
+
     // Load and configure shader
     Shader *shader = new Shader("ShaderText");
     shader->AddShader(PATH_JOIN(selfDir, RESOURCE_PATH::SHADERS, "Text.VS.glsl"), GL_VERTEX_SHADER);
@@ -27,163 +34,162 @@ gfxc::TextRenderer::TextRenderer(const std::string &selfDir, GLuint width, GLuin
     shader->CreateAndLink();
     this->m_textShader = shader;
 
-    
+
     int loc_projection_matrix = glGetUniformLocation(shader->program, "projection");
     glUniformMatrix4fv(loc_projection_matrix, 1, GL_FALSE, glm::value_ptr(glm::ortho(0.0f, static_cast<GLfloat>(width), static_cast<GLfloat>(height), 0.0f)));
 
     int loc_text = glGetUniformLocation(shader->program, "text");
     glUniform1i(loc_text, 0);
 
-    // Configure VAO/VBO for texture quads
+    // Configure VAO/VBO for texture quads. The storage of the VBO is
+    // allocated (and orphaned) on demand, when the quads are flushed.
     glGenVertexArrays(1, &this->VAO);
     glGenBuffers(1, &this->VBO);
     glBindVertexArray(this->VAO);
     glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 6 * 4, NULL, GL_DYNAMIC_DRAW);
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), 0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)offsetof(TextVertex, PosUV));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)offsetof(TextVertex, Color));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)offsetof(TextVertex, Layer));
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
 }
 
 
-void gfxc::TextRenderer::Load(std::string font, GLuint fontSize)
+gfxc::TextRenderer::~TextRenderer()
 {
-    // First clear the previously loaded Characters
-    this->Characters.clear();
+    glDeleteBuffers(1, &this->VBO);
+    glDeleteVertexArrays(1, &this->VAO);
+}
 
-    // Initialize and load the freetype library. All freetype functions
-    // return a value different than 0 whenever an error occurs.
-    FT_Library ft;
 
-    if (FT_Init_FreeType(&ft))
-    {
-        std::cout << "ERROR::FREETYPE: Could not init FreeType Library" << std::endl;
-    }
+void gfxc::TextRenderer::Load(std::string font, GLuint fontSize, bool sdf)
+{
+    // The face stays open in the cache, glyphs are rasterized on first use
+    this->fontID = this->glyphCache.OpenFont(font);
+    this->fontSize = fontSize;
+    this->sdf = sdf;
+}
+
 
-    // Load font as face
-    FT_Face face;
-    if (FT_New_Face(ft, font.c_str(), 0, &face))
+void gfxc::TextRenderer::RenderText(const std::string &text, GLfloat x, GLfloat y, GLfloat scale, glm::vec3 color)
+{
+    if (this->fontID < 0)
     {
-        std::cout << "ERROR::FREETYPE: Failed to load font" << std::endl;
+        return;
     }
 
-    // Set size to load glyphs as
-    FT_Set_Pixel_Sizes(face, 0, fontSize);
+    // Distance fields are stored at one size for all, and scaled to the font size here
+    scale *= static_cast<GLfloat>(this->fontSize) / GlyphCache::GetRasterSize(this->fontSize, this->sdf);
+
+    // The top of the capital letters is used as the reference line. Glyph
+    // pointers are only valid until the next lookup, so the value is copied.
+    const Character *reference = this->glyphCache.GetGlyph(this->fontID, this->fontSize, this->sdf, U'H');
+    GLfloat referenceTop = reference ? static_cast<GLfloat>(reference->Bearing.y) : 0.0f;
 
-    // Disable byte-alignment restriction
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    std::u32string codepoints = text_utils::DecodeUTF8(text);
+    this->vertices.reserve(this->vertices.size() + 6 * codepoints.size());
 
-    // Then for the first 128 ASCII characters, pre-load/compile their characters and store them
-    for (GLubyte c = 0; c < 128; c++)
+    // Iterate through all characters
+    for (char32_t codepoint : codepoints)
     {
-        // Load character glyph 
-        if (FT_Load_Char(face, c, FT_LOAD_RENDER))
+        const Character *ch = this->glyphCache.GetGlyph(this->fontID, this->fontSize, this->sdf, codepoint);
+        if (!ch)
         {
-            std::cout << "ERROR::FREETYTPE: Failed to load Glyph" << std::endl;
             continue;
         }
 
-        // Generate texture
-        GLuint texture;
-        glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
-        glTexImage2D(
-            GL_TEXTURE_2D,
-            0,
-            GL_RED,
-            face->glyph->bitmap.width,
-            face->glyph->bitmap.rows,
-            0,
-            GL_RED,
-            GL_UNSIGNED_BYTE,
-            face->glyph->bitmap.buffer
-        );
-
-        // Set texture options
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        // Now store character for later use
-        Character character = {
-            texture,
-            glm::ivec2(face->glyph->bitmap.width, face->glyph->bitmap.rows),
-            glm::ivec2(face->glyph->bitmap_left, face->glyph->bitmap_top),
-            (GLuint)face->glyph->advance.x
+        GLfloat xpos = x + ch->Bearing.x * scale;
+        GLfloat ypos = y + (referenceTop - ch->Bearing.y) * scale;
+
+        GLfloat w = ch->Size.x * scale;
+        GLfloat h = ch->Size.y * scale;
+
+        // Now advance cursors for next glyph. Bitshift by 6
+        // to get value in pixels.
+        x += (ch->Advance >> 6) * scale;
+
+        if (ch->Size.x == 0 || ch->Size.y == 0)
+        {
+            continue;
+        }
+
+        // Queue the quad of the glyph
+        glm::vec2 layer(ch->Page, ch->SDF);
+        TextVertex quad[6] = {
+            { glm::vec4(xpos,     ypos + h,   ch->UVMin.x, ch->UVMax.y), color, layer },
+            { glm::vec4(xpos + w, ypos,       ch->UVMax.x, ch->UVMin.y), color, layer },
+            { glm::vec4(xpos,     ypos,       ch->UVMin.x, ch->UVMin.y), color, layer },
+
+            { glm::vec4(xpos,     ypos + h,   ch->UVMin.x, ch->UVMax.y), color, layer },
+            { glm::vec4(xpos + w, ypos + h,   ch->UVMax.x, ch->UVMax.y), color, layer },
+            { glm::vec4(xpos + w, ypos,       ch->UVMax.x, ch->UVMin.y), color, layer }
         };
+        this->vertices.insert(this->vertices.end(), quad, quad + 6);
+    }
 
-        Characters.insert(std::pair<GLchar, Character>(c, character));
+    if (!this->batching)
+    {
+        Flush();
     }
+}
 
-    glBindTexture(GL_TEXTURE_2D, 0);
 
-    // Destroy freetype once we're finished
-    FT_Done_Face(face);
-    FT_Done_FreeType(ft);
+void gfxc::TextRenderer::BeginBatch()
+{
+    this->batching = true;
 }
 
 
-void gfxc::TextRenderer::RenderText(std::string text, GLfloat x, GLfloat y, GLfloat scale, glm::vec3 color)
+void gfxc::TextRenderer::EndBatch()
 {
-    // Activate corresponding render state    
+    this->batching = false;
+    Flush();
+}
+
+
+void gfxc::TextRenderer::Flush()
+{
+    if (this->vertices.empty())
+    {
+        return;
+    }
+
+    // Activate corresponding render state
     if (this->m_textShader)
     {
         glUseProgram(this->m_textShader->program);
         CheckOpenGLError();
     }
 
-    // TODO(developer): Update this class
-    int loc_text_color = glGetUniformLocation(this->m_textShader->program, "textColor");
-    glUniform3f(loc_text_color, color.r, color.g, color.b);
-
     glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, this->glyphCache.GetTextureID());
     glBindVertexArray(this->VAO);
 
-    // Iterate through all characters
-    for (auto c = text.cbegin(); c != text.cend(); c++)
-    {
-        Character ch = Characters[*c];
-
-        GLfloat xpos = x + ch.Bearing.x * scale;
-        GLfloat ypos = y + (this->Characters['H'].Bearing.y - ch.Bearing.y) * scale;
-
-        GLfloat w = ch.Size.x * scale;
-        GLfloat h = ch.Size.y * scale;
-
-        // Update VBO for each character
-        GLfloat vertices[6][4] = {
-            { xpos,     ypos + h,   0.0, 1.0 },
-            { xpos + w, ypos,       1.0, 0.0 },
-            { xpos,     ypos,       0.0, 0.0 },
-
-            { xpos,     ypos + h,   0.0, 1.0 },
-            { xpos + w, ypos + h,   1.0, 1.0 },
-            { xpos + w, ypos,       1.0, 0.0 }
-        };
-
-        // Render glyph texture over quad
-        glBindTexture(GL_TEXTURE_2D, ch.TextureID);
-
-        // Update content of VBO memory
-        glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices); // Be sure to use glBufferSubData and not glBufferData
-
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    // Update content of VBO memory. The previous storage is orphaned, so that
+    // the driver does not have to wait for the previous draw to finish.
+    size_t size = sizeof(TextVertex) * this->vertices.size();
+    glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+    this->bufferCapacity = std::max(this->bufferCapacity, size);
+    glBufferData(GL_ARRAY_BUFFER, this->bufferCapacity, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, this->vertices.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-        // Render quad
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+    // Render all the quads at once
+    GLboolean blendEnabled = glIsEnabled(GL_BLEND);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(this->vertices.size()));
+    if (!blendEnabled)
+    {
         glDisable(GL_BLEND);
-
-        // Now advance cursors for next glyph. Bitshift by 6
-        // to get value in pixels.
-        x += (ch.Advance >> 6) * scale; 
     }
 
     glBindVertexArray(0);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    this->vertices.clear();
 }
@@ -9,12 +9,13 @@
 #ifndef TEXT_RENDERER_H
 #define TEXT_RENDERER_H
 
-#include <map>
 #include <string>
+#include <vector>
 
 #include "GL/glew.h"
 #include "glm/glm.hpp"
 
+#include "components/glyph_cache.h"
 #include "core/gpu/mesh.h"
 #include "core/gpu/shader.h"
 #include "core/engine.h"
@@ -22,42 +23,60 @@
 
 namespace gfxc
 {
-    /// Holds all state information relevant to a character as loaded using FreeType
-    struct Character
-    {
-        GLuint TextureID;   // ID handle of the glyph texture
-        glm::ivec2 Size;    // Size of glyph
-        glm::ivec2 Bearing; // Offset from baseline to left/top of glyph
-        GLuint Advance;     // Horizontal offset to advance to next glyph
-    };
-
-
-    // A renderer class for rendering text displayed by a font loaded using the 
-    // FreeType library. A single font is loaded, processed into a list of Character
-    // items for later rendering.
+    // A renderer class for rendering text displayed by a font loaded using the
+    // FreeType library. Glyphs are rasterized on first use into a GlyphCache, so any
+    // UTF-8 text can be drawn. The quads of every string are batched into one
+    // streaming vertex buffer, so that a whole string (or a whole frame of text,
+    // between BeginBatch and EndBatch) is drawn with a single draw call.
     class TextRenderer
     {
      public:
-        // Holds a list of pre-compiled Characters
-        std::map<GLchar, Character> Characters;
-
         // Shader used for text rendering
         Shader *m_textShader;
 
         public:
         // Constructor
         TextRenderer(const std::string &selfDir, GLuint width, GLuint height);
+        ~TextRenderer();
+
+        // Selects the font used by the following RenderText calls. When `sdf` is set,
+        // glyphs are stored as signed distance fields instead of coverage, so that
+        // they stay sharp at any scale.
+        void Load(std::string font, GLuint fontSize, bool sdf = false);
 
-        // Pre-compiles a list of characters from the given font
-        void Load(std::string font, GLuint fontSize);
+        // Renders an UTF-8 string of text using the current font. Outside of
+        // a batch the string is drawn immediately, otherwise it is queued.
+        void RenderText(const std::string &text, GLfloat x, GLfloat y, GLfloat scale, glm::vec3 color = glm::vec3(1.0f));
+
+        // Queue all following RenderText calls and draw them at once in EndBatch
+        void BeginBatch();
+        void EndBatch();
+
+     private:
+        struct TextVertex
+        {
+            glm::vec4 PosUV;    // <vec2 pos, vec2 tex>
+            glm::vec3 Color;
+            glm::vec2 Layer;    // <atlas page, sdf>
+        };
+
+        void Flush();
 
-        // Renders a string of text using the precompiled list of characters
-        void RenderText(std::string text, GLfloat x, GLfloat y, GLfloat scale, glm::vec3 color = glm::vec3(1.0f));
-        
      private:
         // Render state
         GLuint VAO, VBO;
+        GlyphCache glyphCache;
+
+        // Current font
+        int fontID;
+        GLuint fontSize;
+        bool sdf;
+
+        // Streaming vertex storage
+        std::vector<TextVertex> vertices;
+        size_t bufferCapacity;
+        bool batching;
     };
 }
 
-#endif 
+#endif
@@ -2,8 +2,20 @@
 
 #include <iostream>
 
+#include "core/frame_stats.h"
+#include "core/job_system.h"
+#include "core/profiler.h"
+#include "core/gpu/frame_capture.h"
+#include "core/gpu/gpu_buffers.h"
+#include "core/gpu/gpu_profiler.h"
+#include "core/gpu/gpu_readback.h"
+#include "core/gpu/render_target_pool.h"
+#include "core/gpu/shader.h"
+#include "core/managers/file_watcher.h"
+#include "core/managers/resource_path.h"
 #include "core/managers/texture_manager.h"
 #include "utils/gl_utils.h"
+#include "utils/text_utils.h"
 
 
 WindowObject* Engine::window = nullptr;
@@ -26,7 +38,18 @@ WindowObject* Engine::Init(const WindowProperties & props)
         exit(0);
     }
 
+    // Let the driver compile shaders on as many threads as it wants
+    if (GLEW_ARB_parallel_shader_compile)
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+
+    PROFILE_THREAD("Main thread");
+    JobSystem::Init();
     TextureManager::Init(window->props.selfDir);
+    Shader::SetBinaryCacheDirectory(PATH_JOIN(window->props.selfDir, "cache", "shaders"));
+
+    // Hot reload of the assets and of the shaders next to the sources
+    FileWatcher::Init({ PATH_JOIN(window->props.selfDir, RESOURCE_PATH::ROOT),
+                        PATH_JOIN(window->props.selfDir, SOURCE_PATH::MAIN) });
 
     return window;
 }
@@ -42,6 +65,15 @@ void Engine::Exit()
 {
     std::cout << "=====================================================" << std::endl;
     std::cout << "Engine closed. Exit" << std::endl;
+    Profiler::Exit();
+    FrameStats::Exit();
+    FileWatcher::Exit();
+    FrameCapture::Exit();
+    JobSystem::Exit();
+    GPUReadback::Clear();
+    GPUProfiler::Clear();
+    RenderTargetPool::Clear();
+    gpu_utils::ReleaseMeshArenas();
     glfwTerminate();
 }
 
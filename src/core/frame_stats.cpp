@@ -0,0 +1,203 @@
+#include "core/frame_stats.h"
+
+#include <new>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+
+
+std::atomic<int64_t> FrameStats::counters[NR_COUNTERS];
+std::vector<int64_t> FrameStats::history[NR_COUNTERS];
+unsigned int FrameStats::historyNext = 0;
+unsigned long long FrameStats::nrFrames = 0;
+std::string FrameStats::dumpFile;
+
+static const char *counterNames[FrameStats::NR_COUNTERS] = {
+    "draw_calls",
+    "triangles",
+    "state_changes",
+    "uniform_uploads",
+    "buffer_bytes_uploaded",
+    "texture_binds",
+    "collision_pairs_tested",
+    "collisions",
+    "heap_allocations",
+    "frame_time_us",
+    "game_objects_3d",
+    "game_objects_2d",
+};
+
+
+#ifdef USE_PROFILER
+// The other forms of new (arrays, nothrow) go through this one, and the
+// default delete frees with free()
+void *operator new(std::size_t size)
+{
+    FrameStats::Add(FrameStats::HEAP_ALLOCATIONS);
+    while (true)
+    {
+        if (void *pointer = std::malloc(size ? size : 1))
+            return pointer;
+
+        std::new_handler handler = std::get_new_handler();
+        if (!handler)
+            throw std::bad_alloc();
+        handler();
+    }
+}
+#endif
+
+
+int64_t FrameStats::Get(Counter counter)
+{
+    return counters[counter].load(std::memory_order_relaxed);
+}
+
+
+void FrameStats::EndFrame(double frameSeconds)
+{
+    counters[FRAME_TIME_US].store(static_cast<int64_t>(frameSeconds * 1e6), std::memory_order_relaxed);
+
+    for (int i = 0; i < NR_COUNTERS; i++)
+    {
+        // The gauges keep their value, the rest start over
+        int64_t value = (i == GAME_OBJECTS_3D || i == GAME_OBJECTS_2D)
+            ? counters[i].load(std::memory_order_relaxed)
+            : counters[i].exchange(0, std::memory_order_relaxed);
+
+        if (history[i].size() < HISTORY_SIZE)
+            history[i].push_back(value);
+        else
+            history[i][historyNext] = value;
+    }
+
+    historyNext = (historyNext + 1) % HISTORY_SIZE;
+    nrFrames++;
+}
+
+
+FrameStats::Summary FrameStats::GetSummary(Counter counter)
+{
+    const std::vector<int64_t> &values = history[counter];
+    if (values.empty())
+        return { 0, 0, 0, 0 };
+
+    std::vector<int64_t> sorted = values;
+    std::sort(sorted.begin(), sorted.end());
+
+    double sum = 0;
+    for (int64_t value : sorted)
+        sum += static_cast<double>(value);
+
+    // Nearest rank
+    size_t rank = static_cast<size_t>(std::ceil(0.99 * sorted.size()));
+    return { sorted.front(), sum / sorted.size(), sorted[std::max<size_t>(rank, 1) - 1], sorted.back() };
+}
+
+
+unsigned int FrameStats::GetHistorySize()
+{
+    return static_cast<unsigned int>(history[0].size());
+}
+
+
+const char *FrameStats::GetName(Counter counter)
+{
+    return counterNames[counter];
+}
+
+
+bool FrameStats::Write(const std::string &fileName)
+{
+    bool csv = fileName.size() >= 4 && fileName.compare(fileName.size() - 4, 4, ".csv") == 0;
+    bool written = csv ? WriteCSV(fileName) : WriteJSON(fileName);
+    if (!written)
+        std::cout << "FrameStats: cannot write " << fileName << std::endl;
+    return written;
+}
+
+
+void FrameStats::SetDumpFile(const std::string &fileName)
+{
+    dumpFile = fileName;
+}
+
+
+void FrameStats::Exit()
+{
+    if (!dumpFile.empty() && GetHistorySize() > 0)
+        Write(dumpFile);
+}
+
+
+bool FrameStats::WriteCSV(const std::string &fileName)
+{
+    FILE *file = fopen(fileName.c_str(), "w");
+    if (!file)
+        return false;
+
+    fprintf(file, "frame");
+    for (int i = 0; i < NR_COUNTERS; i++)
+        fprintf(file, ",%s", counterNames[i]);
+    fprintf(file, "\n");
+
+    // Oldest first; the frames are numbered from the first one ever counted
+    unsigned int size = GetHistorySize();
+    unsigned int first = (size < HISTORY_SIZE) ? 0 : historyNext;
+    for (unsigned int n = 0; n < size; n++)
+    {
+        fprintf(file, "%llu", nrFrames - size + n);
+        for (int i = 0; i < NR_COUNTERS; i++)
+            fprintf(file, ",%lld", static_cast<long long>(history[i][(first + n) % size]));
+        fprintf(file, "\n");
+    }
+
+    const char *rows[] = { "min", "avg", "p99", "max" };
+    for (int row = 0; row < 4; row++)
+    {
+        fprintf(file, "%s", rows[row]);
+        for (int i = 0; i < NR_COUNTERS; i++)
+        {
+            Summary summary = GetSummary(static_cast<Counter>(i));
+            switch (row)
+            {
+            case 0: fprintf(file, ",%lld", static_cast<long long>(summary.min)); break;
+            case 1: fprintf(file, ",%.3f", summary.average); break;
+            case 2: fprintf(file, ",%lld", static_cast<long long>(summary.p99)); break;
+            case 3: fprintf(file, ",%lld", static_cast<long long>(summary.max)); break;
+            }
+        }
+        fprintf(file, "\n");
+    }
+
+    fclose(file);
+    return true;
+}
+
+
+bool FrameStats::WriteJSON(const std::string &fileName)
+{
+    FILE *file = fopen(fileName.c_str(), "w");
+    if (!file)
+        return false;
+
+    unsigned int size = GetHistorySize();
+    unsigned int first = (size < HISTORY_SIZE) ? 0 : historyNext;
+    fprintf(file, "{\n  \"frames\": %llu,\n  \"first_frame\": %llu,\n  \"counters\": {", nrFrames, nrFrames - size);
+    for (int i = 0; i < NR_COUNTERS; i++)
+    {
+        Summary summary = GetSummary(static_cast<Counter>(i));
+        fprintf(file, "%s\n    \"%s\": {\"min\": %lld, \"avg\": %.3f, \"p99\": %lld, \"max\": %lld, \"history\": [",
+                i ? "," : "", counterNames[i], static_cast<long long>(summary.min), summary.average,
+                static_cast<long long>(summary.p99), static_cast<long long>(summary.max));
+        for (unsigned int n = 0; n < size; n++)
+            fprintf(file, "%s%lld", n ? ", " : "", static_cast<long long>(history[i][(first + n) % size]));
+        fprintf(file, "]}");
+    }
+    fprintf(file, "\n  }\n}\n");
+
+    fclose(file);
+    return true;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+
+// What the engine did in each frame, for the last HISTORY_SIZE frames. The
+// counters are atomic, so any thread may add to them; with threaded rendering,
+// what the render thread replays is counted in the frame after the one it
+// belongs to. Heap allocations are only counted with USE_PROFILER, which
+// replaces the global operator new.
+class FrameStats
+{
+ public:
+    enum Counter
+    {
+        DRAW_CALLS,
+        TRIANGLES,
+        // Programs put in use, and the states set by the render commands
+        STATE_CHANGES,
+        UNIFORM_UPLOADS,
+        BUFFER_BYTES_UPLOADED,
+        TEXTURE_BINDS,
+        COLLISION_PAIRS_TESTED,
+        COLLISIONS,
+        HEAP_ALLOCATIONS,
+        FRAME_TIME_US,
+        // Gauges: the live objects, never reset
+        GAME_OBJECTS_3D,
+        GAME_OBJECTS_2D,
+        NR_COUNTERS
+    };
+
+    struct Summary
+    {
+        int64_t min;
+        double average;
+        int64_t p99;
+        int64_t max;
+    };
+
+    static void Add(Counter counter, int64_t amount = 1)
+    {
+        counters[counter].fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    // The frame being counted
+    static int64_t Get(Counter counter);
+    // Called at the end of every frame, by World
+    static void EndFrame(double frameSeconds);
+
+    // Over the frames in the history
+    static Summary GetSummary(Counter counter);
+    static unsigned int GetHistorySize();
+    static const char *GetName(Counter counter);
+
+    // The history and the summaries: CSV (one row per frame, then the summaries)
+    // if the name ends with .csv, JSON otherwise
+    static bool Write(const std::string &fileName);
+    // Written by Exit, none by default
+    static void SetDumpFile(const std::string &fileName);
+    static void Exit();
+
+ protected:
+    FrameStats() = delete;
+    ~FrameStats() = delete;
+
+ private:
+    static bool WriteCSV(const std::string &fileName);
+    static bool WriteJSON(const std::string &fileName);
+
+ private:
+    static const unsigned int HISTORY_SIZE = 1000;
+
+    static std::atomic<int64_t> counters[NR_COUNTERS];
+    // Ring of frames, oldest first from `historyNext` once full
+    static std::vector<int64_t> history[NR_COUNTERS];
+    static unsigned int historyNext;
+    static unsigned long long nrFrames;
+    static std::string dumpFile;
+};
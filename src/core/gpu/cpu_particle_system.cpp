@@ -0,0 +1,249 @@
+#include "core/gpu/cpu_particle_system.h"
+
+#include <cmath>
+#include <algorithm>
+
+#include "core/job_system.h"
+
+
+// Below this many particles, spreading the work over threads costs more than it saves
+#define PARALLEL_PARTICLES_THRESHOLD    (16384)
+
+
+// -------------------------------------------------------------------------
+// The widest vector instructions the build targets
+
+#if defined(__AVX__)
+#   include <immintrin.h>
+#   define SIMD_SSE
+#   define SIMD_WIDTH   (8)
+typedef __m256 SimdFloat;
+static inline SimdFloat SimdLoad(const float *p)                { return _mm256_loadu_ps(p); }
+static inline void SimdStore(float *p, SimdFloat v)             { _mm256_storeu_ps(p, v); }
+static inline SimdFloat SimdSet(float v)                        { return _mm256_set1_ps(v); }
+static inline SimdFloat SimdAdd(SimdFloat a, SimdFloat b)       { return _mm256_add_ps(a, b); }
+static inline SimdFloat SimdSub(SimdFloat a, SimdFloat b)       { return _mm256_sub_ps(a, b); }
+static inline SimdFloat SimdMul(SimdFloat a, SimdFloat b)       { return _mm256_mul_ps(a, b); }
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   include <emmintrin.h>
+#   define SIMD_SSE
+#   define SIMD_WIDTH   (4)
+typedef __m128 SimdFloat;
+static inline SimdFloat SimdLoad(const float *p)                { return _mm_loadu_ps(p); }
+static inline void SimdStore(float *p, SimdFloat v)             { _mm_storeu_ps(p, v); }
+static inline SimdFloat SimdSet(float v)                        { return _mm_set1_ps(v); }
+static inline SimdFloat SimdAdd(SimdFloat a, SimdFloat b)       { return _mm_add_ps(a, b); }
+static inline SimdFloat SimdSub(SimdFloat a, SimdFloat b)       { return _mm_sub_ps(a, b); }
+static inline SimdFloat SimdMul(SimdFloat a, SimdFloat b)       { return _mm_mul_ps(a, b); }
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#   include <arm_neon.h>
+#   define SIMD_WIDTH   (4)
+typedef float32x4_t SimdFloat;
+static inline SimdFloat SimdLoad(const float *p)                { return vld1q_f32(p); }
+static inline void SimdStore(float *p, SimdFloat v)             { vst1q_f32(p, v); }
+static inline SimdFloat SimdSet(float v)                        { return vdupq_n_f32(v); }
+static inline SimdFloat SimdAdd(SimdFloat a, SimdFloat b)       { return vaddq_f32(a, b); }
+static inline SimdFloat SimdSub(SimdFloat a, SimdFloat b)       { return vsubq_f32(a, b); }
+static inline SimdFloat SimdMul(SimdFloat a, SimdFloat b)       { return vmulq_f32(a, b); }
+#else
+#   define SIMD_WIDTH   (1)
+typedef float SimdFloat;
+static inline SimdFloat SimdLoad(const float *p)                { return *p; }
+static inline void SimdStore(float *p, SimdFloat v)             { *p = v; }
+static inline SimdFloat SimdSet(float v)                        { return v; }
+static inline SimdFloat SimdAdd(SimdFloat a, SimdFloat b)       { return a + b; }
+static inline SimdFloat SimdSub(SimdFloat a, SimdFloat b)       { return a - b; }
+static inline SimdFloat SimdMul(SimdFloat a, SimdFloat b)       { return a * b; }
+#endif
+
+
+std::vector<float> CPUParticleSystem::* const CPUParticleSystem::particleArrays[] = {
+    &CPUParticleSystem::px, &CPUParticleSystem::py, &CPUParticleSystem::pz,
+    &CPUParticleSystem::vx, &CPUParticleSystem::vy, &CPUParticleSystem::vz,
+    &CPUParticleSystem::life, &CPUParticleSystem::invLifetime,
+    &CPUParticleSystem::r, &CPUParticleSystem::g, &CPUParticleSystem::b, &CPUParticleSystem::a,
+};
+
+
+// Calls `function(begin, end)` over [0, count), spread over the job system for
+// large counts. The ranges start at multiples of SIMD_WIDTH.
+template <typename Function>
+static void ParallelFor(unsigned int count, Function function)
+{
+    // A batch per core
+    unsigned int batchSize = count;
+    if (count >= PARALLEL_PARTICLES_THRESHOLD)
+        batchSize = count / (JobSystem::GetWorkerCount() + 1) + 1;
+
+    JobSystem::ParallelFor(count, batchSize, function, SIMD_WIDTH);
+}
+
+
+CPUParticleSystem::CPUParticleSystem(unsigned int maxParticles)
+{
+    this->maxParticles = maxParticles;
+    liveCount = 0;
+    randomState = 0x9E3779B9;
+    gravity = glm::vec3(0);
+    damping = 1;
+
+    // The kernels run over whole vectors, past the last live particle
+    unsigned int padded = (maxParticles + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+    for (auto array : particleArrays)
+        (this->*array).assign(padded, 0.0f);
+}
+
+
+void CPUParticleSystem::Emit(const EmitParameters &parameters, unsigned int count)
+{
+    unsigned int end = std::min(liveCount + count, maxParticles);
+    for (unsigned int i = liveCount; i < end; i++)
+    {
+        px[i] = parameters.position.x;
+        py[i] = parameters.position.y;
+        pz[i] = parameters.position.z;
+        vx[i] = parameters.velocity.x + Random() * parameters.velocitySpread.x;
+        vy[i] = parameters.velocity.y + Random() * parameters.velocitySpread.y;
+        vz[i] = parameters.velocity.z + Random() * parameters.velocitySpread.z;
+
+        float lifetime = std::max(parameters.lifetime + Random() * parameters.lifetimeSpread, 1e-4f);
+        life[i] = lifetime;
+        invLifetime[i] = 1.0f / lifetime;
+
+        r[i] = parameters.color.r;
+        g[i] = parameters.color.g;
+        b[i] = parameters.color.b;
+        a[i] = parameters.color.a;
+    }
+    liveCount = end;
+}
+
+
+void CPUParticleSystem::Update(float deltaTime)
+{
+    if (liveCount == 0)
+        return;
+
+    float frameDamping = std::pow(damping, deltaTime);
+    ParallelFor(liveCount, [&](unsigned int begin, unsigned int end) {
+        Integrate(begin, end, deltaTime, frameDamping);
+    });
+    Kill();
+}
+
+
+void CPUParticleSystem::Clear()
+{
+    liveCount = 0;
+}
+
+
+unsigned int CPUParticleSystem::Write(CPUParticle *out, unsigned int maxCount) const
+{
+    unsigned int count = std::min(liveCount, maxCount);
+    ParallelFor(count, [&](unsigned int begin, unsigned int end) {
+        WriteRange(out, begin, end);
+    });
+    return count;
+}
+
+
+void CPUParticleSystem::Feed(ParticleEffect<CPUParticle> &effect) const
+{
+    CPUParticle *out = effect.MapParticles();
+    effect.UnmapParticles(Write(out, effect.GetSize()));
+}
+
+
+void CPUParticleSystem::Integrate(unsigned int begin, unsigned int end, float deltaTime, float frameDamping)
+{
+    const SimdFloat dt = SimdSet(deltaTime);
+    const SimdFloat damp = SimdSet(frameDamping);
+    const SimdFloat gx = SimdSet(gravity.x * deltaTime);
+    const SimdFloat gy = SimdSet(gravity.y * deltaTime);
+    const SimdFloat gz = SimdSet(gravity.z * deltaTime);
+
+    // v = v * damping + g * dt; p += v * dt; life -= dt
+    for (unsigned int i = begin; i < end; i += SIMD_WIDTH)
+    {
+        SimdFloat velX = SimdAdd(SimdMul(SimdLoad(&vx[i]), damp), gx);
+        SimdFloat velY = SimdAdd(SimdMul(SimdLoad(&vy[i]), damp), gy);
+        SimdFloat velZ = SimdAdd(SimdMul(SimdLoad(&vz[i]), damp), gz);
+        SimdStore(&vx[i], velX);
+        SimdStore(&vy[i], velY);
+        SimdStore(&vz[i], velZ);
+
+        SimdStore(&px[i], SimdAdd(SimdLoad(&px[i]), SimdMul(velX, dt)));
+        SimdStore(&py[i], SimdAdd(SimdLoad(&py[i]), SimdMul(velY, dt)));
+        SimdStore(&pz[i], SimdAdd(SimdLoad(&pz[i]), SimdMul(velZ, dt)));
+        SimdStore(&life[i], SimdSub(SimdLoad(&life[i]), dt));
+    }
+}
+
+
+void CPUParticleSystem::Kill()
+{
+    unsigned int i = 0;
+    while (i < liveCount)
+    {
+        if (life[i] > 0)
+        {
+            i++;
+            continue;
+        }
+
+        // The last particle takes the place of the dead one, and is checked next
+        liveCount--;
+        for (auto array : particleArrays)
+            (this->*array)[i] = (this->*array)[liveCount];
+    }
+}
+
+
+void CPUParticleSystem::WriteRange(CPUParticle *out, unsigned int begin, unsigned int end) const
+{
+    unsigned int i = begin;
+
+#ifdef SIMD_SSE
+    // Four particles at a time, transposed from columns to rows
+    for (; i + 4 <= end; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(&px[i]);
+        __m128 y = _mm_loadu_ps(&py[i]);
+        __m128 z = _mm_loadu_ps(&pz[i]);
+        __m128 w = _mm_mul_ps(_mm_loadu_ps(&life[i]), _mm_loadu_ps(&invLifetime[i]));
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+
+        __m128 cr = _mm_loadu_ps(&r[i]);
+        __m128 cg = _mm_loadu_ps(&g[i]);
+        __m128 cb = _mm_loadu_ps(&b[i]);
+        __m128 ca = _mm_loadu_ps(&a[i]);
+        _MM_TRANSPOSE4_PS(cr, cg, cb, ca);
+
+        _mm_storeu_ps(glm::value_ptr(out[i].position), x);
+        _mm_storeu_ps(glm::value_ptr(out[i].color), cr);
+        _mm_storeu_ps(glm::value_ptr(out[i + 1].position), y);
+        _mm_storeu_ps(glm::value_ptr(out[i + 1].color), cg);
+        _mm_storeu_ps(glm::value_ptr(out[i + 2].position), z);
+        _mm_storeu_ps(glm::value_ptr(out[i + 2].color), cb);
+        _mm_storeu_ps(glm::value_ptr(out[i + 3].position), w);
+        _mm_storeu_ps(glm::value_ptr(out[i + 3].color), ca);
+    }
+#endif
+
+    for (; i < end; i++)
+    {
+        out[i].position = glm::vec4(px[i], py[i], pz[i], life[i] * invLifetime[i]);
+        out[i].color = glm::vec4(r[i], g[i], b[i], a[i]);
+    }
+}
+
+
+float CPUParticleSystem::Random()
+{
+    // xorshift32, mapped to [-1, 1]
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return (randomState >> 8) * (2.0f / 16777215.0f) - 1.0f;
+}
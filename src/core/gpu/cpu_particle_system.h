@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+
+#include "core/gpu/particle_effect.h"
+#include "utils/glm_utils.h"
+
+
+// Layout of the streamed particles, as read by the shaders (std430)
+struct CPUParticle
+{
+    glm::vec4 position;     // w is the remaining fraction of the lifetime
+    glm::vec4 color;
+};
+
+
+// Particles simulated on the CPU, for when compute shaders are not available.
+// The state is kept as a structure of arrays, so that the kernels move several
+// particles per instruction (AVX, SSE2 or NEON, whichever the build targets),
+// and large systems are split over threads. Dead particles are swapped with
+// the last live one, so the live particles are always [0, GetLiveCount()).
+class CPUParticleSystem
+{
+ public:
+    struct EmitParameters
+    {
+        glm::vec3 position = glm::vec3(0);
+        glm::vec3 velocity = glm::vec3(0);
+        // Every velocity component gets a random offset in [-spread, spread]
+        glm::vec3 velocitySpread = glm::vec3(1);
+        float lifetime = 1;
+        float lifetimeSpread = 0;
+        glm::vec4 color = glm::vec4(1);
+    };
+
+ public:
+    explicit CPUParticleSystem(unsigned int maxParticles);
+
+    // Adds `count` particles, or as many as still fit
+    void Emit(const EmitParameters &parameters, unsigned int count);
+    // Moves and ages the particles, then removes the dead ones
+    void Update(float deltaTime);
+    void Clear();
+
+    // Writes (at most `maxCount`) live particles, returns how many were written
+    unsigned int Write(CPUParticle *out, unsigned int maxCount) const;
+    // Streams the live particles to an effect created with GenerateStreaming
+    void Feed(ParticleEffect<CPUParticle> &effect) const;
+
+    unsigned int GetLiveCount() const { return liveCount; }
+    unsigned int GetMaxParticles() const { return maxParticles; }
+
+ public:
+    glm::vec3 gravity;
+    // Fraction of the velocity kept after one second
+    float damping;
+
+ private:
+    void Integrate(unsigned int begin, unsigned int end, float deltaTime, float frameDamping);
+    void Kill();
+    void WriteRange(CPUParticle *out, unsigned int begin, unsigned int end) const;
+    float Random();
+
+ private:
+    unsigned int maxParticles;
+    unsigned int liveCount;
+    unsigned int randomState;
+
+    // Padded to a multiple of the SIMD width
+    std::vector<float> px, py, pz;
+    std::vector<float> vx, vy, vz;
+    std::vector<float> life, invLifetime;
+    std::vector<float> r, g, b, a;
+
+    // All the arrays above, for the operations done on every one of them
+    static std::vector<float> CPUParticleSystem::* const particleArrays[12];
+};
@@ -14,6 +14,10 @@ glm::vec4 FrameBuffer::defaultClearColor = glm::vec4(0);
 FrameBuffer::FrameBuffer()
 {
     FBO = 0;
+    width = 0;
+    height = 0;
+    nrTextures = 0;
+    precision = 0;
     depthTexture = nullptr;
     textures = nullptr;
     DrawBuffers = nullptr;
@@ -23,7 +27,7 @@ FrameBuffer::FrameBuffer()
 
 FrameBuffer::~FrameBuffer()
 {
-    SAFE_FREE(depthTexture);
+    Clean();
 }
 
 
@@ -31,7 +35,23 @@ void FrameBuffer::Clean()
 {
     if (FBO)
         glDeleteFramebuffers(1, &FBO);
+    FBO = 0;
+
+    // Texture2D does not release its OpenGL texture
+    for (unsigned int i = 0; i < nrTextures; i++)
+    {
+        GLuint textureID = textures[i].GetTextureID();
+        glDeleteTextures(1, &textureID);
+    }
+    if (depthTexture)
+    {
+        GLuint textureID = depthTexture->GetTextureID();
+        glDeleteTextures(1, &textureID);
+    }
+    nrTextures = 0;
+
     SAFE_FREE_ARRAY(textures);
+    SAFE_FREE(depthTexture);
     SAFE_FREE_ARRAY(DrawBuffers)
 }
 
@@ -49,6 +69,7 @@ void FrameBuffer::Generate(int width, int height, int nrTextures, bool hasDepthT
     this->width = width;
     this->height = height;
     this->nrTextures = nrTextures;
+    this->precision = precision;
 
     // Create FrameBufferObject
     glGenFramebuffers(1, &FBO);
@@ -87,9 +108,15 @@ void FrameBuffer::Generate(int width, int height, int nrTextures, bool hasDepthT
 
 void FrameBuffer::Resize(int width, int height, int precision)
 {
+    precision = (precision / 8) * 8;
+
+    // Nothing to reallocate
+    if (width == this->width && height == this->height && precision == this->precision)
+        return;
+
     this->width = width;
     this->height = height;
-    precision = (precision / 8) * 8;
+    this->precision = precision;
 
     glBindFramebuffer(GL_FRAMEBUFFER, FBO);
 
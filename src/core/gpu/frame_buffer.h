@@ -46,6 +46,7 @@ class FrameBuffer
 
     int width;
     int height;
+    int precision;
     unsigned int nrTextures;
     glm::vec4 clearColor;
     static glm::vec4 defaultClearColor;
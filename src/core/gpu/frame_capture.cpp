@@ -0,0 +1,385 @@
+#include "core/gpu/frame_capture.h"
+
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+
+#include "stb/stb_image_write.h"
+
+#include "core/gpu/gpu_readback.h"
+#include "utils/gl_utils.h"
+
+
+// Frames waiting for a worker, beyond this the main thread waits for them
+#define MAX_QUEUED_FRAMES   (8)
+#define MAX_WORKERS         (4)
+
+
+std::vector<FrameCapture::Request> FrameCapture::nextFrame;
+
+bool FrameCapture::recording = false;
+std::string FrameCapture::recordingPrefix;
+FrameCapture::Format FrameCapture::recordingFormat = FrameCapture::Format::PNG;
+unsigned int FrameCapture::recordingInterval = 1;
+unsigned long long FrameCapture::recordedFrames = 0;
+unsigned long long FrameCapture::frameIndex = 0;
+std::shared_ptr<FrameCapture::RawStream> FrameCapture::rawStream;
+
+std::vector<std::thread> FrameCapture::workers;
+std::deque<std::function<void()>> FrameCapture::jobs;
+std::mutex FrameCapture::jobsMutex;
+std::condition_variable FrameCapture::jobsChanged;
+bool FrameCapture::stopping = false;
+
+
+// QOI, "The Quite OK Image Format" (https://qoiformat.org): lossless like PNG,
+// but encoded many times faster, which keeps up with recordings
+static bool WriteQOI(const char *fileName, unsigned int width, unsigned int height, unsigned int channels,
+                     const unsigned char *pixels)
+{
+    if (channels != 3 && channels != 4)
+        return false;
+
+    std::vector<unsigned char> out;
+    out.reserve((size_t)width * height * (channels + 1) + 22);
+
+    auto put32 = [&](unsigned int value) {
+        for (int shift = 24; shift >= 0; shift -= 8)
+            out.push_back((value >> shift) & 0xFF);
+    };
+
+    out.insert(out.end(), { 'q', 'o', 'i', 'f' });
+    put32(width);
+    put32(height);
+    out.push_back(channels);
+    out.push_back(0);       // sRGB with linear alpha
+
+    unsigned char index[64][4] = {};
+    unsigned char prev[4] = { 0, 0, 0, 255 };
+    unsigned char px[4] = { 0, 0, 0, 255 };
+    int run = 0;
+
+    size_t count = (size_t)width * height;
+    for (size_t i = 0; i < count; i++)
+    {
+        memcpy(px, pixels + i * channels, channels);
+
+        if (memcmp(px, prev, 4) == 0)
+        {
+            run++;
+            if (run == 62 || i == count - 1)
+            {
+                out.push_back(0xC0 | (run - 1));
+                run = 0;
+            }
+            continue;
+        }
+
+        if (run > 0)
+        {
+            out.push_back(0xC0 | (run - 1));
+            run = 0;
+        }
+
+        int hash = (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64;
+        if (memcmp(index[hash], px, 4) == 0)
+        {
+            out.push_back(hash);
+        }
+        else
+        {
+            memcpy(index[hash], px, 4);
+
+            if (px[3] == prev[3])
+            {
+                signed char dr = (signed char)(px[0] - prev[0]);
+                signed char dg = (signed char)(px[1] - prev[1]);
+                signed char db = (signed char)(px[2] - prev[2]);
+                signed char drg = dr - dg;
+                signed char dbg = db - dg;
+
+                if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+                {
+                    out.push_back(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+                }
+                else if (drg >= -8 && drg <= 7 && dg >= -32 && dg <= 31 && dbg >= -8 && dbg <= 7)
+                {
+                    out.push_back(0x80 | (dg + 32));
+                    out.push_back((drg + 8) << 4 | (dbg + 8));
+                }
+                else
+                {
+                    out.insert(out.end(), { 0xFE, px[0], px[1], px[2] });
+                }
+            }
+            else
+            {
+                out.insert(out.end(), { 0xFF, px[0], px[1], px[2], px[3] });
+            }
+        }
+
+        memcpy(prev, px, 4);
+    }
+
+    out.insert(out.end(), { 0, 0, 0, 0, 0, 0, 0, 1 });
+
+    FILE *file = fopen(fileName, "wb");
+    if (!file)
+        return false;
+    bool written = fwrite(out.data(), 1, out.size(), file) == out.size();
+    fclose(file);
+    return written;
+}
+
+
+static const char *GetExtension(FrameCapture::Format format)
+{
+    switch (format)
+    {
+    case FrameCapture::Format::QOI:     return ".qoi";
+    case FrameCapture::Format::RAW:     return ".rgba";
+    default:                            return ".png";
+    }
+}
+
+
+FrameCapture::RawStream::~RawStream()
+{
+    if (file)
+        fclose(file);
+}
+
+
+void FrameCapture::Capture(const std::string &fileName, Format format)
+{
+    nextFrame.push_back({ fileName, format, nullptr, 0 });
+}
+
+
+void FrameCapture::StartRecording(const std::string &prefix, Format format, unsigned int interval)
+{
+    StopRecording();
+
+    recording = true;
+    recordingPrefix = prefix;
+    recordingFormat = format;
+    recordingInterval = std::max(interval, 1u);
+    recordedFrames = 0;
+
+    if (format == Format::RAW)
+    {
+        std::string fileName = prefix + GetExtension(format);
+        FILE *file = fopen(fileName.c_str(), "wb");
+        if (!file)
+        {
+            std::cout << "FrameCapture: cannot open " << fileName << std::endl;
+            recording = false;
+            return;
+        }
+
+        rawStream = std::make_shared<RawStream>();
+        rawStream->file = file;
+        rawStream->nextFrame = 0;
+    }
+}
+
+
+void FrameCapture::StopRecording()
+{
+    // The file is closed once the frames still in flight are written
+    recording = false;
+    rawStream = nullptr;
+}
+
+
+bool FrameCapture::IsRecording()
+{
+    return recording;
+}
+
+
+void FrameCapture::Update(const glm::ivec2 &resolution)
+{
+    // A minimized window has nothing to read. The captures wait for the next frame,
+    // and the recordings skip this one without numbering it, or the frames of a
+    // raw stream would wait forever for its turn.
+    if (resolution.x <= 0 || resolution.y <= 0)
+    {
+        frameIndex++;
+        return;
+    }
+
+    std::vector<Request> requests;
+    requests.swap(nextFrame);
+
+    if (recording && frameIndex % recordingInterval == 0)
+    {
+        Request request;
+        request.format = recordingFormat;
+        request.stream = rawStream;
+        request.streamFrame = recordedFrames;
+        if (!rawStream)
+        {
+            char frame[16];
+            snprintf(frame, sizeof(frame), "_%06llu", recordedFrames);
+            request.fileName = recordingPrefix + frame + GetExtension(recordingFormat);
+        }
+        requests.push_back(request);
+        recordedFrames++;
+    }
+    frameIndex++;
+
+    if (!requests.empty())
+        Read(resolution, std::move(requests));
+}
+
+
+void FrameCapture::Encode(const std::string &fileName, Format format, unsigned int width, unsigned int height,
+                          unsigned int channels, std::vector<unsigned char> &&pixels)
+{
+    auto data = std::make_shared<std::vector<unsigned char>>(std::move(pixels));
+    Enqueue([fileName, format, width, height, channels, data]() {
+        Request request = { fileName, format, nullptr, 0 };
+        Write(request, width, height, channels, *data);
+    });
+}
+
+
+void FrameCapture::Exit()
+{
+    StopRecording();
+    nextFrame.clear();
+
+    // Hands the frames still on the GPU to the workers, then lets them finish
+    GPUReadback::Finish();
+
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        stopping = true;
+    }
+    jobsChanged.notify_all();
+
+    for (auto &worker : workers)
+        worker.join();
+    workers.clear();
+    stopping = false;
+}
+
+
+void FrameCapture::Read(const glm::ivec2 &resolution, std::vector<Request> &&requests)
+{
+    unsigned int width = resolution.x;
+    unsigned int height = resolution.y;
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glReadBuffer(GL_BACK);
+
+    auto shared = std::make_shared<std::vector<Request>>(std::move(requests));
+    GPUReadback::ReadPixels(0, 0, width, height, GL_RGBA, [shared, width, height](const void *data, GLsizeiptr size) {
+        // The mapping is only valid during the callback
+        auto pixels = std::make_shared<std::vector<unsigned char>>();
+        if (data)
+            pixels->assign(static_cast<const unsigned char *>(data), static_cast<const unsigned char *>(data) + size);
+
+        Enqueue([shared, pixels, width, height]() {
+            // glReadPixels starts with the bottom row, and the alpha
+            // of the back buffer is meaningless
+            std::vector<unsigned char> image(pixels->size());
+            size_t rowSize = (size_t)width * 4;
+            for (size_t y = 0; y < height && !pixels->empty(); y++)
+            {
+                const unsigned char *src = pixels->data() + (height - 1 - y) * rowSize;
+                unsigned char *dst = image.data() + y * rowSize;
+                memcpy(dst, src, rowSize);
+                for (size_t x = 3; x < rowSize; x += 4)
+                    dst[x] = 255;
+            }
+
+            for (const auto &request : *shared)
+                Write(request, width, height, 4, image);
+        });
+    });
+}
+
+
+void FrameCapture::Write(const Request &request, unsigned int width, unsigned int height, unsigned int channels,
+                         const std::vector<unsigned char> &pixels)
+{
+    if (request.stream)
+    {
+        // Failed reads still take their turn, so that the next frames are written
+        RawStream &stream = *request.stream;
+        std::unique_lock<std::mutex> lock(stream.mutex);
+        stream.written.wait(lock, [&]() { return stream.nextFrame == request.streamFrame; });
+        if (!pixels.empty())
+            fwrite(pixels.data(), 1, pixels.size(), stream.file);
+        stream.nextFrame++;
+        stream.written.notify_all();
+        return;
+    }
+
+    if (pixels.empty())
+    {
+        std::cout << "FrameCapture: could not read " << request.fileName << std::endl;
+        return;
+    }
+
+    bool written = false;
+    switch (request.format)
+    {
+    case Format::PNG:
+        written = stbi_write_png(request.fileName.c_str(), width, height, channels, pixels.data(), width * channels) != 0;
+        break;
+    case Format::QOI:
+        written = WriteQOI(request.fileName.c_str(), width, height, channels, pixels.data());
+        break;
+    case Format::RAW:
+        if (FILE *file = fopen(request.fileName.c_str(), "wb"))
+        {
+            written = fwrite(pixels.data(), 1, pixels.size(), file) == pixels.size();
+            fclose(file);
+        }
+        break;
+    }
+
+    if (!written)
+        std::cout << "FrameCapture: could not write " << request.fileName << std::endl;
+}
+
+
+void FrameCapture::Enqueue(std::function<void()> job)
+{
+    std::unique_lock<std::mutex> lock(jobsMutex);
+
+    if (workers.empty())
+    {
+        unsigned int nrWorkers = std::clamp(std::thread::hardware_concurrency() / 2, 1u, (unsigned int)MAX_WORKERS);
+        for (unsigned int i = 0; i < nrWorkers; i++)
+            workers.emplace_back(WorkerThread);
+    }
+
+    // Waits instead of piling up frames when the encoding cannot keep up
+    jobsChanged.wait(lock, []() { return jobs.size() < MAX_QUEUED_FRAMES; });
+    jobs.push_back(std::move(job));
+    jobsChanged.notify_all();
+}
+
+
+void FrameCapture::WorkerThread()
+{
+    std::unique_lock<std::mutex> lock(jobsMutex);
+    while (true)
+    {
+        jobsChanged.wait(lock, []() { return stopping || !jobs.empty(); });
+        if (jobs.empty())
+            return;
+
+        std::function<void()> job = std::move(jobs.front());
+        jobs.pop_front();
+        jobsChanged.notify_all();
+
+        lock.unlock();
+        job();
+        lock.lock();
+    }
+}
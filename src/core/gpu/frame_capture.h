@@ -0,0 +1,96 @@
+#pragma once
+
+#include <mutex>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+#include "utils/glm_utils.h"
+
+
+// Captures the rendered frames without stalling them: the back buffer is read
+// into pixel buffers (see GPUReadback), and a few frames later the pixels are
+// flipped and encoded by worker threads.
+class FrameCapture
+{
+ public:
+    enum class Format
+    {
+        PNG,
+        QOI,
+        // RGBA bytes, top row first. A recording writes every frame to the same
+        // file, a raw video stream: ffmpeg -f rawvideo -pix_fmt rgba -s WxH -i file
+        RAW,
+    };
+
+    // Captures the next frame into `fileName`
+    static void Capture(const std::string &fileName, Format format = Format::PNG);
+
+    // Captures every `interval`th frame, into `<prefix>_<frame>.<ext>`,
+    // or into `<prefix>.rgba` for raw recordings
+    static void StartRecording(const std::string &prefix, Format format = Format::PNG, unsigned int interval = 1);
+    static void StopRecording();
+    static bool IsRecording();
+
+    // Called at the end of every frame, before the buffers are swapped
+    static void Update(const glm::ivec2 &resolution);
+
+    // Writes an image (top row first) on a worker thread
+    static void Encode(const std::string &fileName, Format format, unsigned int width, unsigned int height,
+                       unsigned int channels, std::vector<unsigned char> &&pixels);
+
+    // Waits for the pending captures to be written and stops the workers
+    static void Exit();
+
+ protected:
+    FrameCapture() = delete;
+    ~FrameCapture() = delete;
+
+ private:
+    // Frames of a raw recording are written in order, by whichever worker gets them
+    struct RawStream
+    {
+        ~RawStream();
+
+        FILE *file;
+        unsigned long long nextFrame;
+        std::mutex mutex;
+        std::condition_variable written;
+    };
+
+    struct Request
+    {
+        std::string fileName;
+        Format format;
+        std::shared_ptr<RawStream> stream;
+        unsigned long long streamFrame;
+    };
+
+    static void Read(const glm::ivec2 &resolution, std::vector<Request> &&requests);
+    static void Write(const Request &request, unsigned int width, unsigned int height, unsigned int channels,
+                      const std::vector<unsigned char> &pixels);
+    static void Enqueue(std::function<void()> job);
+    static void WorkerThread();
+
+ private:
+    static std::vector<Request> nextFrame;
+
+    static bool recording;
+    static std::string recordingPrefix;
+    static Format recordingFormat;
+    static unsigned int recordingInterval;
+    static unsigned long long recordedFrames;
+    static unsigned long long frameIndex;
+    static std::shared_ptr<RawStream> rawStream;
+
+    static std::vector<std::thread> workers;
+    static std::deque<std::function<void()>> jobs;
+    static std::mutex jobsMutex;
+    static std::condition_variable jobsChanged;
+    static bool stopping;
+};
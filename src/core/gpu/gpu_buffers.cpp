@@ -1,20 +1,42 @@
 #include "core/gpu/gpu_buffers.h"
 #include "core/gpu/vertex_format.h"
 
+#include <cstddef>
+#include <limits>
+
+#include "glm/gtc/packing.hpp"
+
+#include "core/frame_stats.h"
+
 
 enum VERTEX_ATTRIBUTE_LOC
 {
     POS,
     NORMAL,
     TEX_COORD,
+    COLOR,
+    TANGENT,
 };
 
 
+static MeshArena *meshArenas[gpu_utils::NR_MESH_ARENAS] = { nullptr };
+static bool meshArenasReleased = false;
+
+
 GPUBuffers::GPUBuffers()
 {
     m_size = 0;
     m_VAO = 0;
     memset(m_VBO, 0, 6 * sizeof(int));
+
+    m_arena = -1;
+    m_baseVertex = 0;
+    m_nrVertices = 0;
+    m_indexOffset = 0;
+    m_indexBytes = 0;
+    m_indexType = GL_UNSIGNED_INT;
+    m_positionOffset = glm::vec3(0);
+    m_positionScale = glm::vec3(1);
 }
 
 
@@ -28,113 +50,259 @@ void GPUBuffers::CreateBuffers(unsigned int size)
 
 void GPUBuffers::ReleaseMemory()
 {
+    if (m_arena >= 0)
+    {
+        MeshArena *arena = gpu_utils::GetMeshArena(m_arena);
+        if (arena)
+        {
+            arena->Free(m_baseVertex, m_nrVertices, m_indexOffset, m_indexBytes);
+        }
+        *this = GPUBuffers();
+    }
+
     if (m_size)
     {
-        m_size = 0;
         glDeleteVertexArrays(1, &m_VAO);
         glDeleteBuffers(m_size, m_VBO);
+        m_size = 0;
     }
 }
 
 
-GPUBuffers gpu_utils::UploadData(const std::vector<glm::vec3> &positions,
-                                 const std::vector<glm::vec3> &normals,
-                                 const std::vector<unsigned int>& indices)
+MeshArena *gpu_utils::GetMeshArena(int arena)
 {
-    GPUBuffers buffers;
-    buffers.CreateBuffers(3);
-    glBindVertexArray(buffers.m_VAO);
+    if (meshArenasReleased || arena < 0 || arena >= NR_MESH_ARENAS)
+    {
+        return nullptr;
+    }
 
-    // Generate and populate the buffers with vertex attributes and the indices
-    glBindBuffer(GL_ARRAY_BUFFER, buffers.m_VBO[0]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(positions[0]) * positions.size(), &positions[0], GL_STATIC_DRAW);
-    glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOC::POS);
-    glVertexAttribPointer(VERTEX_ATTRIBUTE_LOC::POS, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    if (!meshArenas[arena])
+    {
+        switch (arena)
+        {
+        case VERTEX_FORMAT_ARENA:
+            meshArenas[arena] = new MeshArena(sizeof(VertexFormat), []()
+            {
+                glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOC::POS);
+                glVertexAttribPointer(VERTEX_ATTRIBUTE_LOC::POS, 3, GL_FLOAT, GL_FALSE, sizeof(VertexFormat), (void*)offsetof(VertexFormat, position));
+
+                glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOC::NORMAL);
+                glVertexAttribPointer(VERTEX_ATTRIBUTE_LOC::NORMAL, 3, GL_FLOAT, GL_FALSE, sizeof(VertexFormat), (void*)offsetof(VertexFormat, normal));
+
+                glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOC::TEX_COORD);
+                glVertexAttribPointer(VERTEX_ATTRIBUTE_LOC::TEX_COORD, 2, GL_FLOAT, GL_FALSE, sizeof(VertexFormat), (void*)offsetof(VertexFormat, text_coord));
+
+                glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOC::COLOR);
+                glVertexAttribPointer(VERTEX_ATTRIBUTE_LOC::COLOR, 3, GL_FLOAT, GL_FALSE, sizeof(VertexFormat), (void*)offsetof(VertexFormat, color));
+
+                glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOC::TANGENT);
+                glVertexAttribPointer(VERTEX_ATTRIBUTE_LOC::TANGENT, 3, GL_FLOAT, GL_FALSE, sizeof(VertexFormat), (void*)offsetof(VertexFormat, tangent));
+            });
+            break;
+
+        case PACKED_VERTEX_FORMAT_ARENA:
+            meshArenas[arena] = new MeshArena(sizeof(PackedVertexFormat), []()
+            {
+                glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOC::POS);
+                glVertexAttribPointer(VERTEX_ATTRIBUTE_LOC::POS, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertexFormat), (void*)offsetof(PackedVertexFormat, position));
+
+                glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOC::NORMAL);
+                glVertexAttribPointer(VERTEX_ATTRIBUTE_LOC::NORMAL, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertexFormat), (void*)offsetof(PackedVertexFormat, normal));
+
+                glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOC::TEX_COORD);
+                glVertexAttribPointer(VERTEX_ATTRIBUTE_LOC::TEX_COORD, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertexFormat), (void*)offsetof(PackedVertexFormat, text_coord));
+
+                glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOC::COLOR);
+                glVertexAttribPointer(VERTEX_ATTRIBUTE_LOC::COLOR, 3, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(PackedVertexFormat), (void*)offsetof(PackedVertexFormat, color));
+
+                glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOC::TANGENT);
+                glVertexAttribPointer(VERTEX_ATTRIBUTE_LOC::TANGENT, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertexFormat), (void*)offsetof(PackedVertexFormat, tangent));
+            });
+            break;
+        }
+    }
 
-    glBindBuffer(GL_ARRAY_BUFFER, buffers.m_VBO[1]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(normals[0]) * normals.size(), &normals[0], GL_STATIC_DRAW);
-    glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOC::NORMAL);
-    glVertexAttribPointer(VERTEX_ATTRIBUTE_LOC::NORMAL, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    return meshArenas[arena];
+}
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.m_VBO[2]);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices[0]) * indices.size(), &indices[0], GL_STATIC_DRAW);
 
-    // Make sure the VAO is not changed from the outside
-    glBindVertexArray(0);
+void gpu_utils::ReleaseMeshArenas()
+{
+    for (auto &arena : meshArenas)
+    {
+        delete arena;
+        arena = nullptr;
+    }
+    meshArenasReleased = true;
+}
 
-    CheckOpenGLError();
 
-    return buffers;
+// Projects a unit vector on the octahedron |x| + |y| + |z| = 1, then unfolds
+// the lower half over the upper one
+static void EncodeOctahedral(const glm::vec3 &n, GLshort out[2])
+{
+    float l1 = glm::abs(n.x) + glm::abs(n.y) + glm::abs(n.z);
+    glm::vec2 octahedral = l1 > 0 ? glm::vec2(n.x, n.y) / l1 : glm::vec2(0);
+    if (l1 > 0 && n.z < 0)
+    {
+        glm::vec2 signs(octahedral.x >= 0 ? 1.0f : -1.0f, octahedral.y >= 0 ? 1.0f : -1.0f);
+        octahedral = (1.0f - glm::abs(glm::vec2(octahedral.y, octahedral.x))) * signs;
+    }
+    out[0] = static_cast<GLshort>(glm::round(glm::clamp(octahedral.x, -1.0f, 1.0f) * 32767.0f));
+    out[1] = static_cast<GLshort>(glm::round(glm::clamp(octahedral.y, -1.0f, 1.0f) * 32767.0f));
 }
 
 
-GPUBuffers gpu_utils::UploadData(const std::vector<glm::vec3> &positions,
-                                 const std::vector<glm::vec3> &normals,
-                                 const std::vector<glm::vec2> &text_coords,
-                                 const std::vector<unsigned int> &indices)
+glm::vec3 gpu_utils::ComputeTangent(const glm::vec3 &normal)
 {
-    // Create the VAO
-    GPUBuffers buffers;
-    buffers.CreateBuffers(4);
-    glBindVertexArray(buffers.m_VAO);
+    // Any vector perpendicular to the normal works, as long as it is
+    // chosen the same way everywhere
+    glm::vec3 tangent(-normal.z, 0, normal.x);
+    if (tangent == glm::vec3(0))
+        tangent = glm::vec3(0, 0, -normal.y);
+    if (tangent == glm::vec3(0))
+        return glm::vec3(1, 0, 0);
+    return glm::normalize(tangent);
+}
 
-    // Generate and populate the buffers with vertex attributes and the indices
-    glBindBuffer(GL_ARRAY_BUFFER, buffers.m_VBO[0]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(positions[0]) * positions.size(), &positions[0], GL_STATIC_DRAW);
-    glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOC::POS);
-    glVertexAttribPointer(VERTEX_ATTRIBUTE_LOC::POS, 3, GL_FLOAT, GL_FALSE, 0, 0);
 
-    glBindBuffer(GL_ARRAY_BUFFER, buffers.m_VBO[1]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(normals[0]) * normals.size(), &normals[0], GL_STATIC_DRAW);
-    glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOC::NORMAL);
-    glVertexAttribPointer(VERTEX_ATTRIBUTE_LOC::NORMAL, 3, GL_FLOAT, GL_FALSE, 0, 0);
+std::vector<PackedVertexFormat> gpu_utils::PackVertices(const std::vector<VertexFormat> &vertices,
+                                                        glm::vec3 &offset, glm::vec3 &scale)
+{
+    glm::vec3 boxMin(std::numeric_limits<float>::max());
+    glm::vec3 boxMax(-std::numeric_limits<float>::max());
+    for (const auto &vertex : vertices)
+    {
+        boxMin = glm::min(boxMin, vertex.position);
+        boxMax = glm::max(boxMax, vertex.position);
+    }
 
-    glBindBuffer(GL_ARRAY_BUFFER, buffers.m_VBO[2]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(text_coords[0]) * text_coords.size(), &text_coords[0], GL_STATIC_DRAW);
-    glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOC::TEX_COORD);
-    glVertexAttribPointer(VERTEX_ATTRIBUTE_LOC::TEX_COORD, 2, GL_FLOAT, GL_FALSE, 0, 0);
+    offset = vertices.empty() ? glm::vec3(0) : boxMin;
+    scale = vertices.empty() ? glm::vec3(1) : glm::max(boxMax - boxMin, glm::vec3(1e-6f));
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.m_VBO[3]);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices[0]) * indices.size(), &indices[0], GL_STATIC_DRAW);
+    std::vector<PackedVertexFormat> packed(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        const VertexFormat &vertex = vertices[i];
+        PackedVertexFormat &out = packed[i];
+
+        glm::vec3 position = glm::round(glm::clamp((vertex.position - offset) / scale, 0.0f, 1.0f) * 65535.0f);
+        out.position[0] = static_cast<GLushort>(position.x);
+        out.position[1] = static_cast<GLushort>(position.y);
+        out.position[2] = static_cast<GLushort>(position.z);
+        out.position[3] = 0;
+
+        EncodeOctahedral(vertex.normal, out.normal);
+        EncodeOctahedral(vertex.tangent, out.tangent);
+
+        out.text_coord[0] = glm::packHalf1x16(vertex.text_coord.x);
+        out.text_coord[1] = glm::packHalf1x16(vertex.text_coord.y);
+
+        glm::vec3 color = glm::round(glm::clamp(vertex.color, 0.0f, 1.0f) * 255.0f);
+        out.color[0] = static_cast<GLubyte>(color.r);
+        out.color[1] = static_cast<GLubyte>(color.g);
+        out.color[2] = static_cast<GLubyte>(color.b);
+        out.color[3] = 255;
+    }
 
-    // Make sure the VAO is not changed from the outside
-    glBindVertexArray(0);
-    CheckOpenGLError();
+    return packed;
+}
 
-    return buffers;
+
+GPUBuffers gpu_utils::UploadData(const std::vector<glm::vec3> &positions,
+                                 const std::vector<glm::vec3> &normals,
+                                 const std::vector<unsigned int>& indices,
+                                 bool packed)
+{
+    return UploadData(positions, normals, std::vector<glm::vec2>(), indices, packed);
 }
 
 
-GPUBuffers gpu_utils::UploadData(const std::vector<VertexFormat> &vertices,
-                                 const std::vector<unsigned int>& indices)
+GPUBuffers gpu_utils::UploadData(const std::vector<glm::vec3> &positions,
+                                 const std::vector<glm::vec3> &normals,
+                                 const std::vector<glm::vec2> &text_coords,
+                                 const std::vector<unsigned int> &indices,
+                                 bool packed)
+{
+    // Interleave the attributes. Missing ones get the values a disabled
+    // vertex attribute would have, so shaders see the same inputs as before.
+    std::vector<VertexFormat> vertices;
+    vertices.reserve(positions.size());
+    for (size_t i = 0; i < positions.size(); i++)
     {
-        // Create the VAO
-        GPUBuffers buffers;
-        buffers.CreateBuffers(2);
-        glBindVertexArray(buffers.m_VAO);
+        vertices.emplace_back(positions[i],
+                              glm::vec3(0),
+                              i < normals.size() ? normals[i] : glm::vec3(0),
+                              i < text_coords.size() ? text_coords[i] : glm::vec2(0));
+    }
+
+    return UploadData(vertices, indices, packed);
+}
 
-        // Generate and populate the buffers with vertex attributes and the indices
-        glBindBuffer(GL_ARRAY_BUFFER, buffers.m_VBO[0]);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices[0]) * vertices.size(), &vertices[0], GL_STATIC_DRAW);
 
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VertexFormat), 0);
+GPUBuffers gpu_utils::UploadData(const std::vector<VertexFormat> &vertices,
+                                 const std::vector<unsigned int>& indices,
+                                 bool packed)
+{
+    GPUBuffers buffers;
+    int arenaID = packed ? PACKED_VERTEX_FORMAT_ARENA : VERTEX_FORMAT_ARENA;
+    MeshArena *arena = GetMeshArena(arenaID);
+    if (!arena || vertices.empty() || indices.empty())
+    {
+        return buffers;
+    }
 
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(VertexFormat), (void*)(sizeof(glm::vec3)));
+    unsigned int nrVertices = static_cast<unsigned int>(vertices.size());
 
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(VertexFormat), (void*)(2 * sizeof(glm::vec3)));
+    // Fill in the tangents that were not given
+    std::vector<VertexFormat> completeVertices;
+    const std::vector<VertexFormat> *source = &vertices;
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        if (vertices[i].tangent != glm::vec3(0))
+            continue;
+
+        if (completeVertices.empty())
+        {
+            completeVertices = vertices;
+            source = &completeVertices;
+        }
+        completeVertices[i].tangent = ComputeTangent(vertices[i].normal);
+    }
 
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(VertexFormat), (void*)(2 * sizeof(glm::vec3) + sizeof(glm::vec2)));
+    // Small meshes are indexed with 16 bits, halving the size of their indices
+    std::vector<GLushort> shortIndices;
+    const void *indexData = &indices[0];
+    unsigned int indexBytes = static_cast<unsigned int>(sizeof(indices[0]) * indices.size());
+    buffers.m_indexType = GL_UNSIGNED_INT;
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.m_VBO[1]);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices[0]) * indices.size(), &indices[0], GL_STATIC_DRAW);
+    if (nrVertices <= std::numeric_limits<GLushort>::max())
+    {
+        shortIndices.assign(indices.begin(), indices.end());
+        indexData = &shortIndices[0];
+        indexBytes = static_cast<unsigned int>(sizeof(shortIndices[0]) * shortIndices.size());
+        buffers.m_indexType = GL_UNSIGNED_SHORT;
+    }
 
-        // Make sure the VAO is not changed from the outside
-        glBindVertexArray(0);
-        CheckOpenGLError();
+    std::vector<PackedVertexFormat> packedVertices;
+    const void *vertexData = &(*source)[0];
+    if (packed)
+    {
+        packedVertices = PackVertices(*source, buffers.m_positionOffset, buffers.m_positionScale);
+        vertexData = &packedVertices[0];
+    }
 
-        return buffers;
+    if (!arena->Upload(vertexData, nrVertices, indexData, indexBytes, buffers.m_baseVertex, buffers.m_indexOffset))
+    {
+        return GPUBuffers();
     }
+    size_t vertexSize = packed ? sizeof(PackedVertexFormat) : sizeof(VertexFormat);
+    FrameStats::Add(FrameStats::BUFFER_BYTES_UPLOADED, static_cast<int64_t>(vertexSize * nrVertices + indexBytes));
+
+    buffers.m_VAO = arena->GetVAO();
+    buffers.m_arena = arenaID;
+    buffers.m_nrVertices = nrVertices;
+    buffers.m_indexBytes = indexBytes;
+
+    return buffers;
+}
@@ -3,6 +3,7 @@
 #include <vector>
 
 #include "core/gpu/vertex_format.h"
+#include "core/gpu/mesh_arena.h"
 #include "utils/gl_utils.h"
 #include "utils/glm_utils.h"
 
@@ -19,6 +20,20 @@ class GPUBuffers
     GLuint m_VAO;
     GLuint m_VBO[6];
 
+    // Location of the data inside a shared mesh arena. Owned buffers
+    // (and the VAO) are only used when `m_arena` is negative.
+    int m_arena;
+    unsigned int m_baseVertex;
+    unsigned int m_nrVertices;
+    unsigned int m_indexOffset;     // In bytes
+    unsigned int m_indexBytes;
+    GLenum m_indexType;
+
+    // Transform from the packed positions to the model space ones,
+    // for meshes in the PACKED_VERTEX_FORMAT_ARENA
+    glm::vec3 m_positionOffset;
+    glm::vec3 m_positionScale;
+
  private:
     unsigned int m_size;
 };
@@ -26,15 +41,44 @@ class GPUBuffers
 
 namespace gpu_utils
 {
+    enum MESH_ARENA
+    {
+        // Interleaved VertexFormat data
+        VERTEX_FORMAT_ARENA,
+        // PackedVertexFormat data
+        PACKED_VERTEX_FORMAT_ARENA,
+        NR_MESH_ARENAS
+    };
+
+    // Returns the arena, creating it on first use. Returns nullptr
+    // once the arenas have been released.
+    MeshArena *GetMeshArena(int arena);
+
+    // Deletes all the arenas, must be called while the context is still alive
+    void ReleaseMeshArenas();
+
+    // The tangent stored for a vertex: a unit vector perpendicular to the normal, the
+    // same for all the vertices sharing the normal (it does not follow the uvs)
+    glm::vec3 ComputeTangent(const glm::vec3 &normal);
+
+    // Quantizes the vertices: positions are stored relative to their bounding
+    // box, which is returned as `offset` and `scale` (position = offset + scale * packed)
+    std::vector<PackedVertexFormat> PackVertices(const std::vector<VertexFormat> &vertices,
+                                                 glm::vec3 &offset, glm::vec3 &scale);
+
+    // When `packed` is set, the data is stored as PackedVertexFormat
     GPUBuffers UploadData(const std::vector<glm::vec3> &positions,
                           const std::vector<glm::vec3> &normals,
-                          const std::vector<unsigned int>& indices);
+                          const std::vector<unsigned int>& indices,
+                          bool packed = false);
 
     GPUBuffers UploadData(const std::vector<glm::vec3> &positions,
                           const std::vector<glm::vec3> &normals,
                           const std::vector<glm::vec2> &text_coords,
-                          const std::vector<unsigned int> &indices);
+                          const std::vector<unsigned int> &indices,
+                          bool packed = false);
 
     GPUBuffers UploadData(const std::vector<VertexFormat> &vertices,
-                          const std::vector<unsigned int>& indices);
+                          const std::vector<unsigned int>& indices,
+                          bool packed = false);
 }   // namespace gpu_utils
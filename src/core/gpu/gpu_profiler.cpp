@@ -0,0 +1,156 @@
+#include "core/gpu/gpu_profiler.h"
+
+#include <iostream>
+
+#include "core/profiler.h"
+
+
+std::atomic<bool> GPUProfiler::enabled(false);
+std::vector<GPUProfiler::PendingRange> GPUProfiler::frames[FRAME_LATENCY];
+unsigned int GPUProfiler::frameIndex = 0;
+std::vector<size_t> GPUProfiler::openRanges;
+std::vector<GLuint> GPUProfiler::freeQueries;
+std::vector<GPUProfiler::Range> GPUProfiler::lastFrame;
+std::unordered_set<std::string> GPUProfiler::names;
+int64_t GPUProfiler::clockOffset = 0;
+
+
+void GPUProfiler::SetEnabled(bool enabled)
+{
+    GPUProfiler::enabled = enabled;
+}
+
+
+bool GPUProfiler::IsEnabled()
+{
+    return enabled || Profiler::IsRecording();
+}
+
+
+void GPUProfiler::Begin(const std::string &name)
+{
+    if (!IsEnabled() || !IsSupported())
+        return;
+
+    std::vector<PendingRange> &ranges = frames[frameIndex % FRAME_LATENCY];
+    openRanges.push_back(ranges.size());
+    ranges.push_back({ Intern(name), static_cast<unsigned int>(openRanges.size() - 1), AcquireQuery(), 0 });
+    glQueryCounter(ranges.back().begin, GL_TIMESTAMP);
+}
+
+
+void GPUProfiler::End()
+{
+    // Ranges begun before the profiler was enabled are not there
+    if (openRanges.empty())
+        return;
+
+    PendingRange &range = frames[frameIndex % FRAME_LATENCY][openRanges.back()];
+    openRanges.pop_back();
+    range.end = AcquireQuery();
+    glQueryCounter(range.end, GL_TIMESTAMP);
+}
+
+
+void GPUProfiler::EndFrame()
+{
+    while (!openRanges.empty())
+        End();
+
+    if (Profiler::IsRecording() && IsSupported())
+    {
+        GLint64 gpuNow;
+        glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+        clockOffset = Profiler::Now() - gpuNow;
+    }
+
+    // The slot to record the next frame in is the oldest one in flight
+    frameIndex++;
+    std::vector<PendingRange> &oldest = frames[frameIndex % FRAME_LATENCY];
+    if (!oldest.empty())
+        Resolve(oldest);
+}
+
+
+const std::vector<GPUProfiler::Range> &GPUProfiler::GetLastFrame()
+{
+    return lastFrame;
+}
+
+
+void GPUProfiler::Clear()
+{
+    for (auto &ranges : frames)
+    {
+        for (const auto &range : ranges)
+        {
+            glDeleteQueries(1, &range.begin);
+            if (range.end)
+                glDeleteQueries(1, &range.end);
+        }
+        ranges.clear();
+    }
+    openRanges.clear();
+
+    if (!freeQueries.empty())
+        glDeleteQueries(static_cast<GLsizei>(freeQueries.size()), freeQueries.data());
+    freeQueries.clear();
+    lastFrame.clear();
+}
+
+
+bool GPUProfiler::IsSupported()
+{
+    static bool supported = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+    static bool reported = false;
+    if (!supported && !reported)
+    {
+        std::cout << "GPUProfiler: timer queries are not supported" << std::endl;
+        reported = true;
+    }
+    return supported;
+}
+
+
+GLuint GPUProfiler::AcquireQuery()
+{
+    GLuint query;
+    if (freeQueries.empty())
+    {
+        glGenQueries(1, &query);
+    }
+    else
+    {
+        query = freeQueries.back();
+        freeQueries.pop_back();
+    }
+    return query;
+}
+
+
+const char *GPUProfiler::Intern(const std::string &name)
+{
+    return names.insert(name).first->c_str();
+}
+
+
+void GPUProfiler::Resolve(std::vector<PendingRange> &ranges)
+{
+    // FRAME_LATENCY frames later the results are there, but should the GPU
+    // be that far behind, GL_QUERY_RESULT waits for them
+    lastFrame.clear();
+    for (const auto &range : ranges)
+    {
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(range.begin, GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(range.end, GL_QUERY_RESULT, &end);
+        freeQueries.push_back(range.begin);
+        freeQueries.push_back(range.end);
+
+        lastFrame.push_back({ range.name, range.depth, (end - begin) / 1e6 });
+        if (Profiler::IsRecording())
+            Profiler::RecordTrack("GPU", range.name, static_cast<int64_t>(begin) + clockOffset,
+                                  static_cast<int64_t>(end) + clockOffset);
+    }
+    ranges.clear();
+}
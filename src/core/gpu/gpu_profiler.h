@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_set>
+
+#include "utils/gl_utils.h"
+
+
+// Times ranges of GPU work with timestamp queries (GL_TIMESTAMP, core since
+// OpenGL 3.3, so also on Mesa's llvmpipe). The queries of a frame are read
+// FRAME_LATENCY frames later, when the GPU is long done with them, so that
+// nothing waits. Ranges can be nested.
+//
+// Begin, End and EndFrame issue OpenGL calls: scenes record them through
+// RenderCommandList::BeginGPURange and EndGPURange. During a Profiler capture
+// the ranges also show up in the trace, on a track of their own.
+class GPUProfiler
+{
+ public:
+    struct Range
+    {
+        std::string name;
+        // Of the ranges it is nested in
+        unsigned int depth;
+        double milliseconds;
+    };
+
+    // Also enabled while the Profiler records a capture
+    static void SetEnabled(bool enabled);
+    static bool IsEnabled();
+
+    static void Begin(const std::string &name);
+    static void End();
+    // Called once the frame is replayed: closes its open ranges
+    // and reads back the oldest frame in flight
+    static void EndFrame();
+
+    // The ranges of the last frame read back, in the order they began
+    static const std::vector<Range> &GetLastFrame();
+
+    // Drops the frames in flight and deletes the queries
+    static void Clear();
+
+ protected:
+    GPUProfiler() = delete;
+    ~GPUProfiler() = delete;
+
+ private:
+    static const unsigned int FRAME_LATENCY = 4;
+
+    struct PendingRange
+    {
+        const char *name;
+        unsigned int depth;
+        GLuint begin;
+        GLuint end;
+    };
+
+    static bool IsSupported();
+    static GLuint AcquireQuery();
+    static const char *Intern(const std::string &name);
+    static void Resolve(std::vector<PendingRange> &ranges);
+
+ private:
+    static std::atomic<bool> enabled;
+
+    // Only touched with the context current
+    static std::vector<PendingRange> frames[FRAME_LATENCY];
+    static unsigned int frameIndex;
+    // Into the ranges of the current frame
+    static std::vector<size_t> openRanges;
+    static std::vector<GLuint> freeQueries;
+    static std::vector<Range> lastFrame;
+    // CPU minus GPU timestamps, in nanoseconds, to place the ranges in the trace
+    static int64_t clockOffset;
+
+    // The names handed to Profiler, which keeps the pointers
+    static std::unordered_set<std::string> names;
+};
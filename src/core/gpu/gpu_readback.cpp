@@ -0,0 +1,144 @@
+#include "core/gpu/gpu_readback.h"
+
+
+std::list<GPUReadback::Request> GPUReadback::pending;
+std::vector<std::pair<GLuint, GLsizeiptr>> GPUReadback::freeBuffers;
+
+
+void GPUReadback::ReadBuffer(GLuint buffer, GLintptr offset, GLsizeiptr size, Callback onReady)
+{
+    GLsizeiptr capacity;
+    GLuint staging = AcquireBuffer(size, capacity);
+
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, staging);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset, 0, size);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    CheckOpenGLError();
+
+    Submit(staging, capacity, size, onReady);
+}
+
+
+void GPUReadback::ReadPixels(int x, int y, int width, int height, GLenum format, Callback onReady)
+{
+    GLsizeiptr channels = (format == GL_RGBA || format == GL_BGRA) ? 4 : (format == GL_RGB || format == GL_BGR) ? 3 : 1;
+    GLsizeiptr size = (GLsizeiptr)width * height * channels;
+
+    GLsizeiptr capacity;
+    GLuint staging = AcquireBuffer(size, capacity);
+
+    // The rows are tightly packed, and glReadPixels returns right away
+    // as the destination is a buffer object
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, staging);
+    glReadPixels(x, y, width, height, format, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    CheckOpenGLError();
+
+    Submit(staging, capacity, size, onReady);
+}
+
+
+void GPUReadback::Update()
+{
+    // The fences signal in the order they were placed
+    while (!pending.empty())
+    {
+        GLenum status = glClientWaitSync(pending.front().fence, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED)
+            break;
+
+        Request request = std::move(pending.front());
+        pending.pop_front();
+        Resolve(request);
+    }
+}
+
+
+void GPUReadback::Finish()
+{
+    while (!pending.empty())
+    {
+        Request request = std::move(pending.front());
+        pending.pop_front();
+        while (glClientWaitSync(request.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED);
+        Resolve(request);
+    }
+}
+
+
+void GPUReadback::Clear()
+{
+    for (auto &request : pending)
+    {
+        glDeleteSync(request.fence);
+        glDeleteBuffers(1, &request.buffer);
+    }
+    pending.clear();
+
+    for (auto &buffer : freeBuffers)
+        glDeleteBuffers(1, &buffer.first);
+    freeBuffers.clear();
+}
+
+
+GLuint GPUReadback::AcquireBuffer(GLsizeiptr size, GLsizeiptr &capacity)
+{
+    // The smallest free buffer that fits
+    auto best = freeBuffers.end();
+    for (auto it = freeBuffers.begin(); it != freeBuffers.end(); ++it)
+    {
+        if (it->second >= size && (best == freeBuffers.end() || it->second < best->second))
+            best = it;
+    }
+
+    if (best != freeBuffers.end())
+    {
+        GLuint buffer = best->first;
+        capacity = best->second;
+        freeBuffers.erase(best);
+        return buffer;
+    }
+
+    GLuint buffer;
+    capacity = size;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, capacity, nullptr, GL_STREAM_READ);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return buffer;
+}
+
+
+void GPUReadback::Submit(GLuint buffer, GLsizeiptr capacity, GLsizeiptr size, Callback onReady)
+{
+    Request request;
+    request.buffer = buffer;
+    request.capacity = capacity;
+    request.size = size;
+    request.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    request.onReady = onReady;
+    pending.push_back(std::move(request));
+}
+
+
+void GPUReadback::Resolve(Request &request)
+{
+    glDeleteSync(request.fence);
+
+    // The copy is done, so mapping does not wait for the GPU
+    glBindBuffer(GL_COPY_READ_BUFFER, request.buffer);
+    const void *data = glMapBufferRange(GL_COPY_READ_BUFFER, 0, request.size, GL_MAP_READ_BIT);
+    request.onReady(data, data ? request.size : 0);
+
+    // The callback may have used the binding point
+    glBindBuffer(GL_COPY_READ_BUFFER, request.buffer);
+    if (data)
+        glUnmapBuffer(GL_COPY_READ_BUFFER);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+    freeBuffers.push_back({ request.buffer, request.capacity });
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <list>
+#include <vector>
+#include <functional>
+
+#include "utils/gl_utils.h"
+
+
+// Reads GPU data without stalling: the data is copied into a staging buffer on
+// the GPU, a fence is placed after the copy, and the callback gets the bytes
+// once the fence has signaled, usually a few frames later. The callbacks are
+// run by Update, on the main thread, and get a null pointer if the read failed.
+class GPUReadback
+{
+ public:
+    typedef std::function<void(const void *data, GLsizeiptr size)> Callback;
+
+    // Reads `size` bytes of `buffer`, starting at `offset`
+    static void ReadBuffer(GLuint buffer, GLintptr offset, GLsizeiptr size, Callback onReady);
+    // Reads a rectangle of the bound read framebuffer, rows bottom to top.
+    // Only GL_UNSIGNED_BYTE pixels are supported.
+    static void ReadPixels(int x, int y, int width, int height, GLenum format, Callback onReady);
+
+    // Runs the callbacks of the reads the GPU has finished
+    static void Update();
+    // Waits for all the pending reads, then runs their callbacks
+    static void Finish();
+    // Drops the pending reads and releases the staging buffers
+    static void Clear();
+
+ protected:
+    GPUReadback() = delete;
+    ~GPUReadback() = delete;
+
+ private:
+    struct Request
+    {
+        GLuint buffer;
+        GLsizeiptr capacity;
+        GLsizeiptr size;
+        GLsync fence;
+        Callback onReady;
+    };
+
+    static GLuint AcquireBuffer(GLsizeiptr size, GLsizeiptr &capacity);
+    static void Submit(GLuint buffer, GLsizeiptr capacity, GLsizeiptr size, Callback onReady);
+    static void Resolve(Request &request);
+
+ private:
+    static std::list<Request> pending;
+    // Staging buffers to reuse, with their sizes
+    static std::vector<std::pair<GLuint, GLsizeiptr>> freeBuffers;
+};
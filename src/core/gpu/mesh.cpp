@@ -1,13 +1,23 @@
 #include <iostream>
 #include "core/gpu/mesh.h"
 
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <algorithm>
 #include <utility>
+#include <filesystem>
 
 #include "assimp/Importer.hpp"          // C++ importer interface
 #include "assimp/postprocess.h"         // Post processing flags
 
 #include "core/gpu/gpu_buffers.h"
+#include "core/gpu/mesh_optimizer.h"
 #include "core/gpu/texture2D.h"
+#include "core/frame_stats.h"
+#include "core/job_system.h"
+#include "core/profiler.h"
+#include "core/managers/file_watcher.h"
 #include "core/managers/texture_manager.h"
 
 #include "utils/memory_utils.h"
@@ -16,11 +26,41 @@
 static_assert(sizeof(aiColor4D) == sizeof(glm::vec4), "WARNING! glm::vec4 and aiColor4D size differs!");
 
 
+// A file imported again on a job. The staged mesh and the importer (which owns
+// the scene) are only used by the job until `done`, and by the main thread after.
+struct Mesh::Reload
+{
+    // Null once the mesh is deleted or reloaded again
+    Mesh *target;
+    Mesh *staged;
+    std::string file;
+    Assimp::Importer importer;
+    const aiScene *scene = nullptr;
+    std::atomic<bool> done { false };
+};
+
+std::list<Mesh::Reload *> Mesh::reloads;
+
+
+static unsigned int GetImportFlags(GLenum drawMode)
+{
+    unsigned int flags = aiProcess_GenSmoothNormals | aiProcess_FlipUVs;
+    if (drawMode == GL_TRIANGLES) flags |= aiProcess_Triangulate;
+    return flags;
+}
+
+
 Mesh::Mesh(std::string meshID)
 {
     this->meshID = std::move(meshID);
 
     useMaterial = true;
+    keepCPUData = false;
+    packedVertices = false;
+    useLODs = true;
+    nrLODs = 1;
+    boundingCenter = glm::vec3(0);
+    boundingRadius = 0;
     glDrawMode = GL_TRIANGLES;
     buffers = new GPUBuffers();
 }
@@ -28,8 +68,15 @@ Mesh::Mesh(std::string meshID)
 
 Mesh::~Mesh()
 {
+    FileWatcher::Unwatch(this);
+    for (Reload *reload : reloads)
+    {
+        if (reload->target == this)
+            reload->target = nullptr;
+    }
     ClearData();
     meshEntries.clear();
+    buffers->ReleaseMemory();
     SAFE_FREE(buffers);
 }
 
@@ -46,6 +93,53 @@ const char * Mesh::GetMeshID() const
 }
 
 
+const mesh_optimizer::Report &Mesh::GetOptimizationReport() const
+{
+    return optimizationReport;
+}
+
+
+bool Mesh::WriteOptimizationReport(const std::string &directory, const std::string &fileName)
+{
+    std::vector<std::filesystem::path> models;
+    std::error_code error;
+    for (std::filesystem::recursive_directory_iterator it(directory, error), end; !error && it != end; it.increment(error))
+    {
+        std::string extension = it->path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        if (it->is_regular_file() && (extension == ".obj" || extension == ".fbx"))
+            models.push_back(it->path());
+    }
+    std::sort(models.begin(), models.end());
+
+    FILE *file = fopen(fileName.c_str(), "w");
+    if (!file)
+    {
+        std::cout << "Mesh: cannot write " << fileName << std::endl;
+        return false;
+    }
+
+    fprintf(file, "asset,triangles,vertices_before,vertices_after,acmr_before,acmr_after\n");
+    for (const auto &model : models)
+    {
+        Mesh mesh(model.filename().string());
+        // The report is about the first level only
+        mesh.UseLODs(false);
+        if (!mesh.LoadMesh(model.parent_path().string(), model.filename().string()))
+            continue;
+
+        const mesh_optimizer::Report &report = mesh.GetOptimizationReport();
+        fprintf(file, "%s,%zu,%zu,%zu,%.3f,%.3f\n",
+                std::filesystem::relative(model, directory, error).generic_string().c_str(),
+                report.triangles, report.verticesBefore, report.verticesAfter,
+                report.acmrBefore, report.acmrAfter);
+    }
+
+    fclose(file);
+    return true;
+}
+
+
 void Mesh::ClearData()
 {
     for (unsigned int i = 0 ; i < materials.size() ; i++) {
@@ -55,31 +149,168 @@ void Mesh::ClearData()
     texCoords.clear();
     indices.clear();
     normals.clear();
+    vertices.clear();
+}
+
+
+void Mesh::OnDataUploaded()
+{
+    glm::vec3 boxMin(std::numeric_limits<float>::max());
+    glm::vec3 boxMax(-std::numeric_limits<float>::max());
+    for (const auto &position : positions)
+    {
+        boxMin = glm::min(boxMin, position);
+        boxMax = glm::max(boxMax, position);
+    }
+    for (const auto &vertex : vertices)
+    {
+        boxMin = glm::min(boxMin, vertex.position);
+        boxMax = glm::max(boxMax, vertex.position);
+    }
+
+    boundingCenter = positions.empty() && vertices.empty() ? glm::vec3(0) : (boxMin + boxMax) * 0.5f;
+    boundingRadius = 0;
+    for (const auto &position : positions)
+        boundingRadius = std::max(boundingRadius, glm::distance(boundingCenter, position));
+    for (const auto &vertex : vertices)
+        boundingRadius = std::max(boundingRadius, glm::distance(boundingCenter, vertex.position));
+
+    nrLODs = 1;
+    for (const auto &entry : meshEntries)
+        nrLODs = std::max(nrLODs, entry.nrLODs);
+
+    if (keepCPUData)
+        return;
+
+    // Swap with empty vectors, clear() alone keeps the capacity
+    std::vector<glm::vec3>().swap(positions);
+    std::vector<glm::vec3>().swap(normals);
+    std::vector<glm::vec2>().swap(texCoords);
+    std::vector<VertexFormat>().swap(vertices);
+    std::vector<unsigned int>().swap(indices);
 }
 
 
 bool Mesh::LoadMesh(const std::string& fileLocation,
                     const std::string& fileName)
 {
-    ClearData();
-    this->fileLocation = fileLocation;
+    PROFILE_FUNCTION();
     std::string file = (fileLocation + '/' + fileName).c_str();
 
+    // Load again when the file changes, in the background. A failed load keeps the uploaded mesh.
+    FileWatcher::Unwatch(this);
+    FileWatcher::Watch(file, this, [this, fileLocation, fileName]() { StartReload(fileLocation, fileName); });
+
     Assimp::Importer Importer;
+    const aiScene* pScene = Importer.ReadFile(file, GetImportFlags(glDrawMode));
 
-    unsigned int flags = aiProcess_GenSmoothNormals | aiProcess_FlipUVs;
-    if (glDrawMode == GL_TRIANGLES) flags |= aiProcess_Triangulate;
+    // pScene is freed when returning because of Importer
+    if (!pScene) {
+        printf("Error parsing '%s': '%s'\n", file.c_str(), Importer.GetErrorString());
+        return false;
+    }
 
-    const aiScene* pScene = Importer.ReadFile(file, flags);
+    std::unique_ptr<Mesh> staged(CreateStaging());
+    staged->CopySettings(*this);
+    staged->fileLocation = fileLocation;
+    if (!staged->InitFromScene(pScene))
+        return false;
 
-    if (pScene) {
-        return InitFromScene(pScene);
+    // The previous data goes away with the staging mesh
+    SwapData(*staged);
+    this->fileLocation = fileLocation;
+    return true;
+}
+
+
+void Mesh::StartReload(const std::string& fileLocation, const std::string& fileName)
+{
+    // Only the latest change is swapped in
+    for (Reload *reload : reloads)
+    {
+        if (reload->target == this)
+            reload->target = nullptr;
     }
 
-    // pScene is freed when returning because of Importer
+    Reload *reload = new Reload();
+    reload->target = this;
+    reload->staged = CreateStaging();
+    reload->staged->CopySettings(*this);
+    reload->staged->fileLocation = fileLocation;
+    reload->file = fileLocation + '/' + fileName;
+    reloads.push_back(reload);
+
+    unsigned int flags = GetImportFlags(glDrawMode);
+    JobSystem::Run([reload, flags]()
+    {
+        PROFILE_ZONE("Mesh::Reload");
+        reload->scene = reload->importer.ReadFile(reload->file, flags);
+        if (reload->scene)
+            reload->staged->ImportScene(reload->scene);
+        reload->done = true;
+    });
+}
+
+
+void Mesh::FinishReloads()
+{
+    for (auto it = reloads.begin(); it != reloads.end();)
+    {
+        Reload *reload = *it;
+        if (!reload->done)
+        {
+            ++it;
+            continue;
+        }
 
-    printf("Error parsing '%s': '%s'\n", file.c_str(), Importer.GetErrorString());
-    return false;
+        Mesh *target = reload->target;
+        if (target && !reload->scene)
+        {
+            printf("Error parsing '%s': '%s'\n", reload->file.c_str(), reload->importer.GetErrorString());
+        }
+        else if (target && reload->staged->UploadScene(reload->scene))
+        {
+            target->SwapData(*reload->staged);
+            target->fileLocation = reload->staged->fileLocation;
+        }
+
+        delete reload->staged;
+        delete reload;
+        it = reloads.erase(it);
+    }
+}
+
+
+Mesh *Mesh::CreateStaging() const
+{
+    return new Mesh(meshID);
+}
+
+
+void Mesh::CopySettings(const Mesh &other)
+{
+    useMaterial = other.useMaterial;
+    keepCPUData = other.keepCPUData;
+    packedVertices = other.packedVertices;
+    useLODs = other.useLODs;
+    glDrawMode = other.glDrawMode;
+}
+
+
+void Mesh::SwapData(Mesh &other)
+{
+    std::swap(positions, other.positions);
+    std::swap(normals, other.normals);
+    std::swap(texCoords, other.texCoords);
+    std::swap(vertices, other.vertices);
+    std::swap(indices, other.indices);
+    std::swap(meshEntries, other.meshEntries);
+    std::swap(materials, other.materials);
+    std::swap(buffers, other.buffers);
+    std::swap(nrLODs, other.nrLODs);
+    std::swap(optimizationReport, other.optimizationReport);
+    std::swap(boundingCenter, other.boundingCenter);
+    std::swap(boundingRadius, other.boundingRadius);
 }
 
 
@@ -122,7 +353,8 @@ bool Mesh::InitFromData(const std::vector<VertexFormat> &vertices,
     this->indices = indices;
 
     InitFromData();
-    *buffers = gpu_utils::UploadData(vertices, indices);
+    *buffers = gpu_utils::UploadData(vertices, indices, packedVertices);
+    OnDataUploaded();
     return buffers->m_VAO != 0;
 }
 
@@ -136,7 +368,8 @@ bool Mesh::InitFromData(const std::vector<glm::vec3>& positions,
     this->indices = indices;
 
     InitFromData();
-    *buffers = gpu_utils::UploadData(positions, normals, indices);
+    *buffers = gpu_utils::UploadData(positions, normals, indices, packedVertices);
+    OnDataUploaded();
     return buffers->m_VAO != 0;
 }
 
@@ -152,15 +385,22 @@ bool Mesh::InitFromData(const std::vector<glm::vec3>& positions,
     this->indices = indices;
 
     InitFromData();
-    *buffers = gpu_utils::UploadData(positions, normals, texCoords, indices);
+    *buffers = gpu_utils::UploadData(positions, normals, texCoords, indices, packedVertices);
+    OnDataUploaded();
     return buffers->m_VAO != 0;
 }
 
 
 bool Mesh::InitFromScene(const aiScene* pScene)
+{
+    ImportScene(pScene);
+    return UploadScene(pScene);
+}
+
+
+void Mesh::ImportScene(const aiScene* pScene)
 {
     meshEntries.resize(pScene->mNumMeshes);
-    materials.resize(pScene->mNumMaterials);
 
     unsigned int nrVertices = 0;
     unsigned int nrIndices = 0;
@@ -168,13 +408,8 @@ bool Mesh::InitFromScene(const aiScene* pScene)
     // Count the number of vertices and indices
     for (unsigned int i = 0 ; i < pScene->mNumMeshes ; i++)
     {
-        meshEntries[i].materialIndex = pScene->mMeshes[i]->mMaterialIndex;
-        meshEntries[i].nrIndices = (pScene->mMeshes[i]->mNumFaces * (glDrawMode == GL_TRIANGLES ? 3 : 4));
-        meshEntries[i].baseVertex = nrVertices;
-        meshEntries[i].baseIndex = nrIndices;
-
         nrVertices += pScene->mMeshes[i]->mNumVertices;
-        nrIndices  += meshEntries[i].nrIndices;
+        nrIndices  += pScene->mMeshes[i]->mNumFaces * (glDrawMode == GL_TRIANGLES ? 3 : 4);
     }
 
     // Reserve space in the vectors for the vertex attributes and indices
@@ -183,46 +418,135 @@ bool Mesh::InitFromScene(const aiScene* pScene)
     texCoords.reserve(nrVertices);
     indices.reserve(nrIndices);
 
-    // Initialize the meshes in the scene one by one
+    // Initialize the meshes in the scene one by one. The optimizations
+    // change the number of vertices, so the offsets are known only after.
+    mesh_optimizer::Report report;
     for (unsigned int i = 0 ; i < meshEntries.size() ; i++)
     {
         const aiMesh* paiMesh = pScene->mMeshes[i];
-        InitMesh(paiMesh);
+        meshEntries[i].materialIndex = paiMesh->mMaterialIndex;
+        meshEntries[i].baseVertex = (unsigned int)positions.size();
+        meshEntries[i].baseIndex = (unsigned int)indices.size();
+
+        report += InitMesh(paiMesh);
+        meshEntries[i].nrIndices = (unsigned int)indices.size() - meshEntries[i].baseIndex;
+
+        if (useLODs && glDrawMode == GL_TRIANGLES && meshEntries[i].nrIndices > 0)
+        {
+            GenerateLODs(meshEntries[i], { &positions[meshEntries[i].baseVertex], sizeof(glm::vec3) },
+                         positions.size() - meshEntries[i].baseVertex);
+        }
     }
 
+    optimizationReport = report;
+}
+
+
+bool Mesh::UploadScene(const aiScene* pScene)
+{
+    materials.resize(pScene->mNumMaterials);
     if (useMaterial && !InitMaterials(pScene))
         return false;
 
     buffers->ReleaseMemory();
-    *buffers = gpu_utils::UploadData(positions, normals, texCoords, indices);
+    *buffers = gpu_utils::UploadData(positions, normals, texCoords, indices, packedVertices);
+    OnDataUploaded();
     return buffers->m_VAO != 0;
 }
 
 
-void Mesh::InitMesh(const aiMesh* paiMesh)
+void Mesh::GenerateLODs(MeshEntry &entry, const mesh_optimizer::VertexStream &positions, size_t nrVertices)
+{
+    // Every level has about half the triangles of the previous one. The chain stops
+    // when the simplification gets stuck (on borders and seams) or too coarse.
+    const float maxError = 0.05f;
+
+    entry.nrLODs = 1;
+    entry.lodNrIndices[0] = entry.nrIndices;
+    entry.lodBaseIndex[0] = entry.baseIndex;
+
+    std::vector<unsigned int> previous(indices.begin() + entry.baseIndex,
+                                       indices.begin() + entry.baseIndex + entry.nrIndices);
+    while (entry.nrLODs < MAX_MESH_LODS)
+    {
+        size_t target = previous.size() / 6 * 3;
+        if (target < 3)
+            break;
+
+        std::vector<unsigned int> lod = mesh_optimizer::Simplify(previous, positions, nrVertices, target, maxError);
+        if (lod.empty() || lod.size() > previous.size() * 3 / 4)
+            break;
+
+        mesh_optimizer::OptimizeVertexCache(lod, nrVertices);
+
+        entry.lodNrIndices[entry.nrLODs] = (unsigned int)lod.size();
+        entry.lodBaseIndex[entry.nrLODs] = (unsigned int)indices.size();
+        entry.nrLODs++;
+
+        indices.insert(indices.end(), lod.begin(), lod.end());
+        previous.swap(lod);
+    }
+}
+
+
+mesh_optimizer::Report Mesh::InitMesh(const aiMesh* paiMesh)
 {
     const aiVector3D Zero3D(0.0f, 0.0f, 0.0f);
 
+    std::vector<glm::vec3> meshPositions, meshNormals;
+    std::vector<glm::vec2> meshTexCoords;
+    std::vector<unsigned int> meshIndices;
+
+    meshPositions.reserve(paiMesh->mNumVertices);
+    meshNormals.reserve(paiMesh->mNumVertices);
+    meshTexCoords.reserve(paiMesh->mNumVertices);
+
     // Populate the vertex attribute vectors
     for (unsigned int i = 0; i < paiMesh->mNumVertices; i++) {
         const aiVector3D* pPos      = &(paiMesh->mVertices[i]);
         const aiVector3D* pNormal   = &(paiMesh->mNormals[i]);
         const aiVector3D* pTexCoord = paiMesh->HasTextureCoords(0) ? &(paiMesh->mTextureCoords[0][i]) : &Zero3D;
 
-        positions.push_back(glm::vec3(pPos->x, pPos->y, pPos->z));
-        normals.push_back(glm::vec3(pNormal->x, pNormal->y, pNormal->z));
-        texCoords.push_back(glm::vec2(pTexCoord->x, pTexCoord->y));
+        meshPositions.push_back(glm::vec3(pPos->x, pPos->y, pPos->z));
+        meshNormals.push_back(glm::vec3(pNormal->x, pNormal->y, pNormal->z));
+        meshTexCoords.push_back(glm::vec2(pTexCoord->x, pTexCoord->y));
     }
 
     // Init the index buffer
     for (unsigned int i = 0; i < paiMesh->mNumFaces; i++) {
         const aiFace& Face = paiMesh->mFaces[i];
-        indices.push_back(Face.mIndices[0]);
-        indices.push_back(Face.mIndices[1]);
-        indices.push_back(Face.mIndices[2]);
+        meshIndices.push_back(Face.mIndices[0]);
+        meshIndices.push_back(Face.mIndices[1]);
+        meshIndices.push_back(Face.mIndices[2]);
         if (Face.mNumIndices == 4)
-            indices.push_back(Face.mIndices[3]);
+            meshIndices.push_back(Face.mIndices[3]);
     }
+
+    // Reorder the triangles and vertices for the GPU (triangle lists only)
+    mesh_optimizer::Report report;
+    if (glDrawMode == GL_TRIANGLES)
+    {
+        std::vector<unsigned int> remap;
+        size_t nrVertices;
+        report = mesh_optimizer::OptimizeMesh(meshIndices,
+            {
+                { meshPositions.data(), sizeof(glm::vec3) },
+                { meshNormals.data(), sizeof(glm::vec3) },
+                { meshTexCoords.data(), sizeof(glm::vec2) }
+            },
+            meshPositions.size(), { meshPositions.data(), sizeof(glm::vec3) }, remap, nrVertices);
+
+        mesh_optimizer::RemapVertexBuffer(meshPositions, remap, nrVertices);
+        mesh_optimizer::RemapVertexBuffer(meshNormals, remap, nrVertices);
+        mesh_optimizer::RemapVertexBuffer(meshTexCoords, remap, nrVertices);
+    }
+
+    positions.insert(positions.end(), meshPositions.begin(), meshPositions.end());
+    normals.insert(normals.end(), meshNormals.begin(), meshNormals.end());
+    texCoords.insert(texCoords.end(), meshTexCoords.begin(), meshTexCoords.end());
+    indices.insert(indices.end(), meshIndices.begin(), meshIndices.end());
+
+    return report;
 }
 
 
@@ -281,8 +605,54 @@ void Mesh::UseMaterials(bool value)
 }
 
 
+void Mesh::KeepCPUData(bool value)
+{
+    keepCPUData = value;
+}
+
+
+void Mesh::UseLODs(bool value)
+{
+    useLODs = value;
+}
+
+
+void Mesh::UsePackedVertices(bool value)
+{
+    packedVertices = value;
+}
+
+
+unsigned int Mesh::GetLODCount() const
+{
+    return nrLODs;
+}
+
+
+glm::vec3 Mesh::GetBoundingCenter() const
+{
+    return boundingCenter;
+}
+
+
+float Mesh::GetBoundingRadius() const
+{
+    return boundingRadius;
+}
+
+
 void Mesh::Render() const
 {
+    Render(0);
+}
+
+
+void Mesh::Render(unsigned int lod) const
+{
+    // Mesh entries are relative to the start of the mesh data, which
+    // may live anywhere inside the (shared) buffers
+    GLsizeiptr indexSize = buffers->m_indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+
     glBindVertexArray(buffers->m_VAO);
     for (unsigned int i = 0; i < meshEntries.size(); i++)
     {
@@ -297,9 +667,24 @@ void Mesh::Render() const
             }
         }
 
-        glDrawElementsBaseVertex(glDrawMode, meshEntries[i].nrIndices,
-            GL_UNSIGNED_INT, (void*)(sizeof(unsigned int) * meshEntries[i].baseIndex),
-            meshEntries[i].baseVertex);
+        // Entries without that many levels use their coarsest one
+        const MeshEntry &entry = meshEntries[i];
+        unsigned int nrIndices = entry.nrIndices;
+        unsigned int baseIndex = entry.baseIndex;
+        if (lod > 0 && entry.nrLODs > 1)
+        {
+            unsigned int level = std::min(lod, entry.nrLODs - 1);
+            nrIndices = entry.lodNrIndices[level];
+            baseIndex = entry.lodBaseIndex[level];
+        }
+
+        glDrawElementsBaseVertex(glDrawMode, nrIndices,
+            buffers->m_indexType, (void*)(buffers->m_indexOffset + indexSize * baseIndex),
+            buffers->m_baseVertex + entry.baseVertex);
+
+        FrameStats::Add(FrameStats::DRAW_CALLS);
+        if (glDrawMode == GL_TRIANGLES)
+            FrameStats::Add(FrameStats::TRIANGLES, nrIndices / 3);
     }
     glBindVertexArray(0);
 }
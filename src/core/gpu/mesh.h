@@ -1,11 +1,13 @@
 #pragma once
 
+#include <list>
 #include <string>
 #include <vector>
 
 #include "core/gpu/vertex_format.h"
 #include "core/gpu/texture2D.h"
 #include "core/gpu/gpu_buffers.h"
+#include "core/gpu/mesh_optimizer.h"
 
 #include "assimp/scene.h"   // Output data structure
 
@@ -29,6 +31,9 @@ class Material
 
 static const unsigned int INVALID_MATERIAL = std::numeric_limits<unsigned int>::max();
 
+// Number of levels of detail of a mesh entry, including the full resolution one
+#define MAX_MESH_LODS           (4)
+
 class MeshEntry
 {
  public:
@@ -38,11 +43,18 @@ class MeshEntry
         baseVertex = 0;
         baseIndex = 0;
         materialIndex = INVALID_MATERIAL;
+        nrLODs = 1;
     }
     unsigned int nrIndices;
     unsigned int baseVertex;
     unsigned int baseIndex;
     unsigned int materialIndex;
+
+    // Simplified versions of the entry, indexing the same vertices. LOD 0 is
+    // the entry itself (nrIndices, baseIndex), LOD i is lodNrIndices[i].
+    unsigned int nrLODs;
+    unsigned int lodNrIndices[MAX_MESH_LODS];
+    unsigned int lodBaseIndex[MAX_MESH_LODS];
 };
 
 class Mesh
@@ -79,6 +91,18 @@ class Mesh
 
     void UseMaterials(bool value);
 
+    // Keep the CPU copies of the vertex data after it was uploaded to
+    // the GPU. Must be set before initializing the mesh. Defaults to false.
+    void KeepCPUData(bool value);
+
+    // Generate simplified versions of the meshes loaded from files, for
+    // far away objects. Must be set before loading. Defaults to true.
+    void UseLODs(bool value);
+
+    // Store the vertices as PackedVertexFormat on the GPU. Must be set before
+    // initializing the mesh, and the shaders must decode them. Defaults to false.
+    void UsePackedVertices(bool value);
+
     // GL_POINTS, GL_TRIANGLES, GL_LINES, GL_LINE_STRIP, GL_LINE_LOOP, GL_LINE_STRIP_ADJACENCY, GL_LINES_ADJACENCY,
     // GL_TRIANGLE_STRIP, GL_TRIANGLE_FAN, GL_TRIANGLE_STRIP_ADJACENCY, GL_TRIANGLES_ADJACENCY
     void SetDrawMode(GLenum primitive);
@@ -86,19 +110,69 @@ class Mesh
 
     void Render() const;
 
+    // Renders the given level of detail, clamped to the ones available
+    void Render(unsigned int lod) const;
+    unsigned int GetLODCount() const;
+
+    // Bounding sphere of the vertices, in model space
+    glm::vec3 GetBoundingCenter() const;
+    float GetBoundingRadius() const;
+
     const GPUBuffers* GetBuffers() const;
     const char* GetMeshID() const;
 
+    // What the import optimizations did to the last file loaded
+    const mesh_optimizer::Report &GetOptimizationReport() const;
+
+    // Loads every model (.obj, .fbx) under `directory` and writes what the import
+    // optimizations did to each one, as CSV. Needs an OpenGL context.
+    static bool WriteOptimizationReport(const std::string &directory, const std::string &fileName);
+
+    // Swaps in the meshes whose files were imported again in the background since
+    // the last call (see LoadMesh). Called at the start of every frame.
+    static void FinishReloads();
+
  protected:
     void InitFromData();
 
-    void InitMesh(const aiMesh* paiMesh);
+    // Computes the bounds of the uploaded data, then releases
+    // the CPU copies, unless asked to keep them
+    void OnDataUploaded();
+
+    // Appends the simplified versions of the entry to the index buffer
+    void GenerateLODs(MeshEntry &entry, const mesh_optimizer::VertexStream &positions, size_t nrVertices);
+
+    // Files are loaded into a staging mesh with the same settings, swapped in
+    // only once the load succeeded, so that a failed (hot) reload leaves the
+    // mesh as it was
+    void CopySettings(const Mesh &other);
+    void SwapData(Mesh &other);
+
+    // Appends the data of the mesh, optimized for the GPU
+    mesh_optimizer::Report InitMesh(const aiMesh* paiMesh);
     bool InitMaterials(const aiScene* pScene);
+
+    // Loading a scene is split in two, so that reloads import in the background.
+    // ImportScene builds the CPU data and may run on any thread, UploadScene
+    // creates the materials and the GPU buffers.
     bool InitFromScene(const aiScene* pScene);
+    virtual void ImportScene(const aiScene* pScene);
+    virtual bool UploadScene(const aiScene* pScene);
+    // An empty mesh of the same type, to load into
+    virtual Mesh *CreateStaging() const;
+
+ private:
+    struct Reload;
+
+    // Imports the file on a job, for FinishReloads to swap in
+    void StartReload(const std::string& fileLocation, const std::string& fileName);
 
  private:
     std::string meshID;
 
+    // In flight, in the order they started
+    static std::list<Reload *> reloads;
+
  public:
     std::vector<glm::vec3> positions;
     std::vector<glm::vec3> normals;
@@ -110,6 +184,13 @@ class Mesh
     std::string fileLocation;
 
     bool useMaterial;
+    bool keepCPUData;
+    bool packedVertices;
+    bool useLODs;
+    unsigned int nrLODs;
+    mesh_optimizer::Report optimizationReport;
+    glm::vec3 boundingCenter;
+    float boundingRadius;
     GLenum glDrawMode;
     GPUBuffers *buffers;
 
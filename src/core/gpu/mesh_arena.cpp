@@ -0,0 +1,205 @@
+#include "core/gpu/mesh_arena.h"
+
+#include <algorithm>
+#include <iterator>
+
+
+// Index ranges are kept 4-byte aligned, so that both 16-bit
+// and 32-bit indices can live in the same buffer
+#define INDEX_ALIGNMENT     (4)
+
+
+RangeAllocator::RangeAllocator()
+{
+    capacity = 0;
+}
+
+
+bool RangeAllocator::Allocate(unsigned int size, unsigned int &offset)
+{
+    for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it)
+    {
+        if (it->second < size)
+            continue;
+
+        offset = it->first;
+        unsigned int remaining = it->second - size;
+        freeRanges.erase(it);
+        if (remaining)
+            freeRanges[offset + size] = remaining;
+        return true;
+    }
+    return false;
+}
+
+
+void RangeAllocator::Free(unsigned int offset, unsigned int size)
+{
+    if (size == 0)
+        return;
+
+    auto next = freeRanges.lower_bound(offset);
+
+    // Merge with the following free range
+    if (next != freeRanges.end() && offset + size == next->first)
+    {
+        size += next->second;
+        next = freeRanges.erase(next);
+    }
+
+    // Merge with the preceding free range
+    if (next != freeRanges.begin())
+    {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset)
+        {
+            prev->second += size;
+            return;
+        }
+    }
+
+    freeRanges[offset] = size;
+}
+
+
+void RangeAllocator::Grow(unsigned int newCapacity)
+{
+    if (newCapacity <= capacity)
+        return;
+
+    unsigned int oldCapacity = capacity;
+    capacity = newCapacity;
+    Free(oldCapacity, newCapacity - oldCapacity);
+}
+
+
+unsigned int RangeAllocator::GetCapacity() const
+{
+    return capacity;
+}
+
+
+MeshArena::MeshArena(GLsizei vertexStride, std::function<void()> setupAttributes,
+                     unsigned int initialVertices, unsigned int initialIndexBytes)
+{
+    this->vertexStride = vertexStride;
+    this->setupAttributes = setupAttributes;
+
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    glGenBuffers(1, &EBO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(initialVertices) * vertexStride, NULL, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    vertexRanges.Grow(initialVertices);
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+    glBufferData(GL_COPY_WRITE_BUFFER, initialIndexBytes, NULL, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    indexRanges.Grow(initialIndexBytes / INDEX_ALIGNMENT);
+
+    BindBuffers();
+    CheckOpenGLError();
+}
+
+
+MeshArena::~MeshArena()
+{
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &EBO);
+}
+
+
+bool MeshArena::Upload(const void *vertices, unsigned int nrVertices,
+                       const void *indices, unsigned int indexBytes,
+                       unsigned int &baseVertex, unsigned int &indexOffset)
+{
+    unsigned int indexUnits = (indexBytes + INDEX_ALIGNMENT - 1) / INDEX_ALIGNMENT;
+
+    if (!vertexRanges.Allocate(nrVertices, baseVertex))
+    {
+        Reserve(VBO, vertexRanges, vertexStride, nrVertices);
+        if (!vertexRanges.Allocate(nrVertices, baseVertex))
+            return false;
+    }
+
+    if (!indexRanges.Allocate(indexUnits, indexOffset))
+    {
+        Reserve(EBO, indexRanges, INDEX_ALIGNMENT, indexUnits);
+        if (!indexRanges.Allocate(indexUnits, indexOffset))
+        {
+            vertexRanges.Free(baseVertex, nrVertices);
+            return false;
+        }
+    }
+    indexOffset *= INDEX_ALIGNMENT;
+
+    // The element buffer is uploaded through a copy binding, so
+    // that the VAO state is not touched
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferSubData(GL_ARRAY_BUFFER, static_cast<GLintptr>(baseVertex) * vertexStride,
+                    static_cast<GLsizeiptr>(nrVertices) * vertexStride, vertices);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, indexOffset, indexBytes, indices);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    CheckOpenGLError();
+    return true;
+}
+
+
+void MeshArena::Free(unsigned int baseVertex, unsigned int nrVertices,
+                     unsigned int indexOffset, unsigned int indexBytes)
+{
+    vertexRanges.Free(baseVertex, nrVertices);
+    indexRanges.Free(indexOffset / INDEX_ALIGNMENT, (indexBytes + INDEX_ALIGNMENT - 1) / INDEX_ALIGNMENT);
+}
+
+
+GLuint MeshArena::GetVAO() const
+{
+    return VAO;
+}
+
+
+void MeshArena::Reserve(GLuint &buffer, RangeAllocator &allocator,
+                        unsigned int unitSize, unsigned int required)
+{
+    unsigned int oldCapacity = allocator.GetCapacity();
+    unsigned int newCapacity = std::max(2 * oldCapacity, oldCapacity + required);
+
+    // Move the content to a bigger buffer
+    GLuint newBuffer;
+    glGenBuffers(1, &newBuffer);
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(newCapacity) * unitSize, NULL, GL_STATIC_DRAW);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, static_cast<GLsizeiptr>(oldCapacity) * unitSize);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glDeleteBuffers(1, &buffer);
+
+    buffer = newBuffer;
+    allocator.Grow(newCapacity);
+
+    // Point the (same) VAO to the new storage
+    BindBuffers();
+    CheckOpenGLError();
+}
+
+
+void MeshArena::BindBuffers()
+{
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    setupAttributes();
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+    // Make sure the VAO is not changed from the outside
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <map>
+#include <functional>
+
+#include "utils/gl_utils.h"
+
+
+// Hands out sub-ranges of a linear resource, first fit. Freed ranges
+// are merged with their free neighbours.
+class RangeAllocator
+{
+ public:
+    RangeAllocator();
+
+    bool Allocate(unsigned int size, unsigned int &offset);
+    void Free(unsigned int offset, unsigned int size);
+
+    // Adds [capacity, newCapacity) to the free space
+    void Grow(unsigned int newCapacity);
+    unsigned int GetCapacity() const;
+
+ private:
+    unsigned int capacity;
+    std::map<unsigned int, unsigned int> freeRanges;    // offset -> size
+};
+
+
+// A vertex buffer and an index buffer shared by all the meshes of a vertex
+// format, drawn through a single VAO. Meshes own sub-ranges of both buffers
+// and draw them with glDrawElementsBaseVertex. The buffers grow on demand;
+// growing keeps the VAO, so meshes never have to know about it.
+class MeshArena
+{
+ public:
+    // `setupAttributes` enables and describes the vertex attributes, it is
+    // called with the VAO and the vertex buffer bound
+    MeshArena(GLsizei vertexStride, std::function<void()> setupAttributes,
+              unsigned int initialVertices = 1 << 16, unsigned int initialIndexBytes = 1 << 20);
+    ~MeshArena();
+
+    // Uploads the data and returns the location of the mesh inside the buffers.
+    // `indexOffset` is in bytes, `baseVertex` in vertices.
+    bool Upload(const void *vertices, unsigned int nrVertices,
+                const void *indices, unsigned int indexBytes,
+                unsigned int &baseVertex, unsigned int &indexOffset);
+    void Free(unsigned int baseVertex, unsigned int nrVertices,
+              unsigned int indexOffset, unsigned int indexBytes);
+
+    GLuint GetVAO() const;
+
+ private:
+    void Reserve(GLuint &buffer, RangeAllocator &allocator,
+                 unsigned int unitSize, unsigned int required);
+    void BindBuffers();
+
+ private:
+    GLuint VAO;
+    GLuint VBO, EBO;
+    GLsizei vertexStride;
+    std::function<void()> setupAttributes;
+
+    RangeAllocator vertexRanges;
+    RangeAllocator indexRanges;
+};
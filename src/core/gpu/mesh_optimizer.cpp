@@ -0,0 +1,637 @@
+#include "core/gpu/mesh_optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+
+namespace
+{
+    const glm::vec3 &PositionOf(const mesh_optimizer::VertexStream &positions, unsigned int vertex)
+    {
+        return *reinterpret_cast<const glm::vec3 *>(
+            static_cast<const unsigned char *>(positions.data) + positions.stride * vertex);
+    }
+
+
+    // FNV-1a over the bytes of a vertex, in all the streams
+    size_t HashVertex(const std::vector<mesh_optimizer::VertexStream> &streams, size_t vertex)
+    {
+        size_t hash = 14695981039346656037ull;
+        for (const auto &stream : streams)
+        {
+            const unsigned char *bytes = static_cast<const unsigned char *>(stream.data) + stream.stride * vertex;
+            for (size_t i = 0; i < stream.stride; i++)
+            {
+                hash ^= bytes[i];
+                hash *= 1099511628211ull;
+            }
+        }
+        return hash;
+    }
+
+
+    bool SameVertex(const std::vector<mesh_optimizer::VertexStream> &streams, size_t a, size_t b)
+    {
+        for (const auto &stream : streams)
+        {
+            const unsigned char *bytes = static_cast<const unsigned char *>(stream.data);
+            if (memcmp(bytes + stream.stride * a, bytes + stream.stride * b, stream.stride) != 0)
+                return false;
+        }
+        return true;
+    }
+}
+
+
+mesh_optimizer::Report::Report()
+{
+    triangles = 0;
+    verticesBefore = 0;
+    verticesAfter = 0;
+    acmrBefore = 0;
+    acmrAfter = 0;
+}
+
+
+mesh_optimizer::Report &mesh_optimizer::Report::operator+=(const Report &other)
+{
+    // ACMR is per triangle, so the merged value is weighted by triangle counts
+    size_t total = triangles + other.triangles;
+    if (total)
+    {
+        acmrBefore = (acmrBefore * triangles + other.acmrBefore * other.triangles) / total;
+        acmrAfter = (acmrAfter * triangles + other.acmrAfter * other.triangles) / total;
+    }
+
+    triangles = total;
+    verticesBefore += other.verticesBefore;
+    verticesAfter += other.verticesAfter;
+    return *this;
+}
+
+
+float mesh_optimizer::AnalyzeVertexCache(const std::vector<unsigned int> &indices, size_t vertexCount,
+                                         unsigned int cacheSize)
+{
+    if (indices.size() < 3)
+        return 0;
+
+    // A vertex is in the cache if it entered it less than `cacheSize` misses ago
+    std::vector<size_t> timestamps(vertexCount, 0);
+    size_t misses = 0;
+
+    for (unsigned int index : indices)
+    {
+        if (timestamps[index] == 0 || misses - timestamps[index] >= cacheSize)
+        {
+            misses++;
+            timestamps[index] = misses;
+        }
+    }
+
+    return static_cast<float>(misses) / (indices.size() / 3);
+}
+
+
+size_t mesh_optimizer::GenerateVertexRemap(const std::vector<VertexStream> &streams, size_t vertexCount,
+                                           std::vector<unsigned int> &remap)
+{
+    remap.assign(vertexCount, ~0u);
+
+    // Open addressing table of vertex ids, at most half full
+    size_t tableSize = 1;
+    while (tableSize < vertexCount * 2)
+        tableSize *= 2;
+    std::vector<unsigned int> table(tableSize, ~0u);
+
+    size_t unique = 0;
+    for (size_t i = 0; i < vertexCount; i++)
+    {
+        size_t slot = HashVertex(streams, i) & (tableSize - 1);
+        while (table[slot] != ~0u && !SameVertex(streams, table[slot], i))
+            slot = (slot + 1) & (tableSize - 1);
+
+        if (table[slot] == ~0u)
+        {
+            table[slot] = static_cast<unsigned int>(i);
+            remap[i] = static_cast<unsigned int>(unique++);
+        }
+        else
+        {
+            remap[i] = remap[table[slot]];
+        }
+    }
+
+    return unique;
+}
+
+
+void mesh_optimizer::OptimizeVertexCache(std::vector<unsigned int> &indices, size_t vertexCount,
+                                         std::vector<unsigned int> *clusters, unsigned int cacheSize)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // Adjacency: the triangles using every vertex
+    std::vector<unsigned int> liveTriangles(vertexCount, 0);
+    for (unsigned int index : indices)
+        liveTriangles[index]++;
+
+    std::vector<unsigned int> adjacencyOffsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+        adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+
+    std::vector<unsigned int> adjacency(indices.size());
+    std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++)
+        adjacency[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+
+    std::vector<size_t> cacheTimestamps(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<unsigned int> deadEnd;
+    std::vector<unsigned int> candidates;
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+
+    size_t timestamp = cacheSize + 1;
+    size_t cursor = 0;
+    int fanning = 0;
+
+    if (clusters)
+        clusters->push_back(0);
+
+    while (fanning >= 0)
+    {
+        candidates.clear();
+
+        // Emit all the remaining triangles around the fanning vertex
+        for (unsigned int a = adjacencyOffsets[fanning]; a < adjacencyOffsets[fanning + 1]; a++)
+        {
+            unsigned int triangle = adjacency[a];
+            if (emitted[triangle])
+                continue;
+
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int v = indices[triangle * 3 + k];
+                result.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                liveTriangles[v]--;
+
+                if (timestamp - cacheTimestamps[v] > cacheSize)
+                    cacheTimestamps[v] = timestamp++;
+            }
+            emitted[triangle] = true;
+        }
+
+        // Pick the candidate that is going to stay in the cache the longest,
+        // as long as fanning around it won't evict it
+        int best = -1;
+        size_t bestPriority = 0;
+        for (unsigned int v : candidates)
+        {
+            if (liveTriangles[v] == 0)
+                continue;
+
+            size_t priority = 0;
+            if (timestamp - cacheTimestamps[v] + 2 * liveTriangles[v] <= cacheSize)
+                priority = timestamp - cacheTimestamps[v];
+
+            if (best < 0 || priority > bestPriority)
+            {
+                best = static_cast<int>(v);
+                bestPriority = priority;
+            }
+        }
+
+        if (best >= 0)
+        {
+            fanning = best;
+            continue;
+        }
+
+        // Dead end: go back to a recently used vertex, or to the next one in input order.
+        // This is where the cache is (probably) cold again, so a new cluster starts.
+        fanning = -1;
+        while (!deadEnd.empty())
+        {
+            unsigned int v = deadEnd.back();
+            deadEnd.pop_back();
+            if (liveTriangles[v] > 0)
+            {
+                fanning = static_cast<int>(v);
+                break;
+            }
+        }
+
+        while (fanning < 0 && cursor < vertexCount)
+        {
+            if (liveTriangles[cursor] > 0)
+            {
+                fanning = static_cast<int>(cursor);
+            }
+            cursor++;
+        }
+
+        if (clusters && fanning >= 0 && result.size() / 3 != clusters->back())
+            clusters->push_back(static_cast<unsigned int>(result.size() / 3));
+    }
+
+    indices.swap(result);
+}
+
+
+void mesh_optimizer::OptimizeOverdraw(std::vector<unsigned int> &indices, const std::vector<unsigned int> &clusters,
+                                      const VertexStream &positions)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (clusters.size() < 2)
+        return;
+
+    struct Cluster
+    {
+        unsigned int begin, end;
+        float sortKey;
+    };
+
+    // Area weighted centroid and normal of every cluster
+    std::vector<Cluster> sorted(clusters.size());
+    std::vector<glm::vec3> centroids(clusters.size());
+    std::vector<glm::vec3> normals(clusters.size());
+    glm::vec3 meshCentroid(0);
+    float meshArea = 0;
+
+    for (size_t c = 0; c < clusters.size(); c++)
+    {
+        sorted[c].begin = clusters[c];
+        sorted[c].end = c + 1 < clusters.size() ? clusters[c + 1] : static_cast<unsigned int>(triangleCount);
+
+        glm::vec3 centroid(0), normal(0);
+        float area = 0;
+        for (unsigned int t = sorted[c].begin; t < sorted[c].end; t++)
+        {
+            const glm::vec3 &p0 = PositionOf(positions, indices[t * 3 + 0]);
+            const glm::vec3 &p1 = PositionOf(positions, indices[t * 3 + 1]);
+            const glm::vec3 &p2 = PositionOf(positions, indices[t * 3 + 2]);
+
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float a = glm::length(n);
+            centroid += (p0 + p1 + p2) * (a / 3.0f);
+            normal += n;
+            area += a;
+        }
+
+        meshCentroid += centroid;
+        meshArea += area;
+        centroids[c] = area > 0 ? centroid / area : centroid;
+        normals[c] = glm::length(normal) > 0 ? glm::normalize(normal) : normal;
+    }
+
+    if (meshArea > 0)
+        meshCentroid /= meshArea;
+
+    for (size_t c = 0; c < clusters.size(); c++)
+        sorted[c].sortKey = glm::dot(centroids[c] - meshCentroid, normals[c]);
+
+    std::stable_sort(sorted.begin(), sorted.end(),
+        [](const Cluster &a, const Cluster &b) { return a.sortKey > b.sortKey; });
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (const auto &cluster : sorted)
+        result.insert(result.end(), indices.begin() + cluster.begin * 3, indices.begin() + cluster.end * 3);
+
+    indices.swap(result);
+}
+
+
+size_t mesh_optimizer::OptimizeVertexFetchRemap(const std::vector<unsigned int> &indices, size_t vertexCount,
+                                                std::vector<unsigned int> &remap)
+{
+    remap.assign(vertexCount, ~0u);
+
+    unsigned int next = 0;
+    for (unsigned int index : indices)
+    {
+        if (remap[index] == ~0u)
+            remap[index] = next++;
+    }
+
+    return next;
+}
+
+
+mesh_optimizer::Report mesh_optimizer::OptimizeMesh(std::vector<unsigned int> &indices, const std::vector<VertexStream> &streams,
+                                                    size_t vertexCount, const VertexStream &positions,
+                                                    std::vector<unsigned int> &remap, size_t &newVertexCount)
+{
+    Report report;
+    report.triangles = indices.size() / 3;
+    report.verticesBefore = vertexCount;
+    report.acmrBefore = AnalyzeVertexCache(indices, vertexCount);
+
+    // Weld the duplicate vertices
+    std::vector<unsigned int> weldRemap;
+    size_t weldedCount = GenerateVertexRemap(streams, vertexCount, weldRemap);
+    for (auto &index : indices)
+        index = weldRemap[index];
+
+    // A vertex of the input that every welded vertex comes from, to look up positions
+    std::vector<unsigned int> source(weldedCount);
+    for (size_t i = vertexCount; i-- > 0;)
+        source[weldRemap[i]] = static_cast<unsigned int>(i);
+
+    std::vector<glm::vec3> weldedPositions(weldedCount);
+    for (size_t i = 0; i < weldedCount; i++)
+        weldedPositions[i] = PositionOf(positions, source[i]);
+
+    // Reorder the triangles, first for the cache, then for overdraw
+    std::vector<unsigned int> clusters;
+    OptimizeVertexCache(indices, weldedCount, &clusters);
+    OptimizeOverdraw(indices, clusters, { weldedPositions.data(), sizeof(glm::vec3) });
+
+    // Reorder the vertices, and compose both remaps
+    std::vector<unsigned int> fetchRemap;
+    newVertexCount = OptimizeVertexFetchRemap(indices, weldedCount, fetchRemap);
+    for (auto &index : indices)
+        index = fetchRemap[index];
+
+    remap.resize(vertexCount);
+    for (size_t i = 0; i < vertexCount; i++)
+        remap[i] = fetchRemap[weldRemap[i]];
+
+    report.verticesAfter = newVertexCount;
+    report.acmrAfter = AnalyzeVertexCache(indices, newVertexCount);
+    return report;
+}
+
+
+namespace
+{
+    // Weighted sum of squared distances to a set of planes, as a symmetric 4x4 matrix,
+    // and the sum of the weights
+    struct Quadric
+    {
+        double a00, a01, a02, a03;
+        double a11, a12, a13;
+        double a22, a23;
+        double a33;
+        double weight;
+
+        Quadric() : a00(0), a01(0), a02(0), a03(0), a11(0), a12(0), a13(0), a22(0), a23(0), a33(0), weight(0) {}
+
+        Quadric(const glm::dvec3 &n, double d, double weight) : weight(weight)
+        {
+            a00 = weight * n.x * n.x; a01 = weight * n.x * n.y; a02 = weight * n.x * n.z; a03 = weight * n.x * d;
+            a11 = weight * n.y * n.y; a12 = weight * n.y * n.z; a13 = weight * n.y * d;
+            a22 = weight * n.z * n.z; a23 = weight * n.z * d;
+            a33 = weight * d * d;
+        }
+
+        Quadric &operator+=(const Quadric &q)
+        {
+            a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+            a11 += q.a11; a12 += q.a12; a13 += q.a13;
+            a22 += q.a22; a23 += q.a23;
+            a33 += q.a33;
+            weight += q.weight;
+            return *this;
+        }
+
+        // The weighted average of the squared distances, so that it does not depend on
+        // the areas that weight the planes: a squared distance, whatever the scale
+        double Error(const glm::vec3 &p) const
+        {
+            if (weight <= 0)
+                return 0;
+
+            double x = p.x, y = p.y, z = p.z;
+            double result = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x
+                          + a11 * y * y + 2 * a12 * y * z + 2 * a13 * y
+                          + a22 * z * z + 2 * a23 * z
+                          + a33;
+            return result > 0 ? result / weight : 0;
+        }
+    };
+
+
+    struct Collapse
+    {
+        unsigned int from, to;
+        double cost;
+    };
+
+
+    unsigned int Follow(const std::vector<unsigned int> &collapsed, unsigned int v)
+    {
+        while (collapsed[v] != v)
+            v = collapsed[v];
+        return v;
+    }
+}
+
+
+std::vector<unsigned int> mesh_optimizer::Simplify(const std::vector<unsigned int> &indices, const VertexStream &positions,
+                                                   size_t vertexCount, size_t targetIndexCount, float targetError,
+                                                   float *resultError)
+{
+    std::vector<unsigned int> result = indices;
+    if (resultError)
+        *resultError = 0;
+    if (result.size() <= targetIndexCount || vertexCount == 0)
+        return result;
+
+    // Errors are measured relative to the extent of the mesh
+    glm::vec3 boxMin(PositionOf(positions, result[0])), boxMax(boxMin);
+    for (unsigned int index : result)
+    {
+        boxMin = glm::min(boxMin, PositionOf(positions, index));
+        boxMax = glm::max(boxMax, PositionOf(positions, index));
+    }
+    float extent = glm::max(glm::length(boxMax - boxMin), 1e-6f);
+    double maxError = static_cast<double>(targetError) * extent;
+    maxError *= maxError;
+
+    // Vertices that share a position with another one sit on an attribute seam;
+    // vertices on open edges are on a border. Neither of them can move.
+    std::vector<bool> locked(vertexCount, false);
+    {
+        // Only the positions are compared, whatever the stride of the stream is
+        std::vector<glm::vec3> compact(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++)
+            compact[v] = PositionOf(positions, static_cast<unsigned int>(v));
+
+        std::vector<unsigned int> byPosition;
+        GenerateVertexRemap({ { compact.data(), sizeof(glm::vec3) } }, vertexCount, byPosition);
+        std::vector<unsigned int> firstWithPosition(vertexCount, ~0u);
+        for (size_t v = 0; v < vertexCount; v++)
+        {
+            unsigned int &first = firstWithPosition[byPosition[v]];
+            if (first == ~0u)
+            {
+                first = static_cast<unsigned int>(v);
+            }
+            else
+            {
+                locked[first] = true;
+                locked[v] = true;
+            }
+        }
+
+        std::unordered_map<unsigned long long, int> edges;
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned long long a = result[i + k], b = result[i + (k + 1) % 3];
+                edges[a < b ? (a << 32 | b) : (b << 32 | a)]++;
+            }
+        }
+        for (const auto &edge : edges)
+        {
+            if (edge.second == 1)
+            {
+                locked[edge.first >> 32] = true;
+                locked[edge.first & 0xFFFFFFFF] = true;
+            }
+        }
+    }
+
+    // Plane quadrics of the triangles, weighted by area
+    std::vector<Quadric> quadrics(vertexCount);
+    for (size_t i = 0; i < result.size(); i += 3)
+    {
+        glm::dvec3 p0 = PositionOf(positions, result[i + 0]);
+        glm::dvec3 p1 = PositionOf(positions, result[i + 1]);
+        glm::dvec3 p2 = PositionOf(positions, result[i + 2]);
+        glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+        double area = glm::length(normal);
+        if (area == 0)
+            continue;
+
+        normal /= area;
+        Quadric q(normal, -glm::dot(normal, p0), area);
+        for (int k = 0; k < 3; k++)
+            quadrics[result[i + k]] += q;
+    }
+
+    std::vector<unsigned int> collapsed(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        collapsed[v] = static_cast<unsigned int>(v);
+
+    double worstError = 0;
+    std::vector<Collapse> candidates;
+    std::vector<bool> touched(vertexCount);
+    std::vector<unsigned int> adjacencyOffsets(vertexCount + 1);
+    std::vector<unsigned int> adjacency;
+
+    // Every pass collapses the cheapest edges, at most one per vertex
+    while (result.size() > targetIndexCount)
+    {
+        std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+        for (unsigned int index : result)
+            adjacencyOffsets[index + 1]++;
+        for (size_t v = 0; v < vertexCount; v++)
+            adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+        adjacency.resize(result.size());
+        std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t i = 0; i < result.size(); i++)
+            adjacency[fill[result[i]]++] = static_cast<unsigned int>(i / 3);
+
+        candidates.clear();
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int from = result[i + k], to = result[i + (k + 1) % 3];
+                if (locked[from])
+                    continue;
+                Quadric q = quadrics[from];
+                q += quadrics[to];
+                candidates.push_back({ from, to, q.Error(PositionOf(positions, to)) });
+            }
+        }
+        if (candidates.empty())
+            break;
+
+        std::sort(candidates.begin(), candidates.end(),
+            [](const Collapse &a, const Collapse &b) { return a.cost < b.cost; });
+
+        std::fill(touched.begin(), touched.end(), false);
+        size_t trianglesLeft = result.size() / 3;
+        size_t collapses = 0;
+
+        for (const auto &collapse : candidates)
+        {
+            if (collapse.cost > maxError || trianglesLeft * 3 <= targetIndexCount)
+                break;
+            if (touched[collapse.from] || touched[collapse.to])
+                continue;
+
+            // Moving `from` onto `to` must not flip any of the remaining triangles
+            const glm::vec3 &target = PositionOf(positions, collapse.to);
+            bool flips = false;
+            size_t removed = 0;
+            for (unsigned int a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1] && !flips; a++)
+            {
+                const unsigned int *t = &result[adjacency[a] * 3];
+                if (t[0] == collapse.to || t[1] == collapse.to || t[2] == collapse.to)
+                {
+                    removed++;
+                    continue;
+                }
+
+                glm::vec3 p[3], q[3];
+                for (int k = 0; k < 3; k++)
+                {
+                    p[k] = PositionOf(positions, t[k]);
+                    q[k] = t[k] == collapse.from ? target : p[k];
+                }
+                glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+                flips = glm::dot(before, after) <= 0;
+            }
+            if (flips)
+                continue;
+
+            // Lock the whole neighbourhood for the rest of the pass
+            for (unsigned int a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1]; a++)
+            {
+                for (int k = 0; k < 3; k++)
+                    touched[result[adjacency[a] * 3 + k]] = true;
+            }
+
+            collapsed[collapse.from] = collapse.to;
+            quadrics[collapse.to] += quadrics[collapse.from];
+            worstError = std::max(worstError, collapse.cost);
+            trianglesLeft -= removed;
+            collapses++;
+        }
+
+        if (collapses == 0)
+            break;
+
+        // Apply the collapses and drop the degenerate triangles
+        size_t write = 0;
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            unsigned int a = Follow(collapsed, result[i + 0]);
+            unsigned int b = Follow(collapsed, result[i + 1]);
+            unsigned int c = Follow(collapsed, result[i + 2]);
+            if (a == b || b == c || a == c)
+                continue;
+            result[write++] = a;
+            result[write++] = b;
+            result[write++] = c;
+        }
+        result.resize(write);
+    }
+
+    if (resultError)
+        *resultError = static_cast<float>(std::sqrt(worstError) / extent);
+    return result;
+}
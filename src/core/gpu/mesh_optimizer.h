@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+#include "utils/glm_utils.h"
+
+
+// Import time optimizations for indexed triangle lists
+namespace mesh_optimizer
+{
+    // One array of vertex attributes, `stride` bytes per vertex
+    struct VertexStream
+    {
+        const void *data;
+        size_t stride;
+    };
+
+    struct Report
+    {
+        Report();
+        Report &operator+=(const Report &other);
+
+        size_t triangles;
+        size_t verticesBefore;
+        size_t verticesAfter;
+        float acmrBefore;
+        float acmrAfter;
+    };
+
+    // Average cache miss ratio (cache misses per triangle) of a FIFO post-transform cache
+    float AnalyzeVertexCache(const std::vector<unsigned int> &indices, size_t vertexCount,
+                             unsigned int cacheSize = 16);
+
+    // Finds the vertices that are identical across all streams. `remap` maps every
+    // vertex to its unique copy. Returns the number of unique vertices.
+    size_t GenerateVertexRemap(const std::vector<VertexStream> &streams, size_t vertexCount,
+                               std::vector<unsigned int> &remap);
+
+    // Reorders the triangles for the post-transform vertex cache (Tipsify). The first
+    // triangle of every cluster found along the way is appended to `clusters`.
+    void OptimizeVertexCache(std::vector<unsigned int> &indices, size_t vertexCount,
+                             std::vector<unsigned int> *clusters = nullptr,
+                             unsigned int cacheSize = 16);
+
+    // Sorts the clusters of triangles so that the ones facing away from the center of
+    // the mesh are drawn first, as they are most likely to occlude the rest
+    void OptimizeOverdraw(std::vector<unsigned int> &indices, const std::vector<unsigned int> &clusters,
+                          const VertexStream &positions);
+
+    // Numbers the vertices in the order they are first referenced, so that vertex
+    // fetches are mostly sequential. Returns the number of referenced vertices.
+    size_t OptimizeVertexFetchRemap(const std::vector<unsigned int> &indices, size_t vertexCount,
+                                    std::vector<unsigned int> &remap);
+
+    // Runs all the passes above on a triangle list: welds duplicate vertices, then
+    // reorders the triangles and finally the vertices. The indices are rewritten in
+    // place, while the vertex streams are left for the caller to update through
+    // RemapVertexBuffer with `remap`.
+    Report OptimizeMesh(std::vector<unsigned int> &indices, const std::vector<VertexStream> &streams,
+                        size_t vertexCount, const VertexStream &positions,
+                        std::vector<unsigned int> &remap, size_t &newVertexCount);
+
+    // Reduces the number of triangles to about `targetIndexCount / 3` by collapsing edges
+    // (quadric error metric). Only existing vertices are used, so the result can share the
+    // vertex buffer of the input. Borders and attribute seams are kept in place. The collapses
+    // stop early once the error, relative to the size of the mesh, exceeds `targetError`.
+    // Returns the resulting error through `resultError`, if given.
+    std::vector<unsigned int> Simplify(const std::vector<unsigned int> &indices, const VertexStream &positions,
+                                       size_t vertexCount, size_t targetIndexCount, float targetError,
+                                       float *resultError = nullptr);
+
+    // Applies a remap returned by the functions above to a vertex buffer.
+    // Vertices mapped to ~0u (not referenced) are dropped.
+    template <typename T>
+    void RemapVertexBuffer(std::vector<T> &vertices, const std::vector<unsigned int> &remap, size_t newCount)
+    {
+        if (vertices.empty())
+            return;
+
+        std::vector<T> result(newCount, vertices[0]);
+        for (size_t i = 0; i < remap.size() && i < vertices.size(); i++)
+        {
+            if (remap[i] != ~0u)
+                result[remap[i]] = vertices[i];
+        }
+        vertices.swap(result);
+    }
+}
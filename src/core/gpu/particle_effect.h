@@ -12,6 +12,7 @@
 #include "core/gpu/shader.h"
 #include "core/gpu/texture2D.h"
 #include "core/gpu/ssbo.h"
+#include "core/gpu/stream_buffer.h"
 
 
 // TODO(developer): Decouple gfxc components from this class
@@ -24,6 +25,14 @@ class ParticleEffect
 
     virtual void Generate(unsigned int particleCount, bool createLocalBuffer = false);
     virtual void FillRandomData(std::function<T(void)> generator);
+
+    // The particles are written by the CPU every frame (see CPUParticleSystem)
+    // instead of living in an SSBO: only the live ones are streamed, through a
+    // ring of regions, and Render draws the ones of the last UnmapParticles.
+    virtual void GenerateStreaming(unsigned int maxParticles);
+    virtual T *MapParticles();
+    virtual void UnmapParticles(unsigned int nrParticles);
+
     virtual void Render(gfxc::Camera *camera, Shader *shader, unsigned int nrParticles = -1);
 
     virtual SSBO<T>* GetParticleBuffer() const
@@ -36,6 +45,9 @@ class ParticleEffect
         return particleCount;
     }
 
+ protected:
+    void CreateIndexBuffer();
+
  public:
     gfxc::Transform * source;
 
@@ -44,6 +56,8 @@ class ParticleEffect
     GLuint VAO;
     GLuint VBO;
     SSBO<T> *particles;
+    StreamBuffer *stream;
+    unsigned int streamedParticles;
 };
 
 
@@ -51,7 +65,12 @@ template <class T>
 ParticleEffect<T>::ParticleEffect()
 {
     source = new gfxc::Transform();
+    particleCount = 0;
+    VAO = 0;
+    VBO = 0;
     particles = nullptr;
+    stream = nullptr;
+    streamedParticles = 0;
 }
 
 
@@ -60,6 +79,9 @@ ParticleEffect<T>::~ParticleEffect()
 {
     SAFE_FREE(source);
     SAFE_FREE(particles);
+    SAFE_FREE(stream);
+    glDeleteBuffers(1, &VBO);
+    glDeleteVertexArrays(1, &VAO);
 }
 
 
@@ -73,11 +95,25 @@ void ParticleEffect<T>::Render(gfxc::Camera *camera, Shader *shader, unsigned in
     glUniform3fv(shader->loc_eye_pos, 1, glm::value_ptr(camera->m_transform->GetWorldPosition()));
 
     // Bind Particle Storage
-    particles->BindBuffer(0);
+    unsigned int count = MIN(particleCount, nrParticles);
+    if (stream)
+    {
+        count = MIN(streamedParticles, count);
+        if (count == 0)
+            return;
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, stream->GetBuffer(), stream->GetOffset(), count * sizeof(T));
+    }
+    else
+    {
+        particles->BindBuffer(0);
+    }
 
     // Render Particles
     glBindVertexArray(VAO);
-    glDrawElements(GL_POINTS, MIN(particleCount, nrParticles), GL_UNSIGNED_INT, 0);
+    glDrawElements(GL_POINTS, count, GL_UNSIGNED_INT, 0);
+
+    if (stream)
+        stream->Fence();
 }
 
 
@@ -86,9 +122,46 @@ void ParticleEffect<T>::Generate(unsigned int particleCount, bool createLocalBuf
 {
     this->particleCount = particleCount;
 
+    SAFE_FREE(stream);
     SAFE_FREE(particles);
     particles = new SSBO<T>(particleCount, createLocalBuffer);
 
+    CreateIndexBuffer();
+}
+
+
+template <class T>
+void ParticleEffect<T>::GenerateStreaming(unsigned int maxParticles)
+{
+    this->particleCount = maxParticles;
+
+    SAFE_FREE(particles);
+    SAFE_FREE(stream);
+    stream = new StreamBuffer(GL_SHADER_STORAGE_BUFFER, maxParticles * sizeof(T));
+    streamedParticles = 0;
+
+    CreateIndexBuffer();
+}
+
+
+template <class T>
+T *ParticleEffect<T>::MapParticles()
+{
+    return static_cast<T *>(stream->Map());
+}
+
+
+template <class T>
+void ParticleEffect<T>::UnmapParticles(unsigned int nrParticles)
+{
+    streamedParticles = MIN(nrParticles, particleCount);
+    stream->Unmap(streamedParticles * sizeof(T));
+}
+
+
+template <class T>
+void ParticleEffect<T>::CreateIndexBuffer()
+{
     unsigned int *indices = new unsigned int[particleCount];
     unsigned int *p = indices;
     for (unsigned int i = 0; i < particleCount; i++)
@@ -97,13 +170,14 @@ void ParticleEffect<T>::Generate(unsigned int particleCount, bool createLocalBuf
         p++;
     }
 
-    GLuint IBO;
+    glDeleteBuffers(1, &VBO);
+    glDeleteVertexArrays(1, &VAO);
 
     glGenVertexArrays(1, &VAO);
     glBindVertexArray(VAO);
 
-    glGenBuffers(1, &IBO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
+    glGenBuffers(1, &VBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, VBO);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, particleCount * sizeof(unsigned int), indices, GL_STATIC_DRAW);
 
     glBindVertexArray(0);
@@ -115,10 +189,10 @@ void ParticleEffect<T>::Generate(unsigned int particleCount, bool createLocalBuf
 template <class T>
 void ParticleEffect<T>::FillRandomData(std::function<T(void)> generator)
 {
-    particles->ReadBuffer();
-    auto data = const_cast<T*>(particles->GetBuffer());
+    // The previous contents are overwritten, no need to read them back
+    std::vector<T> data(particleCount);
     for (unsigned int i = 0; i < particleCount; i++) {
         data[i] = generator();
     }
-    particles->SetBufferData(data);
+    particles->SetBufferData(data.data());
 }
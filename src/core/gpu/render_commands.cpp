@@ -0,0 +1,280 @@
+#include "core/gpu/render_commands.h"
+
+#include "core/frame_stats.h"
+#include "core/gpu/gpu_profiler.h"
+#include "core/gpu/mesh.h"
+#include "core/gpu/shader.h"
+#include "core/gpu/texture2D.h"
+
+
+RenderCommandList::RenderCommandList()
+{
+}
+
+
+RenderCommandList::~RenderCommandList()
+{
+}
+
+
+void RenderCommandList::Clear(const glm::vec4 &color, bool clearColor, bool clearDepth)
+{
+    AddCommand(CommandType::CLEAR);
+    commands.back().color = color;
+    commands.back().mask = (clearColor ? GL_COLOR_BUFFER_BIT : 0) | (clearDepth ? GL_DEPTH_BUFFER_BIT : 0);
+}
+
+
+void RenderCommandList::SetViewport(const glm::ivec4 &area)
+{
+    AddCommand(CommandType::VIEWPORT);
+    commands.back().area = area;
+}
+
+
+void RenderCommandList::SetScissor(bool enabled, const glm::ivec4 &area)
+{
+    AddCommand(CommandType::SCISSOR, enabled);
+    commands.back().area = area;
+}
+
+
+void RenderCommandList::SetDepthTest(bool enabled)
+{
+    AddCommand(CommandType::DEPTH_TEST, enabled);
+}
+
+
+void RenderCommandList::SetBlending(bool enabled)
+{
+    AddCommand(CommandType::BLENDING, enabled);
+}
+
+
+int RenderCommandList::AddSetup(Setup setup)
+{
+    setups.push_back(std::move(setup));
+    return static_cast<int>(setups.size() - 1);
+}
+
+
+void RenderCommandList::Draw(const DrawCommand &draw)
+{
+    AddCommand(CommandType::DRAW);
+    commands.back().index = static_cast<unsigned int>(draws.size());
+
+    draws.push_back(draw);
+    draws.back().firstUniform = static_cast<unsigned int>(uniforms.size());
+    draws.back().nrUniforms = 0;
+}
+
+
+void RenderCommandList::SetUniform(const std::string &name, int value)
+{
+    AddUniform(name, UniformType::INT).value.intValue = value;
+}
+
+
+void RenderCommandList::SetUniform(const std::string &name, float value)
+{
+    AddUniform(name, UniformType::FLOAT).value.floatValue = value;
+}
+
+
+void RenderCommandList::SetUniform(const std::string &name, const glm::vec2 &value)
+{
+    AddUniform(name, UniformType::VEC2).value.vec2Value = value;
+}
+
+
+void RenderCommandList::SetUniform(const std::string &name, const glm::vec3 &value)
+{
+    AddUniform(name, UniformType::VEC3).value.vec3Value = value;
+}
+
+
+void RenderCommandList::SetUniform(const std::string &name, const glm::vec4 &value)
+{
+    AddUniform(name, UniformType::VEC4).value.vec4Value = value;
+}
+
+
+void RenderCommandList::SetUniform(const std::string &name, const glm::mat3 &value)
+{
+    AddUniform(name, UniformType::MAT3).value.mat3Value = value;
+}
+
+
+void RenderCommandList::SetUniform(const std::string &name, const glm::mat4 &value)
+{
+    AddUniform(name, UniformType::MAT4).value.mat4Value = value;
+}
+
+
+void RenderCommandList::Run(Callback callback)
+{
+    AddCommand(CommandType::RUN);
+    commands.back().index = static_cast<unsigned int>(callbacks.size());
+    callbacks.push_back(std::move(callback));
+}
+
+
+void RenderCommandList::BeginGPURange(const std::string &name)
+{
+    if (GPUProfiler::IsEnabled())
+        Run([name]() { GPUProfiler::Begin(name); });
+}
+
+
+void RenderCommandList::EndGPURange()
+{
+    if (GPUProfiler::IsEnabled())
+        Run(GPUProfiler::End);
+}
+
+
+void RenderCommandList::Execute() const
+{
+    for (const auto &command : commands)
+    {
+        switch (command.type)
+        {
+        case CommandType::CLEAR:
+            glClearColor(command.color.r, command.color.g, command.color.b, command.color.a);
+            glClear(command.mask);
+            break;
+        case CommandType::VIEWPORT:
+            glViewport(command.area.x, command.area.y, command.area.z, command.area.w);
+            break;
+        case CommandType::SCISSOR:
+            if (command.enabled)
+            {
+                glEnable(GL_SCISSOR_TEST);
+                glScissor(command.area.x, command.area.y, command.area.z, command.area.w);
+            }
+            else
+            {
+                glDisable(GL_SCISSOR_TEST);
+            }
+            break;
+        case CommandType::DEPTH_TEST:
+            command.enabled ? glEnable(GL_DEPTH_TEST) : glDisable(GL_DEPTH_TEST);
+            break;
+        case CommandType::BLENDING:
+            if (command.enabled)
+            {
+                glEnable(GL_BLEND);
+                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            }
+            else
+            {
+                glDisable(GL_BLEND);
+            }
+            break;
+        case CommandType::DRAW:
+            ExecuteDraw(draws[command.index]);
+            continue;
+        case CommandType::RUN:
+            callbacks[command.index]();
+            continue;
+        }
+        FrameStats::Add(FrameStats::STATE_CHANGES);
+    }
+}
+
+
+void RenderCommandList::Reset()
+{
+    // clear() keeps the capacity
+    commands.clear();
+    draws.clear();
+    uniforms.clear();
+    setups.clear();
+    callbacks.clear();
+}
+
+
+bool RenderCommandList::IsEmpty() const
+{
+    return commands.empty();
+}
+
+
+unsigned int RenderCommandList::GetDrawCount() const
+{
+    return static_cast<unsigned int>(draws.size());
+}
+
+
+void RenderCommandList::AddCommand(CommandType type, bool enabled)
+{
+    commands.emplace_back();
+    commands.back().type = type;
+    commands.back().enabled = enabled;
+    commands.back().index = 0;
+    commands.back().mask = 0;
+}
+
+
+RenderCommandList::Uniform &RenderCommandList::AddUniform(const std::string &name, UniformType type)
+{
+    uniforms.emplace_back();
+    uniforms.back().name = name;
+    uniforms.back().type = type;
+
+    // Uniforms recorded before any draw are dropped during the replay
+    if (!draws.empty())
+        draws.back().nrUniforms++;
+    return uniforms.back();
+}
+
+
+void RenderCommandList::ExecuteDraw(const DrawCommand &draw) const
+{
+    Shader *shader = draw.shader;
+    if (!draw.mesh || !shader)
+        return;
+
+    if (draw.setup >= 0)
+        shader = setups[draw.setup](shader, draw);
+    if (!shader || !shader->program)
+        return;
+
+    if (draw.wireframe)
+    {
+        glLineWidth(1);
+        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    }
+    else
+    {
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    }
+
+    shader->Use();
+    if (draw.texture)
+        draw.texture->BindToTextureUnit(GL_TEXTURE0);
+
+    for (unsigned int i = draw.firstUniform; i < draw.firstUniform + draw.nrUniforms; i++)
+    {
+        const Uniform &uniform = uniforms[i];
+        const UniformValue &value = uniform.value;
+        GLint location = glGetUniformLocation(shader->program, uniform.name.c_str());
+        switch (uniform.type)
+        {
+        case UniformType::INT:      glUniform1i(location, value.intValue); break;
+        case UniformType::FLOAT:    glUniform1f(location, value.floatValue); break;
+        case UniformType::VEC2:     glUniform2fv(location, 1, glm::value_ptr(value.vec2Value)); break;
+        case UniformType::VEC3:     glUniform3fv(location, 1, glm::value_ptr(value.vec3Value)); break;
+        case UniformType::VEC4:     glUniform4fv(location, 1, glm::value_ptr(value.vec4Value)); break;
+        case UniformType::MAT3:     glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(value.mat3Value)); break;
+        case UniformType::MAT4:     glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value.mat4Value)); break;
+        }
+    }
+
+    glUniformMatrix4fv(shader->loc_model_matrix, 1, GL_FALSE, glm::value_ptr(draw.model));
+    glUniformMatrix4fv(shader->loc_view_matrix, 1, GL_FALSE, glm::value_ptr(draw.view));
+    glUniformMatrix4fv(shader->loc_projection_matrix, 1, GL_FALSE, glm::value_ptr(draw.projection));
+    FrameStats::Add(FrameStats::UNIFORM_UPLOADS, draw.nrUniforms + 3);
+
+    draw.mesh->Render(draw.lod);
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "utils/gl_utils.h"
+#include "utils/glm_utils.h"
+
+
+class Mesh;
+class Shader;
+class Texture2D;
+
+
+struct DrawCommand
+{
+    Mesh *mesh = nullptr;
+    Shader *shader = nullptr;
+    unsigned int lod = 0;
+
+    // Set through the Model, View and Projection uniforms of the shader
+    glm::mat4 model = glm::mat4(1);
+    glm::mat4 view = glm::mat4(1);
+    glm::mat4 projection = glm::mat4(1);
+
+    Texture2D *texture = nullptr;       // Bound to texture unit 0
+    bool wireframe = false;
+    int setup = -1;                     // See RenderCommandList::AddSetup
+
+    // Filled in by the command list
+    unsigned int firstUniform = 0;
+    unsigned int nrUniforms = 0;
+};
+
+
+// What a frame draws, recorded without touching OpenGL so that it can be done
+// on one thread and replayed on the one owning the context. The commands keep
+// pointers to the meshes, shaders and textures, which have to outlive the replay.
+//
+// Per frame: record, Execute, Reset. The lists are meant to be reused, so that
+// recording stops allocating after the first frames.
+class RenderCommandList
+{
+ public:
+    typedef std::function<void()> Callback;
+    // Picks the program to draw with (`shader` itself, or e.g. one of its variants),
+    // puts it in use and sets on it what the scene shares between draws
+    typedef std::function<Shader *(Shader *shader, const DrawCommand &draw)> Setup;
+
+    RenderCommandList();
+    ~RenderCommandList();
+
+    void Clear(const glm::vec4 &color, bool clearColor = true, bool clearDepth = true);
+    void SetViewport(const glm::ivec4 &area);
+    void SetScissor(bool enabled, const glm::ivec4 &area = glm::ivec4(0));
+    void SetDepthTest(bool enabled);
+    // Alpha blending, source alpha over one minus source alpha
+    void SetBlending(bool enabled);
+
+    // The index to put in DrawCommand::setup
+    int AddSetup(Setup setup);
+    void Draw(const DrawCommand &draw);
+    // The uniforms of the last draw, set after its setup
+    void SetUniform(const std::string &name, int value);
+    void SetUniform(const std::string &name, float value);
+    void SetUniform(const std::string &name, const glm::vec2 &value);
+    void SetUniform(const std::string &name, const glm::vec3 &value);
+    void SetUniform(const std::string &name, const glm::vec4 &value);
+    void SetUniform(const std::string &name, const glm::mat3 &value);
+    void SetUniform(const std::string &name, const glm::mat4 &value);
+
+    // For the work that cannot be described by the other commands,
+    // run during the replay like any other command
+    void Run(Callback callback);
+
+    // A range of the commands timed by GPUProfiler, when it is enabled
+    void BeginGPURange(const std::string &name);
+    void EndGPURange();
+
+    // Replays the commands, with the OpenGL context current
+    void Execute() const;
+    void Reset();
+
+    bool IsEmpty() const;
+    unsigned int GetDrawCount() const;
+
+ private:
+    enum class CommandType
+    {
+        CLEAR,
+        VIEWPORT,
+        SCISSOR,
+        DEPTH_TEST,
+        BLENDING,
+        DRAW,
+        RUN
+    };
+
+    struct Command
+    {
+        CommandType type;
+        bool enabled;
+        unsigned int index;         // Into draws or callbacks
+        GLbitfield mask;
+        glm::vec4 color;
+        glm::ivec4 area;
+    };
+
+    enum class UniformType
+    {
+        INT, FLOAT,
+        VEC2, VEC3, VEC4,
+        MAT3, MAT4
+    };
+
+    union UniformValue
+    {
+        int intValue;
+        float floatValue;
+        glm::vec2 vec2Value; glm::vec3 vec3Value; glm::vec4 vec4Value;
+        glm::mat3 mat3Value; glm::mat4 mat4Value;
+    };
+
+    struct Uniform
+    {
+        std::string name;
+        UniformType type;
+        UniformValue value;
+    };
+
+    void AddCommand(CommandType type, bool enabled = false);
+    Uniform &AddUniform(const std::string &name, UniformType type);
+    void ExecuteDraw(const DrawCommand &draw) const;
+
+ private:
+    std::vector<Command> commands;
+    std::vector<DrawCommand> draws;
+    std::vector<Uniform> uniforms;
+    std::vector<Setup> setups;
+    std::vector<Callback> callbacks;
+};
@@ -0,0 +1,184 @@
+#include "core/gpu/render_graph.h"
+
+#include <iostream>
+
+#include "core/gpu/gpu_profiler.h"
+
+
+RenderGraph::RenderGraph()
+{
+}
+
+
+RenderGraph::~RenderGraph()
+{
+    Reset();
+}
+
+
+RenderGraph::Resource RenderGraph::CreateTarget(const std::string &name, const RenderTargetDesc &desc)
+{
+    resources.push_back({ name, desc, nullptr, false, 0, -1, -1 });
+    return static_cast<Resource>(resources.size() - 1);
+}
+
+
+RenderGraph::Resource RenderGraph::ImportTarget(const std::string &name, FrameBuffer *target)
+{
+    RenderTargetDesc desc;
+    if (target)
+    {
+        desc.size = target->GetResolution();
+        desc.nrTextures = target->GetNumberOfRenderTargets();
+        desc.hasDepthTexture = target->GetDepthTexture() != nullptr;
+    }
+
+    resources.push_back({ name, desc, target, true, 0, -1, -1 });
+    return static_cast<Resource>(resources.size() - 1);
+}
+
+
+void RenderGraph::AddPass(const std::string &name, const std::vector<Resource> &inputs,
+                          const std::vector<Resource> &outputs, PassFunction execute)
+{
+    for (Resource resource : inputs)
+    {
+        if (!IsValid(resource))
+        {
+            std::cout << "RenderGraph: pass " << name << " reads an unknown target" << std::endl;
+            return;
+        }
+    }
+    for (Resource resource : outputs)
+    {
+        if (!IsValid(resource))
+        {
+            std::cout << "RenderGraph: pass " << name << " writes an unknown target" << std::endl;
+            return;
+        }
+    }
+
+    passes.push_back({ name, inputs, outputs, execute, 0, false });
+}
+
+
+FrameBuffer *RenderGraph::GetTarget(Resource resource) const
+{
+    return IsValid(resource) ? resources[resource].target : nullptr;
+}
+
+
+void RenderGraph::Execute()
+{
+    Compile();
+
+    for (int i = 0; i < (int)passes.size(); i++)
+    {
+        if (passes[i].culled)
+            continue;
+
+        for (auto &resource : resources)
+        {
+            if (!resource.imported && resource.firstPass == i)
+                resource.target = RenderTargetPool::Acquire(resource.desc);
+        }
+
+        GPUProfiler::Begin(passes[i].name);
+        passes[i].execute(*this);
+        GPUProfiler::End();
+
+        for (auto &resource : resources)
+        {
+            if (!resource.imported && resource.lastPass == i)
+            {
+                RenderTargetPool::Release(resource.target);
+                resource.target = nullptr;
+            }
+        }
+    }
+}
+
+
+void RenderGraph::Reset()
+{
+    resources.clear();
+    passes.clear();
+}
+
+
+void RenderGraph::Compile()
+{
+    for (auto &resource : resources)
+    {
+        resource.readers = 0;
+        resource.firstPass = -1;
+        resource.lastPass = -1;
+    }
+
+    for (auto &pass : passes)
+    {
+        pass.references = static_cast<int>(pass.outputs.size());
+        pass.culled = false;
+        for (Resource input : pass.inputs)
+            resources[input].readers++;
+    }
+
+    // Walks back from the transient targets nobody reads. A pass goes once all
+    // its outputs are unused, which never happens to passes writing imported
+    // targets, and its inputs may become unused in turn.
+    std::vector<Resource> unused;
+    for (int i = 0; i < (int)resources.size(); i++)
+    {
+        if (!resources[i].imported && resources[i].readers == 0)
+            unused.push_back(i);
+    }
+
+    while (!unused.empty())
+    {
+        Resource resource = unused.back();
+        unused.pop_back();
+
+        for (auto &pass : passes)
+        {
+            if (pass.culled)
+                continue;
+
+            for (Resource output : pass.outputs)
+            {
+                if (output != resource || --pass.references > 0)
+                    continue;
+
+                pass.culled = true;
+                for (Resource input : pass.inputs)
+                {
+                    if (--resources[input].readers == 0 && !resources[input].imported)
+                        unused.push_back(input);
+                }
+            }
+        }
+    }
+
+    // Lifetimes, in pass indices
+    for (int i = 0; i < (int)passes.size(); i++)
+    {
+        if (passes[i].culled)
+            continue;
+
+        auto use = [&](Resource resource) {
+            ResourceNode &node = resources[resource];
+            if (node.firstPass < 0)
+                node.firstPass = i;
+            node.lastPass = i;
+        };
+        for (Resource input : passes[i].inputs)
+            use(input);
+        for (Resource output : passes[i].outputs)
+            use(output);
+    }
+}
+
+
+bool RenderGraph::IsValid(Resource resource) const
+{
+    return resource >= 0 && resource < (Resource)resources.size();
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "core/gpu/render_target_pool.h"
+
+
+// The passes of a frame, with the targets they read and write. Passes whose
+// outputs nobody reads are culled, and every transient target is taken from
+// the RenderTargetPool right before its first pass and given back right after
+// its last one, so targets with disjoint lifetimes end up sharing memory.
+//
+// Per frame: declare the targets and the passes (in execution order), Execute, Reset.
+class RenderGraph
+{
+ public:
+    typedef int Resource;
+    typedef std::function<void(const RenderGraph &graph)> PassFunction;
+
+    RenderGraph();
+    ~RenderGraph();
+
+    // A target that only lives during this frame
+    Resource CreateTarget(const std::string &name, const RenderTargetDesc &desc);
+    // A target owned elsewhere, nullptr being the default framebuffer.
+    // The passes writing it are never culled.
+    Resource ImportTarget(const std::string &name, FrameBuffer *target);
+
+    // Passes without outputs are never culled
+    void AddPass(const std::string &name, const std::vector<Resource> &inputs,
+                 const std::vector<Resource> &outputs, PassFunction execute);
+
+    // Only valid while the passes using `resource` run
+    FrameBuffer *GetTarget(Resource resource) const;
+
+    void Execute();
+    void Reset();
+
+ private:
+    struct ResourceNode
+    {
+        std::string name;
+        RenderTargetDesc desc;
+        FrameBuffer *target;
+        bool imported;
+        int readers;
+        int firstPass;
+        int lastPass;
+    };
+
+    struct PassNode
+    {
+        std::string name;
+        std::vector<Resource> inputs;
+        std::vector<Resource> outputs;
+        PassFunction execute;
+        int references;
+        bool culled;
+    };
+
+    void Compile();
+    bool IsValid(Resource resource) const;
+
+ private:
+    std::vector<ResourceNode> resources;
+    std::vector<PassNode> passes;
+};
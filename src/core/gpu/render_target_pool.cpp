@@ -0,0 +1,81 @@
+#include "core/gpu/render_target_pool.h"
+
+#include <iostream>
+
+#include "utils/memory_utils.h"
+
+
+// Free targets are kept for this many frames before being deleted
+#define MAX_UNUSED_FRAMES   (3)
+
+
+std::vector<RenderTargetPool::Entry> RenderTargetPool::entries;
+unsigned long long RenderTargetPool::frame = 0;
+
+
+FrameBuffer *RenderTargetPool::Acquire(const RenderTargetDesc &desc)
+{
+    for (auto &entry : entries)
+    {
+        if (!entry.inUse && entry.desc == desc)
+        {
+            entry.inUse = true;
+            entry.lastUsedFrame = frame;
+            return entry.target;
+        }
+    }
+
+    FrameBuffer *target = new FrameBuffer();
+    target->Generate(desc.size.x, desc.size.y, desc.nrTextures, desc.hasDepthTexture, desc.precision);
+    entries.push_back({ target, desc, frame, true });
+    return target;
+}
+
+
+void RenderTargetPool::Release(FrameBuffer *target)
+{
+    for (auto &entry : entries)
+    {
+        if (entry.target == target)
+        {
+            entry.inUse = false;
+            entry.lastUsedFrame = frame;
+            return;
+        }
+    }
+
+    std::cout << "RenderTargetPool: releasing a framebuffer that is not from the pool" << std::endl;
+}
+
+
+void RenderTargetPool::EndFrame()
+{
+    for (auto it = entries.begin(); it != entries.end();)
+    {
+        if (!it->inUse && frame - it->lastUsedFrame >= MAX_UNUSED_FRAMES)
+        {
+            delete it->target;
+            it = entries.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    frame++;
+}
+
+
+void RenderTargetPool::Clear()
+{
+    for (auto &entry : entries)
+        delete entry.target;
+    entries.clear();
+}
+
+
+unsigned int RenderTargetPool::GetTargetCount()
+{
+    return static_cast<unsigned int>(entries.size());
+}
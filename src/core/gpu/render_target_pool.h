@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+
+#include "core/gpu/frame_buffer.h"
+#include "utils/glm_utils.h"
+
+
+struct RenderTargetDesc
+{
+    glm::ivec2 size = glm::ivec2(0);
+    int nrTextures = 1;
+    int precision = 32;             // Bits per channel: 8, 16 or 32
+    bool hasDepthTexture = true;
+
+    bool operator==(const RenderTargetDesc &other) const
+    {
+        return size == other.size && nrTextures == other.nrTextures &&
+            precision / 8 == other.precision / 8 && hasDepthTexture == other.hasDepthTexture;
+    }
+};
+
+
+// Framebuffers handed out for a while (a pass, a frame) and recycled afterwards,
+// so that passes with the same kind of targets share them instead of each one
+// owning its own. Targets unused for a few frames are freed, which is also how
+// the ones of a previous window size go away.
+class RenderTargetPool
+{
+ public:
+    // A free framebuffer matching `desc`, created if there is none
+    static FrameBuffer *Acquire(const RenderTargetDesc &desc);
+    static void Release(FrameBuffer *target);
+
+    // Called once per frame
+    static void EndFrame();
+    static void Clear();
+
+    static unsigned int GetTargetCount();
+
+ protected:
+    RenderTargetPool() = delete;
+    ~RenderTargetPool() = delete;
+
+ private:
+    struct Entry
+    {
+        FrameBuffer *target;
+        RenderTargetDesc desc;
+        unsigned long long lastUsedFrame;
+        bool inUse;
+    };
+
+    static std::vector<Entry> entries;
+    static unsigned long long frame;
+};
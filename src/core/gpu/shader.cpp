@@ -1,12 +1,26 @@
 #include "core/gpu/shader.h"
 
+#include <cstdio>
+#include <cstring>
 #include <fstream>
+#include <sstream>
 #include <iostream>
+#include <filesystem>
+
+#include "core/frame_stats.h"
+#include "core/managers/file_watcher.h"
+#include "utils/text_utils.h"
+
+
+std::string Shader::binaryCacheDirectory;
+std::list<Shader *> Shader::submittedShaders;
 
 
 Shader::Shader(const std::string &name)
 {
     program = 0;
+    pendingProgram = 0;
+    pendingFromCache = false;
     shaderName = name;
     shaderFiles.reserve(5);
 }
@@ -14,6 +28,10 @@ Shader::Shader(const std::string &name)
 
 Shader::~Shader()
 {
+    for (auto &variant : variants)
+        delete variant.second;
+    DiscardPending();
+    FileWatcher::Unwatch(this);
     glDeleteProgram(program);
 }
 
@@ -36,18 +54,19 @@ void Shader::Use() const
     {
         glUseProgram(program);
         CheckOpenGLError();
+        FrameStats::Add(FrameStats::STATE_CHANGES);
     }
 }
 
 
 unsigned int Shader::Reload()
 {
-    if (program) {
-        glDeleteProgram(program);
-        program = 0;
-    }
+    for (auto &variant : variants)
+        variant.second->Reload();
 
-    return CreateAndLink();
+    // The current program is replaced once the new one is linked, see FinishAll
+    Submit();
+    return program;
 }
 
 
@@ -72,6 +91,43 @@ void Shader::OnLoad(std::function<void()> onLoad)
 }
 
 
+void Shader::SetDefine(const std::string &name, const std::string &value)
+{
+    defines[name] = value;
+}
+
+
+const ShaderDefines &Shader::GetDefines() const
+{
+    return defines;
+}
+
+
+Shader *Shader::GetVariant(const ShaderDefines &variantDefines)
+{
+    // std::map keeps the defines sorted, so equal sets give equal keys
+    std::string key;
+    for (const auto &define : variantDefines)
+        key += define.first + "=" + define.second + ";";
+
+    auto it = variants.find(key);
+    if (it != variants.end())
+        return it->second;
+
+    Shader *variant = new Shader(shaderName + " [" + key + "]");
+    variant->shaderFiles = shaderFiles;
+    variant->shaderCodes = shaderCodes;
+    variant->defines = defines;
+    for (const auto &define : variantDefines)
+        variant->defines[define.first] = define.second;
+
+    // Variants that fail are kept too (without a program), so they are not compiled every frame
+    variant->CreateAndLink();
+    variants[key] = variant;
+    return variant;
+}
+
+
 void Shader::GetUniforms()
 {
     // MVP
@@ -129,45 +185,157 @@ void Shader::AddShaderCode(const std::string &shaderCode, GLenum shaderType)
 }
 
 
+void Shader::SetBinaryCacheDirectory(const std::string &directory)
+{
+    binaryCacheDirectory = directory;
+}
+
+
 unsigned int Shader::CreateAndLink()
 {
-    std::vector<unsigned int> shaders;
+    Submit();
+    Finish(true);
+    return program;
+}
+
 
-    // Compile shaders
+void Shader::Submit()
+{
+    // Gather the final sources, they are also the key of the cached binary
+    std::vector<ShaderFile> sources;
+    std::set<std::string> sourceFiles;
+    bool read = true;
     for (auto S : shaderFiles) {
-        auto shaderID = Shader::CreateShader(S.file, S.type);
-        if (shaderID) {
-            shaders.push_back(shaderID);
-        } else {
-            return 0;
-        }
+        std::set<std::string> included;
+        std::string code;
+        read = Shader::ReadShader(S.file, defines, included, code) && read;
+        sources.push_back({ code, S.type });
+        sourceFiles.insert(included.begin(), included.end());
+    }
+    for (auto S : shaderCodes) {
+        std::set<std::string> included;
+        std::string code;
+        read = Shader::Preprocess(S.file, "", defines, included, code) && read;
+        sources.push_back({ code, S.type });
+        sourceFiles.insert(included.begin(), included.end());
     }
 
-    for (auto S : shaderCodes)
-    {
-        auto shaderID = Shader::CompileShader(S.file, S.type);
-        if (shaderID) {
-            shaders.push_back(shaderID);
-        } else {
-            return 0;
-        }
+    // Recompile when any of the files changes, including the #included ones,
+    // and the missing ones, which an editor may have only just moved away
+    FileWatcher::Unwatch(this);
+    for (const auto &file : sourceFiles) {
+        if (!file.empty())
+            FileWatcher::Watch(file, this, [this]() { Submit(); });
     }
 
-    // Create Program and Link
-    if (shaders.size()) {
-        program = Shader::CreateProgram(shaders);
+    // A failed (re)load keeps the previous program, and whatever is being linked
+    if (!read) {
+        std::cout << "\tPROGRAM = " << shaderName << "\t ..... NOT READ, KEPT THE PREVIOUS ONE" << std::endl;
+        return;
+    }
 
-        if (program)
-        {
-            glUseProgram(program);
-            GetUniforms();
-            for (auto Observer : loadObservers) {
-                Observer();
+    DiscardPending();
+
+    if (sources.empty()) {
+        return;
+    }
+
+    pendingCacheKey = GetBinaryCacheKey(sources);
+    pendingProgram = LoadProgramBinary(pendingCacheKey);
+    pendingFromCache = pendingProgram != 0;
+
+    if (!pendingFromCache) {
+        // Only submit the work here, the status queries would wait for the driver
+        std::vector<unsigned int> shaders;
+        for (auto S : sources) {
+            auto shaderID = Shader::CompileShader(S.file, S.type);
+            if (shaderID) {
+                shaders.push_back(shaderID);
+                pendingObjects.push_back({ shaderID, S.type });
             }
-            return program;
         }
+        pendingProgram = Shader::CreateProgram(shaders);
+    }
+
+    submittedShaders.push_back(this);
+}
+
+
+bool Shader::Finish(bool wait)
+{
+    if (!IsPending())
+        return true;
+
+    if (!wait && GLEW_ARB_parallel_shader_compile) {
+        int completed = GL_FALSE;
+        glGetProgramiv(pendingProgram, GL_COMPLETION_STATUS_ARB, &completed);
+        if (completed == GL_FALSE)
+            return false;
+    }
+
+    bool compiled = true;
+    for (auto object : pendingObjects) {
+        compiled = Shader::CheckCompileStatus(object.id, object.type) && compiled;
+    }
+    bool linked = compiled && Shader::CheckLinkStatus(pendingProgram);
+
+    unsigned int newProgram = pendingProgram;
+    pendingProgram = 0;
+    DiscardPending();
+
+    // A failed (re)load keeps the previous program
+    if (!linked) {
+        glDeleteProgram(newProgram);
+        return true;
+    }
+
+    if (pendingFromCache) {
+        std::cout << "	PROGRAM = " << shaderName << "\t ..... LOADED FROM CACHE " << std::endl;
+    } else {
+        std::cout << "	PROGRAM = " << shaderName << "\t ..... LINKED " << std::endl;
+        SaveProgramBinary(newProgram, pendingCacheKey);
+    }
+
+    glDeleteProgram(program);
+    program = newProgram;
+
+    glUseProgram(program);
+    GetUniforms();
+    for (auto Observer : loadObservers) {
+        Observer();
+    }
+    return true;
+}
+
+
+bool Shader::IsPending() const
+{
+    return pendingProgram != 0;
+}
+
+
+void Shader::FinishAll(bool wait)
+{
+    // Finish removes the shaders from the list
+    std::list<Shader *> shaders = submittedShaders;
+    for (auto shader : shaders) {
+        shader->Finish(wait);
+    }
+}
+
+
+void Shader::DiscardPending()
+{
+    for (auto object : pendingObjects) {
+        glDeleteShader(object.id);
+    }
+    pendingObjects.clear();
+
+    if (pendingProgram) {
+        glDeleteProgram(pendingProgram);
+        pendingProgram = 0;
     }
-    return 0;
+    submittedShaders.remove(this);
 }
 
 
@@ -177,55 +345,125 @@ void Shader::ClearShaders()
 }
 
 
-static std::string InjectDefines(const std::string &shaderCode)
+bool Shader::ReadShader(const std::string &shaderFile, const ShaderDefines &defines,
+                        std::set<std::string> &included, std::string &code)
 {
-    std::string defines;
-    size_t pos = shaderCode.find_first_of("\n");
+    std::cout << "\tFILE = " << shaderFile << std::endl;
+
+    // Watched even if missing, see Submit
+    included.insert(std::filesystem::path(shaderFile).lexically_normal().string());
+
+    std::string content;
+    return ReadFile(shaderFile, content) && Preprocess(content, shaderFile, defines, included, code);
+}
+
+
+bool Shader::ReadFile(const std::string &file, std::string &content)
+{
+    std::ifstream stream(file.c_str(), std::ios::in);
+
+    if (!stream.good()) {
+        std::cout << "\tCould not open file: " << file << std::endl;
+        return false;
+    }
+
+    // Get file content
+    stream.seekg(0, std::ios::end);
+    content.resize((unsigned int)stream.tellg());
+    stream.seekg(0, std::ios::beg);
+    stream.read(&content[0], content.size());
+    stream.close();
+
+    return true;
+}
+
+
+bool Shader::Preprocess(const std::string &shaderCode, const std::string &shaderFile,
+                        const ShaderDefines &defines, std::set<std::string> &included, std::string &result)
+{
+    included.insert(std::filesystem::path(shaderFile).lexically_normal().string());
+    std::string code;
+    if (!ResolveIncludes(shaderCode, shaderFile, included, 0, code))
+        return false;
+
+    // The defines go right after the #version line
+    std::string header;
 
 #ifdef SOLVED
-    defines += "\n#define SOLVED";
+    header += "\n#define SOLVED";
 #endif
 
+    for (const auto &define : defines)
+        header += "\n#define " + define.first + " " + define.second;
+
+    size_t pos = code.find_first_of("\n");
     if (pos == std::string::npos)
     {
-        return shaderCode + defines;
+        result = code + header;
+        return true;
     }
 
-    return shaderCode.substr(0, pos) + defines + shaderCode.substr(pos, std::string::npos);
+    // Keep the line numbers of the compile errors
+    header += "\n#line 2 0";
+    result = code.substr(0, pos) + header + code.substr(pos, std::string::npos);
+    return true;
 }
 
 
-unsigned int Shader::CreateShader(const std::string &shaderFile, GLenum shaderType)
+bool Shader::ResolveIncludes(const std::string &shaderCode, const std::string &shaderFile,
+                             std::set<std::string> &included, int sourceIndex, std::string &result)
 {
-    std::string shader_code;
-    std::ifstream file(shaderFile.c_str(), std::ios::in);
+    std::filesystem::path directory = std::filesystem::path(shaderFile).parent_path();
+    std::istringstream input(shaderCode);
+    std::string line;
+    int lineNumber = 0;
 
-    if (!file.good()) {
-        std::cout << "\tCould not open file: " << shaderFile << std::endl;
-        std::terminate();
-    }
+    while (std::getline(input, line))
+    {
+        lineNumber++;
+        size_t start = line.find_first_not_of(" \t");
+        if (start == std::string::npos || line.compare(start, 8, "#include") != 0) {
+            result += line + "\n";
+            continue;
+        }
+
+        // #include "path", relative to the including file
+        size_t open = line.find('"', start + 8);
+        size_t close = (open == std::string::npos) ? open : line.find('"', open + 1);
+        if (close == std::string::npos) {
+            std::cout << "\tInvalid #include in " << shaderFile << ":" << lineNumber << std::endl;
+            return false;
+        }
 
-    std::cout << "\tFILE = " << shaderFile;
+        std::string includeFile = (directory / line.substr(open + 1, close - open - 1)).lexically_normal().string();
 
-    // Get file content
-    file.seekg(0, std::ios::end);
-    shader_code.resize((unsigned int)file.tellg());
-    file.seekg(0, std::ios::beg);
-    file.read(&shader_code[0], shader_code.size());
-    file.close();
+        // Every file is included once, which also breaks include cycles
+        if (!included.insert(includeFile).second) {
+            result += "\n";
+            continue;
+        }
+
+        // Each file gets its own source string number in the compile errors
+        int includeIndex = (int)included.size() - 1;
+        std::cout << "\tINCLUDE " << includeIndex << " = " << includeFile << std::endl;
+
+        std::string content, code;
+        if (!ReadFile(includeFile, content) || !ResolveIncludes(content, includeFile, included, includeIndex, code))
+            return false;
+
+        result += "#line 1 " + std::to_string(includeIndex) + "\n";
+        result += code;
+        result += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(sourceIndex) + "\n";
+    }
 
-    return CompileShader(InjectDefines(shader_code), shaderType);
+    return true;
 }
 
 
 unsigned int Shader::CompileShader(const std::string shaderCode, GLenum shaderType)
 {
-    int infoLogLength = 0;
-    int compileResult = 0;
-    unsigned int glShaderObject;
-
     // Create new shader object
-    glShaderObject = glCreateShader(shaderType);
+    unsigned int glShaderObject = glCreateShader(shaderType);
     if (glShaderObject == 0) {
         std::cout << "\t ..... ERROR " << std::endl;
         return 0;
@@ -236,6 +474,16 @@ unsigned int Shader::CompileShader(const std::string shaderCode, GLenum shaderTy
 
     glShaderSource(glShaderObject, 1, &shader_code_ptr, &shader_code_size);
     glCompileShader(glShaderObject);
+
+    return glShaderObject;
+}
+
+
+bool Shader::CheckCompileStatus(unsigned int glShaderObject, GLenum shaderType)
+{
+    int infoLogLength = 0;
+    int compileResult = 0;
+
     glGetShaderiv(glShaderObject, GL_COMPILE_STATUS, &compileResult);
 
     // LOG COMPILE ERRORS
@@ -253,7 +501,7 @@ unsigned int Shader::CompileShader(const std::string shaderCode, GLenum shaderTy
         if (shaderType == GL_COMPUTE_SHADER)             str_shader_type="COMPUTE";
 
         glGetShaderiv(glShaderObject, GL_INFO_LOG_LENGTH, &infoLogLength);
-        std::vector<char> shader_log(infoLogLength);
+        std::vector<char> shader_log(infoLogLength + 1);
         glGetShaderInfoLog(glShaderObject, infoLogLength, NULL, &shader_log[0]);
 
         std::cout << "\n-----------------------------------------------------\n";
@@ -261,46 +509,146 @@ unsigned int Shader::CompileShader(const std::string shaderCode, GLenum shaderTy
         std::cout << &shader_log[0] << "\n";
         std::cout << "-----------------------------------------------------" << std::endl;
 
-        return 0;
+        return false;
     }
 
-    std::cout << "\t ..... COMPILED " << std::endl;
-
-    return glShaderObject;
+    return true;
 }
 
 
 unsigned int Shader::CreateProgram(const std::vector<unsigned int> &shaderObjects)
 {
-    int infoLogLength = 0;
-    int linkResult = 0;
-
     // build OpenGL program object and link all the OpenGL shader objects
     unsigned int glProgramObject = glCreateProgram();
 
+    // Ask the driver to keep the binary around, for the cache
+    if (!binaryCacheDirectory.empty() && GLEW_ARB_get_program_binary)
+        glProgramParameteri(glProgramObject, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
     for (auto shader : shaderObjects)
         glAttachShader(glProgramObject, shader);
 
     glLinkProgram(glProgramObject);
+
+    return glProgramObject;
+}
+
+
+bool Shader::CheckLinkStatus(unsigned int glProgramObject)
+{
+    int infoLogLength = 0;
+    int linkResult = 0;
+
     glGetProgramiv(glProgramObject, GL_LINK_STATUS, &linkResult);
 
     // LOG LINK ERRORS
     if (linkResult == GL_FALSE) {
         glGetProgramiv(glProgramObject, GL_INFO_LOG_LENGTH, &infoLogLength);
-        std::vector<char> program_log(infoLogLength);
+        std::vector<char> program_log(infoLogLength + 1);
         glGetProgramInfoLog(glProgramObject, infoLogLength, NULL, &program_log[0]);
 
         std::cout << "Shader Loader : LINK ERROR" << std::endl;
         std::cout << &program_log[0] << std::endl;
+        return false;
+    }
 
-        return 0;
+    CheckOpenGLError();
+
+    return true;
+}
+
+
+std::string Shader::GetBinaryCacheKey(const std::vector<ShaderFile> &sources)
+{
+    if (binaryCacheDirectory.empty() || !GLEW_ARB_get_program_binary)
+        return "";
+
+    // FNV-1a over everything that changes the binary: the driver and the sources
+    unsigned long long hash = 14695981039346656037ull;
+    auto mix = [&hash](const void *data, size_t size)
+    {
+        const unsigned char *bytes = static_cast<const unsigned char *>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+    };
+
+    for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION }) {
+        const char *value = reinterpret_cast<const char *>(glGetString(name));
+        if (value)
+            mix(value, strlen(value) + 1);
     }
 
-    // Delete the shader objects because we do not need them any more
-    for (auto shader : shaderObjects)
-        glDeleteShader(shader);
+    for (const auto &source : sources) {
+        mix(&source.type, sizeof(source.type));
+        mix(source.file.data(), source.file.size() + 1);
+    }
 
-    CheckOpenGLError();
+    char key[17];
+    snprintf(key, sizeof(key), "%016llx", hash);
+    return key;
+}
+
+
+unsigned int Shader::LoadProgramBinary(const std::string &key)
+{
+    if (key.empty())
+        return 0;
+
+    std::string path = PATH_JOIN(binaryCacheDirectory, key + ".bin");
+    std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+    if (!file.good())
+        return 0;
+
+    // Layout: <GLenum format> <binary>
+    GLenum format = 0;
+    file.read(reinterpret_cast<char *>(&format), sizeof(format));
+    std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    file.close();
+
+    if (binary.empty())
+        return 0;
+
+    unsigned int glProgramObject = glCreateProgram();
+    glProgramBinary(glProgramObject, format, binary.data(), (GLsizei)binary.size());
+
+    // The driver rejects binaries of other versions, the program is compiled again then
+    int linkResult = 0;
+    glGetProgramiv(glProgramObject, GL_LINK_STATUS, &linkResult);
+    if (linkResult == GL_FALSE) {
+        glDeleteProgram(glProgramObject);
+        std::remove(path.c_str());
+        return 0;
+    }
 
     return glProgramObject;
 }
+
+
+void Shader::SaveProgramBinary(unsigned int program, const std::string &key)
+{
+    if (key.empty())
+        return;
+
+    int length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    GLenum format = 0;
+    std::vector<char> binary(length);
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+
+    std::error_code error;
+    std::filesystem::create_directories(binaryCacheDirectory, error);
+
+    std::string path = PATH_JOIN(binaryCacheDirectory, key + ".bin");
+    std::ofstream file(path.c_str(), std::ios::out | std::ios::binary);
+    if (!file.good())
+        return;
+
+    file.write(reinterpret_cast<const char *>(&format), sizeof(format));
+    file.write(binary.data(), length);
+    CheckOpenGLError();
+}
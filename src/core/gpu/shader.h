@@ -3,6 +3,8 @@
 #include <string>
 #include <vector>
 #include <list>
+#include <map>
+#include <set>
 #include <functional>
 
 #include "utils/gl_utils.h"
@@ -12,6 +14,10 @@
 #define INVALID_LOC            (-1)
 
 
+// Preprocessor symbols and their values, injected after the #version line
+typedef std::map<std::string, std::string> ShaderDefines;
+
+
 class Shader
 {
  public:
@@ -29,16 +35,58 @@ class Shader
     void ClearShaders();
     unsigned int CreateAndLink();
 
+    // Starts compiling and linking without waiting for the driver. Submit all the
+    // shaders first and finish them afterwards, so that the driver can compile them
+    // in parallel (ARB/KHR_parallel_shader_compile). Until then, the previous
+    // program (if any) stays in use.
+    void Submit();
+    // Completes a submitted link. Without `wait`, it returns false while the driver
+    // is still busy. Drivers without parallel compilation always wait here.
+    bool Finish(bool wait = true);
+    bool IsPending() const;
+    static void FinishAll(bool wait);
+
     void BindTexturesUnits();
     GLint GetUniformLocation(const char * uniformName) const;
 
     void OnLoad(std::function<void()> onLoad);
 
+    // Defines of this shader. They take effect on the next CreateAndLink.
+    void SetDefine(const std::string &name, const std::string &value = "1");
+    const ShaderDefines &GetDefines() const;
+
+    // A copy of this shader compiled with the extra `defines`. Variants are
+    // compiled on first use and owned by this shader, so a shader that is only
+    // used through its variants never has to be linked itself.
+    Shader *GetVariant(const ShaderDefines &defines);
+
+    // Linked programs are saved to (and loaded from) this directory with
+    // glGetProgramBinary. An empty directory disables the cache.
+    static void SetBinaryCacheDirectory(const std::string &directory);
+
  private:
+    struct ShaderFile;
+
     void GetUniforms();
-    static unsigned int CreateShader(const std::string &shaderFile, GLenum shaderType);
+    // These return false on a missing file or a bad #include, which Submit
+    // reports and skips, so that a failed (hot) reload keeps the program
+    static bool ReadShader(const std::string &shaderFile, const ShaderDefines &defines,
+                           std::set<std::string> &included, std::string &code);
+    static bool ReadFile(const std::string &file, std::string &content);
+    static bool Preprocess(const std::string &shaderCode, const std::string &shaderFile,
+                           const ShaderDefines &defines, std::set<std::string> &included, std::string &code);
+    static bool ResolveIncludes(const std::string &shaderCode, const std::string &shaderFile,
+                                std::set<std::string> &included, int sourceIndex, std::string &code);
     static unsigned int CompileShader(const std::string shaderCode, GLenum shaderType);
+    static bool CheckCompileStatus(unsigned int shaderObject, GLenum shaderType);
     static unsigned int CreateProgram(const std::vector<unsigned int> &shaderObjects);
+    static bool CheckLinkStatus(unsigned int programObject);
+    void DiscardPending();
+
+    // Program binary cache, keyed by the sources and the driver
+    static std::string GetBinaryCacheKey(const std::vector<ShaderFile> &sources);
+    static unsigned int LoadProgramBinary(const std::string &key);
+    static void SaveProgramBinary(unsigned int program, const std::string &key);
 
  public:
     GLuint program;
@@ -76,8 +124,25 @@ class Shader
         GLenum type;
     };
 
+    struct ShaderObject
+    {
+        unsigned int id;
+        GLenum type;
+    };
+
     std::string shaderName;
     std::vector<ShaderFile> shaderFiles;
     std::vector<ShaderFile> shaderCodes;
     std::list<std::function<void()>> loadObservers;
+    ShaderDefines defines;
+    std::map<std::string, Shader *> variants;
+
+    // The program being linked, see Submit
+    unsigned int pendingProgram;
+    std::vector<ShaderObject> pendingObjects;
+    std::string pendingCacheKey;
+    bool pendingFromCache;
+
+    static std::string binaryCacheDirectory;
+    static std::list<Shader *> submittedShaders;
 };
@@ -1,5 +1,13 @@
 #pragma once
 
+#include <vector>
+#include <memory>
+#include <future>
+#include <cstring>
+#include <iostream>
+
+#include "core/gpu/gpu_readback.h"
+#include "core/gpu/stream_buffer.h"
 #include "utils/gl_utils.h"
 #include "utils/memory_utils.h"
 
@@ -13,6 +21,7 @@ class SSBO
         this->size = size;
         memorySize = size * sizeof(StorageEntry);
         data = createLocalBuffer ? new StorageEntry[size] : nullptr;
+        stream = nullptr;
 
         #ifdef GLEW_ARB_shader_storage_buffer_object
         {
@@ -24,21 +33,64 @@ class SSBO
         #endif
     }
 
+    // Persistently mapped storage, split into `nrRegions` regions used in turn so
+    // that the CPU writes one while the GPU still reads the others. Every frame:
+    // Map (waits for the GPU to release the region), write, Unmap, bind and run
+    // the commands using the buffer, then Fence.
+    static SSBO *CreatePersistent(unsigned int size, unsigned int nrRegions = 3)
+    {
+        return new SSBO(size, new StreamBuffer(GL_SHADER_STORAGE_BUFFER, size * sizeof(StorageEntry), nrRegions));
+    }
+
     ~SSBO()
     {
-        glDeleteBuffers(1, &ssbo);
+        if (stream) {
+            SAFE_FREE(stream);
+        } else {
+            glDeleteBuffers(1, &ssbo);
+        }
         SAFE_FREE_ARRAY(data);
     };
 
-    void SetBufferData(const StorageEntry *data, GLenum usage = GL_DYNAMIC_DRAW)
+    StorageEntry *Map()
     {
+        return static_cast<StorageEntry *>(stream->Map());
+    }
+
+    void Unmap()
+    {
+        stream->Unmap(memorySize);
+    }
+
+    void Fence()
+    {
+        if (stream)
+            stream->Fence();
+    }
+
+    // The size of the storage is fixed, so the data is written in place
+    void SetBufferData(const StorageEntry *data)
+    {
+        if (stream)
+        {
+            memcpy(Map(), data, memorySize);
+            Unmap();
+            return;
+        }
+
         Bind();
-        glBufferData(GL_SHADER_STORAGE_BUFFER, memorySize, data, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, memorySize, data);
         Unbind();
     }
 
     void SetBufferSubData(const StorageEntry *data, int offset, int size)
     {
+        if (stream)
+        {
+            std::cout << "SSBO: persistent buffers are written through Map" << std::endl;
+            return;
+        }
+
         Bind();
         glBufferSubData(GL_SHADER_STORAGE_BUFFER, offset, size * sizeof(StorageEntry), data);
         Unbind();
@@ -46,9 +98,13 @@ class SSBO
 
     void BindBuffer(GLuint index) const
     {
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, index, ssbo);
+        if (stream)
+            glBindBufferRange(GL_SHADER_STORAGE_BUFFER, index, ssbo, stream->GetOffset(), memorySize);
+        else
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, index, ssbo);
     }
 
+    // Waits for the GPU, prefer ReadBufferAsync in the frame loop
     void ReadBuffer()
     {
         if (data == nullptr)
@@ -57,14 +113,32 @@ class SSBO
         }
 
         Bind();
-        GLvoid* p = glMapBuffer(GL_SHADER_STORAGE_BUFFER, GL_READ_ONLY);
-        memcpy(data, p, memorySize);
-        CheckOpenGLError();
-        glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, GetOffset(), memorySize, data);
         CheckOpenGLError();
         Unbind();
     }
 
+    // Copies the current contents on the GPU. The future is resolved by
+    // GPUReadback::Update once the copy is done, a few frames later, so
+    // it must not be waited on before that (or before GPUReadback::Finish).
+    std::future<std::vector<StorageEntry>> ReadBufferAsync() const
+    {
+        auto promise = std::make_shared<std::promise<std::vector<StorageEntry>>>();
+        unsigned int count = size;
+
+        GPUReadback::ReadBuffer(ssbo, GetOffset(), memorySize, [promise, count](const void *bytes, GLsizeiptr bytesSize) {
+            std::vector<StorageEntry> result;
+            if (bytes)
+            {
+                result.resize(count);
+                memcpy(result.data(), bytes, bytesSize);
+            }
+            promise->set_value(std::move(result));
+        });
+
+        return promise->get_future();
+    }
+
     const StorageEntry* GetBuffer() const
     {
         return data;
@@ -75,16 +149,30 @@ class SSBO
         return size;
     }
 
+    bool IsPersistent() const
+    {
+        return stream != nullptr;
+    }
+
     void ClearBuffer() const
     {
         Bind();
         unsigned int value = 0;
-        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED, GL_UNSIGNED_INT, &value);
+        glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GetOffset(), memorySize, GL_RED, GL_UNSIGNED_INT, &value);
         Unbind();
         CheckOpenGLError();
     }
 
  private:
+    SSBO(unsigned int size, StreamBuffer *stream)
+    {
+        this->size = size;
+        memorySize = size * sizeof(StorageEntry);
+        data = nullptr;
+        this->stream = stream;
+        ssbo = stream->GetBuffer();
+    }
+
     inline void Bind() const
     {
         glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
@@ -97,9 +185,16 @@ class SSBO
         CheckOpenGLError();
     }
 
+    // Start of the region in use
+    inline GLintptr GetOffset() const
+    {
+        return stream ? stream->GetOffset() : 0;
+    }
+
  private:
     unsigned int ssbo;
     unsigned int size;
     unsigned int memorySize;
     StorageEntry *data;
+    StreamBuffer *stream;
 };
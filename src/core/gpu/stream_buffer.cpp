@@ -0,0 +1,126 @@
+#include "core/gpu/stream_buffer.h"
+
+#include <iostream>
+
+
+// Regions start at multiples of this, the largest offset alignment
+// required for binding ranges of uniform and storage buffers
+#define REGION_ALIGNMENT    (256)
+
+// Fences are polled with this timeout (in nanoseconds) until they signal
+#define FENCE_TIMEOUT       (1000000)
+
+
+StreamBuffer::StreamBuffer(GLenum target, GLsizeiptr regionSize, unsigned int nrRegions)
+{
+    this->target = target;
+    this->regionSize = (regionSize + REGION_ALIGNMENT - 1) / REGION_ALIGNMENT * REGION_ALIGNMENT;
+    this->nrRegions = nrRegions ? nrRegions : 1;
+    region = this->nrRegions - 1;
+    mapped = nullptr;
+    fences.assign(this->nrRegions, nullptr);
+
+    GLsizeiptr totalSize = this->regionSize * this->nrRegions;
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(target, buffer);
+
+    if (GLEW_ARB_buffer_storage)
+    {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(target, totalSize, nullptr, flags);
+        mapped = static_cast<char *>(glMapBufferRange(target, 0, totalSize, flags));
+        if (mapped == nullptr)
+            std::cout << "StreamBuffer: persistent mapping failed, using glBufferSubData" << std::endl;
+    }
+
+    if (mapped == nullptr)
+    {
+        // An immutable store cannot be respecified, so start from a new buffer
+        if (GLEW_ARB_buffer_storage)
+        {
+            glDeleteBuffers(1, &buffer);
+            glGenBuffers(1, &buffer);
+            glBindBuffer(target, buffer);
+        }
+        glBufferData(target, totalSize, nullptr, GL_STREAM_DRAW);
+        staging.resize(this->regionSize);
+    }
+
+    glBindBuffer(target, 0);
+    CheckOpenGLError();
+}
+
+
+StreamBuffer::~StreamBuffer()
+{
+    for (auto fence : fences)
+    {
+        if (fence)
+            glDeleteSync(fence);
+    }
+
+    if (mapped)
+    {
+        glBindBuffer(target, buffer);
+        glUnmapBuffer(target);
+        glBindBuffer(target, 0);
+    }
+    glDeleteBuffers(1, &buffer);
+}
+
+
+void *StreamBuffer::Map()
+{
+    region = (region + 1) % nrRegions;
+    if (mapped == nullptr)
+        return staging.data();
+
+    WaitForRegion(region);
+    return mapped + GetOffset();
+}
+
+
+void StreamBuffer::Unmap(GLsizeiptr bytesWritten)
+{
+    // Coherent mappings are visible to the GPU without flushing
+    if (mapped || bytesWritten <= 0)
+        return;
+
+    glBindBuffer(target, buffer);
+    glBufferSubData(target, GetOffset(), bytesWritten < regionSize ? bytesWritten : regionSize, staging.data());
+    glBindBuffer(target, 0);
+}
+
+
+void StreamBuffer::Fence()
+{
+    // The driver already orders glBufferSubData after the pending draw calls
+    if (mapped == nullptr)
+        return;
+
+    if (fences[region])
+        glDeleteSync(fences[region]);
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+
+void StreamBuffer::WaitForRegion(unsigned int index)
+{
+    GLsync fence = fences[index];
+    if (fence == nullptr)
+        return;
+
+    // Only flush on the first try, the commands are submitted afterwards
+    GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    while (true)
+    {
+        GLenum status = glClientWaitSync(fence, flags, FENCE_TIMEOUT);
+        if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED || status == GL_WAIT_FAILED)
+            break;
+        flags = 0;
+    }
+
+    glDeleteSync(fence);
+    fences[index] = nullptr;
+}
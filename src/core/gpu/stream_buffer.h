@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+
+#include "utils/gl_utils.h"
+
+
+// A buffer written by the CPU every frame, split into regions used in turn, so
+// that the CPU fills one region while the GPU still reads the previous ones.
+// With ARB_buffer_storage the buffer is mapped once (persistent and coherent)
+// and every region is guarded by a fence; without it, the data is staged on
+// the CPU and uploaded with glBufferSubData.
+//
+// Per frame: Map, write at most GetRegionSize() bytes, Unmap, issue the draw
+// calls reading [GetOffset(), GetOffset() + bytes), then Fence.
+class StreamBuffer
+{
+ public:
+    StreamBuffer(GLenum target, GLsizeiptr regionSize, unsigned int nrRegions = 3);
+    ~StreamBuffer();
+
+    // Waits until the GPU is done with the next region, and returns it
+    void *Map();
+    void Unmap(GLsizeiptr bytesWritten);
+    // Marks the end of the commands reading the current region
+    void Fence();
+
+    GLuint GetBuffer() const { return buffer; }
+    GLenum GetTarget() const { return target; }
+    GLintptr GetOffset() const { return (GLintptr)region * regionSize; }
+    GLsizeiptr GetRegionSize() const { return regionSize; }
+    bool IsPersistent() const { return mapped != nullptr; }
+
+ private:
+    void WaitForRegion(unsigned int index);
+
+ private:
+    GLuint buffer;
+    GLenum target;
+    GLsizeiptr regionSize;
+    unsigned int nrRegions;
+    unsigned int region;
+
+    char *mapped;
+    std::vector<char> staging;
+    std::vector<GLsync> fences;
+};
@@ -1,6 +1,6 @@
 #include "core/gpu/texture2D.h"
 
-#include <thread>
+#include <vector>
 #include <iostream>
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -8,16 +8,13 @@
 #include "stb/stb_image.h"
 #include "stb/stb_image_write.h"
 
+#include "core/frame_stats.h"
+#include "core/gpu/frame_capture.h"
+#include "core/profiler.h"
+#include "core/managers/file_watcher.h"
 #include "utils/memory_utils.h"
 
 
-void write_image_thread(const char* fileName, unsigned int width, unsigned int height, unsigned int channels, const unsigned char *data)
-{
-    stbi_write_png(fileName, width, height, channels, data, width * channels);
-    delete data;
-}
-
-
 const GLint pixelFormat[5] = { 0, GL_RED, GL_RG, GL_RGB, GL_RGBA };
 const GLint internalFormat[][5] = {
     { 0, GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 },
@@ -43,6 +40,7 @@ Texture2D::Texture2D()
 
 
 Texture2D::~Texture2D() {
+    FileWatcher::Unwatch(this);
 }
 
 
@@ -63,6 +61,13 @@ void Texture2D::Init(GLuint gpuTextureID, unsigned int width, unsigned int heigh
 
 bool Texture2D::Load2D(const char *fileName, GLenum wrapping_mode)
 {
+    PROFILE_FUNCTION();
+
+    // Load again when the file changes. A failed load keeps the current image.
+    std::string file = fileName;
+    FileWatcher::Unwatch(this);
+    FileWatcher::Watch(file, this, [this, file, wrapping_mode]() { Load2D(file.c_str(), wrapping_mode); });
+
     int width, height, chn;
     imageData = stbi_load(fileName, &width, &height, &chn, 0);
 
@@ -103,9 +108,13 @@ void Texture2D::SaveToFile(const char *fileName)
         imageData = new unsigned char[width * height * channels];
     }
     glBindTexture(targetType, textureID);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
     glGetTexImage(targetType, 0, pixelFormat[channels], GL_UNSIGNED_BYTE, (void *)imageData);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
 
-    stbi_write_png(fileName, width, height, channels, imageData, width * channels);
+    // Encoded on a worker thread, from a copy
+    std::vector<unsigned char> pixels(imageData, imageData + width * height * channels);
+    FrameCapture::Encode(fileName, FrameCapture::Format::PNG, width, height, channels, std::move(pixels));
 }
 
 
@@ -209,6 +218,7 @@ void Texture2D::BindToTextureUnit(GLenum TextureUnit) const
     if (!textureID) return;
     glActiveTexture(TextureUnit);
     glBindTexture(GL_TEXTURE_2D, textureID);
+    FrameStats::Add(FrameStats::TEXTURE_BINDS);
 }
 
 
@@ -25,6 +25,7 @@ class Texture2D
     void CreateDepthBufferTexture(unsigned int width, unsigned int height);
 
     bool Load2D(const char* fileName, GLenum wrappingMode = GL_REPEAT);
+    // The PNG is written shortly after, by the FrameCapture workers
     void SaveToFile(const char* fileName);
     void CacheInMemory(bool state);
 
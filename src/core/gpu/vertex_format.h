@@ -1,5 +1,6 @@
 #pragma once
 
+#include "utils/gl_utils.h"
 #include "utils/glm_utils.h"
 
 
@@ -9,7 +10,7 @@ struct VertexFormat
         glm::vec3 color = glm::vec3(1),
         glm::vec3 normal = glm::vec3(0, 1, 0),
         glm::vec2 text_coord = glm::vec2(0))
-        : position(position), normal(normal), text_coord(text_coord), color(color) { }
+        : position(position), normal(normal), text_coord(text_coord), color(color), tangent(0) { }
 
     // Position of the vertex
     glm::vec3 position;
@@ -22,4 +23,29 @@ struct VertexFormat
 
     // Vertex color
     glm::vec3 color;
+
+    // A unit vector perpendicular to the normal. Left at 0, it is derived
+    // from the normal on upload, see gpu_utils::ComputeTangent.
+    glm::vec3 tangent;
+};
+
+
+// Compact version of VertexFormat (24 bytes instead of 56), for large meshes. Shaders
+// have to decode the position, the normal and the tangent, see gpu_utils::PackVertices.
+struct PackedVertexFormat
+{
+    // Position inside the bounding box of the mesh, as unorm16 (w is padding)
+    GLushort position[4];
+
+    // Octahedral encoding of the normal, as snorm16
+    GLshort normal[2];
+
+    // Texture coordinates as half floats
+    GLushort text_coord[2];
+
+    // Color as unorm8 (alpha is always 1)
+    GLubyte color[4];
+
+    // Octahedral encoding of the tangent, as snorm16
+    GLshort tangent[2];
 };
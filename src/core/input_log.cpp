@@ -0,0 +1,345 @@
+#include "core/input_log.h"
+
+#include <cstring>
+#include <iostream>
+
+
+#define INPUT_LOG_VERSION   (1)
+
+static const char magic[4] = { 'G', 'F', 'X', 'I' };
+
+
+// Little endian base 128: 7 bits per byte, the high bit set on all but the last.
+// The signed values are zigzag encoded first, so that small negative ones
+// (the mouse deltas) stay short too.
+static void WriteVarint(FILE *file, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        fputc(static_cast<int>((value & 0x7F) | 0x80), file);
+        value >>= 7;
+    }
+    fputc(static_cast<int>(value), file);
+}
+
+
+static bool ReadVarint(const std::vector<uint8_t> &data, size_t &offset, uint32_t &value)
+{
+    value = 0;
+    for (unsigned int shift = 0; shift < 35; shift += 7)
+    {
+        if (offset >= data.size())
+            return false;
+        uint8_t byte = data[offset++];
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+
+static uint32_t ZigZag(int32_t value)
+{
+    return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+
+static int32_t UnZigZag(uint32_t value)
+{
+    return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+}
+
+
+static bool ReadFile(const std::string &fileName, std::vector<uint8_t> &data)
+{
+    FILE *file = fopen(fileName.c_str(), "rb");
+    if (!file)
+        return false;
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    data.resize(size > 0 ? static_cast<size_t>(size) : 0);
+    bool read = fread(data.data(), 1, data.size(), file) == data.size();
+    fclose(file);
+    return read;
+}
+
+
+/*
+ *  InputLog
+ */
+
+bool InputLog::ReadHeader(const std::string &fileName, Header &header)
+{
+    std::vector<uint8_t> data;
+    size_t offset = 0;
+    return ReadFile(fileName, data) && ParseHeader(data, offset, header);
+}
+
+
+bool InputLog::Load(const std::string &fileName)
+{
+    std::vector<uint8_t> data;
+    if (!ReadFile(fileName, data))
+    {
+        std::cout << "InputLog: cannot read " << fileName << std::endl;
+        return false;
+    }
+
+    size_t offset = 0;
+    if (!ParseHeader(data, offset, header))
+    {
+        std::cout << "InputLog: " << fileName << " is not an input log of this version" << std::endl;
+        return false;
+    }
+
+    frames.clear();
+    events.clear();
+    while (offset < data.size())
+    {
+        // A frame cut short (the recording did not close) ends the log
+        Frame frame;
+        uint64_t bits = 0;
+        uint32_t nrEvents;
+        if (data.size() - offset < sizeof(bits))
+            break;
+        for (unsigned int i = 0; i < sizeof(bits); i++)
+            bits |= static_cast<uint64_t>(data[offset++]) << (8 * i);
+        memcpy(&frame.deltaTime, &bits, sizeof(bits));
+        if (!ReadVarint(data, offset, nrEvents))
+            break;
+
+        frame.firstEvent = static_cast<uint32_t>(events.size());
+        frame.nrEvents = nrEvents;
+        bool complete = true;
+        for (uint32_t i = 0; i < nrEvents && complete; i++)
+        {
+            Event event = {};
+            complete = offset < data.size() && data[offset] < NR_EVENT_TYPES;
+            if (!complete)
+                break;
+            event.type = static_cast<EventType>(data[offset++]);
+            for (unsigned int a = 0; a < GetArgumentCount(event.type) && complete; a++)
+            {
+                uint32_t value;
+                complete = ReadVarint(data, offset, value);
+                event.args[a] = UnZigZag(value);
+            }
+            if (complete)
+                events.push_back(event);
+        }
+        if (!complete)
+        {
+            events.resize(frame.firstEvent);
+            break;
+        }
+        frames.push_back(frame);
+    }
+
+    return true;
+}
+
+
+const InputLog::Header &InputLog::GetHeader() const
+{
+    return header;
+}
+
+
+size_t InputLog::GetFrameCount() const
+{
+    return frames.size();
+}
+
+
+const InputLog::Frame &InputLog::GetFrame(size_t index) const
+{
+    return frames[index];
+}
+
+
+const InputLog::Event &InputLog::GetEvent(size_t index) const
+{
+    return events[index];
+}
+
+
+unsigned int InputLog::GetArgumentCount(EventType type)
+{
+    switch (type)
+    {
+    case WINDOW_RESIZE:
+    case KEY_PRESS:
+    case KEY_RELEASE:
+    case INPUT_UPDATE:
+        return 2;
+    default:
+        return 4;
+    }
+}
+
+
+void InputLog::WriteHeader(FILE *file, const Header &header)
+{
+    fwrite(magic, 1, sizeof(magic), file);
+    WriteVarint(file, INPUT_LOG_VERSION);
+    WriteVarint(file, header.seed);
+    WriteVarint(file, ZigZag(header.resolution.x));
+    WriteVarint(file, ZigZag(header.resolution.y));
+}
+
+
+void InputLog::WriteFrame(FILE *file, double deltaTime, const std::vector<Event> &events)
+{
+    uint64_t bits;
+    memcpy(&bits, &deltaTime, sizeof(bits));
+    for (unsigned int i = 0; i < sizeof(bits); i++)
+        fputc(static_cast<int>((bits >> (8 * i)) & 0xFF), file);
+
+    WriteVarint(file, static_cast<uint32_t>(events.size()));
+    for (const Event &event : events)
+    {
+        fputc(event.type, file);
+        for (unsigned int a = 0; a < GetArgumentCount(event.type); a++)
+            WriteVarint(file, ZigZag(event.args[a]));
+    }
+}
+
+
+bool InputLog::ParseHeader(const std::vector<uint8_t> &data, size_t &offset, Header &header)
+{
+    if (data.size() < sizeof(magic) || memcmp(data.data(), magic, sizeof(magic)) != 0)
+        return false;
+    offset = sizeof(magic);
+
+    uint32_t version, width, height;
+    if (!ReadVarint(data, offset, version) || version != INPUT_LOG_VERSION)
+        return false;
+    if (!ReadVarint(data, offset, header.seed) || !ReadVarint(data, offset, width) ||
+        !ReadVarint(data, offset, height))
+        return false;
+
+    header.resolution = glm::ivec2(UnZigZag(width), UnZigZag(height));
+    return true;
+}
+
+
+/*
+ *  InputRecorder
+ */
+
+InputRecorder::InputRecorder()
+    : file(nullptr), nrFrames(0)
+{
+}
+
+
+InputRecorder::~InputRecorder()
+{
+    Close();
+    // The window keeps its observers otherwise
+    SetActive(false);
+}
+
+
+bool InputRecorder::Open(const std::string &fileName, const InputLog::Header &header)
+{
+    Close();
+    file = fopen(fileName.c_str(), "wb");
+    if (!file)
+    {
+        std::cout << "InputRecorder: cannot write " << fileName << std::endl;
+        return false;
+    }
+
+    InputLog::WriteHeader(file, header);
+    events.clear();
+    nrFrames = 0;
+    return true;
+}
+
+
+void InputRecorder::EndFrame(double deltaTime)
+{
+    if (!file)
+        return;
+
+    InputLog::WriteFrame(file, deltaTime, events);
+    events.clear();
+    nrFrames++;
+}
+
+
+void InputRecorder::Close()
+{
+    if (!file)
+        return;
+
+    fclose(file);
+    file = nullptr;
+}
+
+
+unsigned long long InputRecorder::GetFrameCount() const
+{
+    return nrFrames;
+}
+
+
+void InputRecorder::OnInputUpdate(float deltaTime, int mods)
+{
+    int32_t bits;
+    memcpy(&bits, &deltaTime, sizeof(bits));
+    Add(InputLog::INPUT_UPDATE, bits, mods);
+}
+
+
+void InputRecorder::OnKeyPress(int key, int mods)
+{
+    Add(InputLog::KEY_PRESS, key, mods);
+}
+
+
+void InputRecorder::OnKeyRelease(int key, int mods)
+{
+    Add(InputLog::KEY_RELEASE, key, mods);
+}
+
+
+void InputRecorder::OnMouseMove(int mouseX, int mouseY, int deltaX, int deltaY)
+{
+    Add(InputLog::MOUSE_MOVE, mouseX, mouseY, deltaX, deltaY);
+}
+
+
+void InputRecorder::OnMouseBtnPress(int mouseX, int mouseY, int button, int mods)
+{
+    Add(InputLog::MOUSE_BTN_PRESS, mouseX, mouseY, button, mods);
+}
+
+
+void InputRecorder::OnMouseBtnRelease(int mouseX, int mouseY, int button, int mods)
+{
+    Add(InputLog::MOUSE_BTN_RELEASE, mouseX, mouseY, button, mods);
+}
+
+
+void InputRecorder::OnMouseScroll(int mouseX, int mouseY, int offsetX, int offsetY)
+{
+    Add(InputLog::MOUSE_SCROLL, mouseX, mouseY, offsetX, offsetY);
+}
+
+
+void InputRecorder::OnWindowResize(int width, int height)
+{
+    Add(InputLog::WINDOW_RESIZE, width, height);
+}
+
+
+void InputRecorder::Add(InputLog::EventType type, int32_t a, int32_t b, int32_t c, int32_t d)
+{
+    if (file)
+        events.push_back({ type, { a, b, c, d } });
+}
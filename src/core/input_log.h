@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "core/window/input_controller.h"
+#include "utils/glm_utils.h"
+
+
+// The input of a World and the time each of its frames took, to play a session
+// again (see World::RecordInput and World::ReplayInput). Given the same seed for
+// its random numbers, a world that takes the same events in the same frames, and
+// steps by the same times, runs the same simulation.
+//
+// The file starts with a header (magic, version, seed, window resolution), then
+// has a record per frame: its delta time (the bits of the double), the number of
+// events, and the events, each a type byte followed by its arguments, as varints.
+class InputLog
+{
+ public:
+    enum EventType : uint8_t
+    {
+        WINDOW_RESIZE,
+        MOUSE_MOVE,
+        MOUSE_BTN_PRESS,
+        MOUSE_BTN_RELEASE,
+        MOUSE_SCROLL,
+        KEY_PRESS,
+        KEY_RELEASE,
+        // The delta time (the bits of the float) and the mods
+        INPUT_UPDATE,
+        NR_EVENT_TYPES
+    };
+
+    // The arguments of the InputController method of the same name
+    struct Event
+    {
+        EventType type;
+        int32_t args[4];
+    };
+
+    struct Header
+    {
+        uint32_t seed;
+        glm::ivec2 resolution;
+    };
+
+    struct Frame
+    {
+        double deltaTime;
+        // Into the events of the log
+        uint32_t firstEvent;
+        uint32_t nrEvents;
+    };
+
+    static bool ReadHeader(const std::string &fileName, Header &header);
+    bool Load(const std::string &fileName);
+
+    const Header &GetHeader() const;
+    size_t GetFrameCount() const;
+    const Frame &GetFrame(size_t index) const;
+    const Event &GetEvent(size_t index) const;
+
+    static unsigned int GetArgumentCount(EventType type);
+
+    // Of the file format
+    static void WriteHeader(FILE *file, const Header &header);
+    static void WriteFrame(FILE *file, double deltaTime, const std::vector<Event> &events);
+
+ private:
+    static bool ParseHeader(const std::vector<uint8_t> &data, size_t &offset, Header &header);
+
+ private:
+    Header header;
+    std::vector<Frame> frames;
+    std::vector<Event> events;
+};
+
+
+// Writes the events that the window sends to its observers into an InputLog,
+// one frame at a time
+class InputRecorder : public InputController
+{
+ public:
+    InputRecorder();
+    ~InputRecorder();
+
+    bool Open(const std::string &fileName, const InputLog::Header &header);
+    // The events received since the last frame, in the frame that took `deltaTime`
+    void EndFrame(double deltaTime);
+    void Close();
+
+    unsigned long long GetFrameCount() const;
+
+ protected:
+    void OnInputUpdate(float deltaTime, int mods) override;
+    void OnKeyPress(int key, int mods) override;
+    void OnKeyRelease(int key, int mods) override;
+    void OnMouseMove(int mouseX, int mouseY, int deltaX, int deltaY) override;
+    void OnMouseBtnPress(int mouseX, int mouseY, int button, int mods) override;
+    void OnMouseBtnRelease(int mouseX, int mouseY, int button, int mods) override;
+    void OnMouseScroll(int mouseX, int mouseY, int offsetX, int offsetY) override;
+    void OnWindowResize(int width, int height) override;
+
+ private:
+    void Add(InputLog::EventType type, int32_t a, int32_t b = 0, int32_t c = 0, int32_t d = 0);
+
+ private:
+    FILE *file;
+    std::vector<InputLog::Event> events;
+    unsigned long long nrFrames;
+};
@@ -0,0 +1,331 @@
+#include "core/job_system.h"
+
+#include <cstdlib>
+#include <string>
+#include <algorithm>
+
+#include "core/profiler.h"
+
+
+struct Job
+{
+    std::function<void()> function;
+    JobCounter *counter;
+};
+
+
+std::vector<std::thread> JobSystem::workers;
+std::vector<JobSystem::WorkQueue *> JobSystem::queues;
+thread_local JobSystem::WorkQueue *JobSystem::localQueue = nullptr;
+
+std::mutex JobSystem::sharedMutex;
+std::deque<Job *> JobSystem::sharedQueue;
+
+std::atomic<int> JobSystem::queuedJobs(0);
+std::atomic<int> JobSystem::sleepingWorkers(0);
+std::mutex JobSystem::sleepMutex;
+std::condition_variable JobSystem::wakeUp;
+std::atomic<bool> JobSystem::stopping(false);
+
+
+JobCounter::JobCounter()
+    : pending(0)
+{
+}
+
+
+JobCounter::~JobCounter()
+{
+    // The last job may still be releasing the mutex
+    std::lock_guard<std::mutex> lock(waitingMutex);
+}
+
+
+bool JobCounter::IsDone() const
+{
+    return pending.load(std::memory_order_acquire) == 0;
+}
+
+
+JobSystem::WorkQueue::WorkQueue()
+    : top(0), bottom(0)
+{
+    for (auto &job : jobs)
+        job.store(nullptr, std::memory_order_relaxed);
+}
+
+
+bool JobSystem::WorkQueue::Push(Job *job)
+{
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_acquire);
+    if (b - t >= CAPACITY)
+        return false;
+
+    jobs[b & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom.store(b + 1, std::memory_order_relaxed);
+    return true;
+}
+
+
+Job *JobSystem::WorkQueue::Pop()
+{
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+
+    if (t > b)
+    {
+        // Empty
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Job *job = jobs[b & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (t == b)
+    {
+        // The last job, which a thief may be taking too
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            job = nullptr;
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+
+Job *JobSystem::WorkQueue::Steal()
+{
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_acquire);
+    if (t >= b)
+        return nullptr;
+
+    Job *job = jobs[t & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        return nullptr;
+    return job;
+}
+
+
+void JobSystem::Init(unsigned int nrWorkers)
+{
+    if (!queues.empty())
+        return;
+
+    if (nrWorkers == 0)
+        nrWorkers = std::max(2u, std::thread::hardware_concurrency()) - 1;
+
+    stopping = false;
+    for (unsigned int i = 0; i <= nrWorkers; i++)
+        queues.push_back(new WorkQueue());
+    localQueue = queues.back();
+
+    for (unsigned int i = 0; i < nrWorkers; i++)
+        workers.emplace_back(WorkerThread, i);
+
+    // Calling exit() with the workers running would destroy the statics under them
+    static bool exitRegistered = false;
+    if (!exitRegistered)
+        std::atexit(Exit);
+    exitRegistered = true;
+}
+
+
+void JobSystem::Exit()
+{
+    if (queues.empty())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+    for (auto &worker : workers)
+        worker.join();
+    workers.clear();
+
+    // Whatever is left runs here
+    while (Job *job = FindJob())
+        Execute(job);
+
+    for (auto queue : queues)
+        delete queue;
+    queues.clear();
+    localQueue = nullptr;
+}
+
+
+void JobSystem::Run(std::function<void()> function, JobCounter *counter, JobCounter *after)
+{
+    if (counter)
+        counter->pending.fetch_add(1, std::memory_order_relaxed);
+
+    Job *job = new Job{ std::move(function), counter };
+
+    // Without workers, everything runs right away
+    if (queues.empty())
+    {
+        Execute(job);
+        return;
+    }
+
+    if (after)
+    {
+        std::lock_guard<std::mutex> lock(after->waitingMutex);
+        if (!after->IsDone())
+        {
+            after->waiting.push_back(job);
+            return;
+        }
+    }
+
+    Schedule(job);
+}
+
+
+void JobSystem::Wait(JobCounter &counter)
+{
+    while (!counter.IsDone())
+    {
+        if (Job *job = FindJob())
+            Execute(job);
+        else
+            std::this_thread::yield();
+    }
+}
+
+
+void JobSystem::ParallelFor(unsigned int count, unsigned int batchSize,
+                            const std::function<void(unsigned int begin, unsigned int end)> &function,
+                            unsigned int alignment)
+{
+    if (count == 0)
+        return;
+
+    alignment = std::max(alignment, 1u);
+    batchSize = std::max(batchSize, 1u);
+    batchSize = (batchSize + alignment - 1) / alignment * alignment;
+    if (batchSize >= count || queues.empty())
+    {
+        function(0, count);
+        return;
+    }
+
+    JobCounter counter;
+    for (unsigned int begin = batchSize; begin < count; begin += batchSize)
+    {
+        unsigned int end = std::min(begin + batchSize, count);
+        Run([&function, begin, end]() { function(begin, end); }, &counter);
+    }
+
+    // The first batch is done by the calling thread, which then helps with the others
+    function(0, batchSize);
+    Wait(counter);
+}
+
+
+unsigned int JobSystem::GetWorkerCount()
+{
+    return static_cast<unsigned int>(workers.size());
+}
+
+
+void JobSystem::Schedule(Job *job)
+{
+    if (!localQueue || !localQueue->Push(job))
+    {
+        std::lock_guard<std::mutex> lock(sharedMutex);
+        sharedQueue.push_back(job);
+    }
+
+    // Sleeping workers count themselves before checking queuedJobs, so either
+    // they see this job or it sees them
+    queuedJobs.fetch_add(1);
+    if (sleepingWorkers.load() > 0)
+    {
+        { std::lock_guard<std::mutex> lock(sleepMutex); }
+        wakeUp.notify_one();
+    }
+}
+
+
+Job *JobSystem::FindJob()
+{
+    Job *job = localQueue ? localQueue->Pop() : nullptr;
+
+    // Steals from the others, starting at a different queue on every thread
+    if (!job && !queues.empty())
+    {
+        static thread_local unsigned int victim = 0;
+        size_t nrQueues = queues.size();
+        for (size_t i = 0; i < nrQueues && !job; i++)
+        {
+            WorkQueue *queue = queues[victim++ % nrQueues];
+            if (queue != localQueue)
+                job = queue->Steal();
+        }
+    }
+
+    if (!job)
+    {
+        std::lock_guard<std::mutex> lock(sharedMutex);
+        if (!sharedQueue.empty())
+        {
+            job = sharedQueue.front();
+            sharedQueue.pop_front();
+        }
+    }
+
+    if (job)
+        queuedJobs.fetch_sub(1);
+    return job;
+}
+
+
+void JobSystem::Execute(Job *job)
+{
+    {
+        PROFILE_ZONE("Job");
+        job->function();
+    }
+
+    JobCounter *counter = job->counter;
+    delete job;
+    if (!counter)
+        return;
+
+    // Once the count reaches zero, the jobs waiting for it can start
+    std::vector<Job *> released;
+    {
+        std::lock_guard<std::mutex> lock(counter->waitingMutex);
+        if (counter->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            released.swap(counter->waiting);
+    }
+    for (Job *waiting : released)
+        Schedule(waiting);
+}
+
+
+void JobSystem::WorkerThread(unsigned int index)
+{
+    localQueue = queues[index];
+    PROFILE_THREAD("Job worker " + std::to_string(index));
+
+    while (!stopping)
+    {
+        if (Job *job = FindJob())
+        {
+            Execute(job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleepingWorkers.fetch_add(1);
+        wakeUp.wait(lock, []() { return stopping || queuedJobs.load() > 0; });
+        sleepingWorkers.fetch_sub(1);
+    }
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <deque>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <condition_variable>
+
+
+struct Job;
+
+
+// Counts the jobs started with it that have not finished yet. A counter can be
+// reused once Wait returned for it.
+class JobCounter
+{
+    friend class JobSystem;
+
+ public:
+    JobCounter();
+    ~JobCounter();
+
+    bool IsDone() const;
+
+ private:
+    std::atomic<int> pending;
+    // The jobs started after this counter, see JobSystem::Run
+    std::mutex waitingMutex;
+    std::vector<Job *> waiting;
+};
+
+
+// Runs short jobs on a worker per core. Each worker, and the main thread, has its
+// own deque of jobs (Chase-Lev: the owner pushes and pops at one end without locks,
+// the idle workers steal from the other end), so jobs started by a job stay on the
+// same core unless others run out of work. Jobs started from other threads go
+// through a shared queue.
+//
+// Waiting for a counter runs other jobs in the meantime, so jobs may wait for the
+// jobs they started. Jobs must not block on anything else.
+class JobSystem
+{
+ public:
+    // `nrWorkers` besides the main thread; 0 for one per remaining core
+    static void Init(unsigned int nrWorkers = 0);
+    static void Exit();
+
+    // Starts `job`, after the jobs of `after` (if any) finished. `counter`, if any,
+    // is increased until the job finishes.
+    static void Run(std::function<void()> job, JobCounter *counter = nullptr, JobCounter *after = nullptr);
+    // Runs jobs until those of `counter` are done
+    static void Wait(JobCounter &counter);
+
+    // Calls `function(begin, end)` over [0, count), in batches of about `batchSize`
+    // (a multiple of `alignment`) spread over the workers, and waits for them
+    static void ParallelFor(unsigned int count, unsigned int batchSize,
+                            const std::function<void(unsigned int begin, unsigned int end)> &function,
+                            unsigned int alignment = 1);
+
+    // The workers, not counting the main thread
+    static unsigned int GetWorkerCount();
+
+ protected:
+    JobSystem() = delete;
+    ~JobSystem() = delete;
+
+ private:
+    // Chase-Lev work-stealing deque, of a fixed capacity
+    class WorkQueue
+    {
+     public:
+        WorkQueue();
+
+        // Owner only. Returns false when full.
+        bool Push(Job *job);
+        Job *Pop();
+        // Any thread
+        Job *Steal();
+
+     private:
+        static const int64_t CAPACITY = 4096;
+
+        std::atomic<int64_t> top;
+        std::atomic<int64_t> bottom;
+        std::atomic<Job *> jobs[CAPACITY];
+    };
+
+    static void Schedule(Job *job);
+    static Job *FindJob();
+    static void Execute(Job *job);
+    static void WorkerThread(unsigned int index);
+
+ private:
+    static std::vector<std::thread> workers;
+    // One per worker, the main thread's last
+    static std::vector<WorkQueue *> queues;
+    // The one of the calling thread, if it has one
+    static thread_local WorkQueue *localQueue;
+
+    static std::mutex sharedMutex;
+    static std::deque<Job *> sharedQueue;
+
+    // Jobs queued but not taken yet, which workers sleep without
+    static std::atomic<int> queuedJobs;
+    static std::atomic<int> sleepingWorkers;
+    static std::mutex sleepMutex;
+    static std::condition_variable wakeUp;
+    static std::atomic<bool> stopping;
+};
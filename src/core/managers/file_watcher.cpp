@@ -0,0 +1,231 @@
+#include "core/managers/file_watcher.h"
+
+#include <iostream>
+#include <filesystem>
+
+#ifdef __linux__
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#else
+#include <chrono>
+#endif
+
+
+// How long the thread sleeps between checks, so that Exit does not hang
+#define WATCH_PERIOD_MS     (100)
+
+
+std::unordered_multimap<std::string, FileWatcher::Watcher> FileWatcher::watchers;
+std::mutex FileWatcher::watchersMutex;
+std::vector<std::string> FileWatcher::directories;
+std::thread FileWatcher::thread;
+std::atomic<bool> FileWatcher::running(false);
+std::mutex FileWatcher::changedMutex;
+std::unordered_set<std::string> FileWatcher::changedFiles;
+
+
+void FileWatcher::Init(const std::vector<std::string> &directories)
+{
+    Exit();
+
+    FileWatcher::directories.clear();
+    for (const auto &directory : directories)
+    {
+        std::error_code error;
+        if (std::filesystem::is_directory(directory, error))
+            FileWatcher::directories.push_back(Normalize(directory));
+    }
+
+    if (FileWatcher::directories.empty())
+        return;
+
+    running = true;
+    thread = std::thread(WatchThread);
+}
+
+
+void FileWatcher::Exit()
+{
+    running = false;
+    if (thread.joinable())
+        thread.join();
+}
+
+
+void FileWatcher::Watch(const std::string &file, const void *owner, std::function<void()> onChange)
+{
+    std::string path = Normalize(file);
+    std::lock_guard<std::mutex> lock(watchersMutex);
+    watchers.insert({ path, { owner, onChange } });
+}
+
+
+void FileWatcher::Unwatch(const void *owner)
+{
+    std::lock_guard<std::mutex> lock(watchersMutex);
+    for (auto it = watchers.begin(); it != watchers.end();)
+    {
+        if (it->second.owner == owner)
+            it = watchers.erase(it);
+        else
+            ++it;
+    }
+}
+
+
+void FileWatcher::Update()
+{
+    std::unordered_set<std::string> changed;
+    {
+        std::lock_guard<std::mutex> lock(changedMutex);
+        changed.swap(changedFiles);
+    }
+
+    if (changed.empty())
+        return;
+
+    // The callbacks are gathered first, as they usually watch their files again
+    std::vector<std::function<void()>> callbacks;
+    std::unordered_set<const void *> owners;
+    std::unique_lock<std::mutex> lock(watchersMutex);
+    for (const auto &file : changed)
+    {
+        auto range = watchers.equal_range(file);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (!owners.insert(it->second.owner).second)
+                continue;
+
+            std::cout << "Reloading " << file << std::endl;
+            callbacks.push_back(it->second.onChange);
+        }
+    }
+    lock.unlock();
+
+    for (auto &callback : callbacks)
+        callback();
+}
+
+
+void FileWatcher::OnFileChanged(const std::string &file)
+{
+    std::lock_guard<std::mutex> lock(changedMutex);
+    changedFiles.insert(Normalize(file));
+}
+
+
+std::string FileWatcher::Normalize(const std::string &file)
+{
+    std::error_code error;
+    std::filesystem::path path = std::filesystem::weakly_canonical(file, error);
+    if (error)
+        return std::filesystem::path(file).lexically_normal().string();
+    return path.string();
+}
+
+
+#ifdef __linux__
+
+void FileWatcher::WatchThread()
+{
+    int fd = inotify_init1(IN_NONBLOCK);
+    if (fd < 0)
+    {
+        std::cout << "FileWatcher: inotify is not available" << std::endl;
+        return;
+    }
+
+    const uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE;
+    std::unordered_map<int, std::string> watchedDirectories;    // watch descriptor -> directory
+
+    auto addDirectory = [&](const std::string &root)
+    {
+        std::error_code error;
+        int wd = inotify_add_watch(fd, root.c_str(), mask);
+        if (wd >= 0)
+            watchedDirectories[wd] = root;
+
+        for (std::filesystem::recursive_directory_iterator it(root, error), end; !error && it != end; it.increment(error))
+        {
+            if (!it->is_directory(error))
+                continue;
+            wd = inotify_add_watch(fd, it->path().string().c_str(), mask);
+            if (wd >= 0)
+                watchedDirectories[wd] = it->path().string();
+        }
+    };
+
+    for (const auto &directory : directories)
+        addDirectory(directory);
+
+    alignas(struct inotify_event) char buffer[4096];
+    while (running)
+    {
+        pollfd descriptor = { fd, POLLIN, 0 };
+        if (poll(&descriptor, 1, WATCH_PERIOD_MS) <= 0)
+            continue;
+
+        ssize_t length;
+        while ((length = read(fd, buffer, sizeof(buffer))) > 0)
+        {
+            for (char *ptr = buffer; ptr < buffer + length;)
+            {
+                const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(ptr);
+                ptr += sizeof(struct inotify_event) + event->len;
+
+                auto it = watchedDirectories.find(event->wd);
+                if (it == watchedDirectories.end() || event->len == 0)
+                    continue;
+
+                std::string path = (std::filesystem::path(it->second) / event->name).string();
+                if (event->mask & IN_ISDIR)
+                {
+                    // New directories are watched as well
+                    if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                        addDirectory(path);
+                }
+                else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+                {
+                    // Files being created are reported once they are closed
+                    OnFileChanged(path);
+                }
+            }
+        }
+    }
+
+    close(fd);
+}
+
+#else
+
+void FileWatcher::WatchThread()
+{
+    // No change notifications, compare the modification times instead
+    std::unordered_map<std::string, std::filesystem::file_time_type> writeTimes;
+
+    bool firstPass = true;
+    while (running)
+    {
+        for (const auto &directory : directories)
+        {
+            std::error_code error;
+            for (std::filesystem::recursive_directory_iterator it(directory, error), end; !error && it != end; it.increment(error))
+            {
+                if (!it->is_regular_file(error))
+                    continue;
+
+                auto writeTime = it->last_write_time(error);
+                auto &known = writeTimes[it->path().string()];
+                if (!firstPass && known != writeTime)
+                    OnFileChanged(it->path().string());
+                known = writeTime;
+            }
+        }
+        firstPass = false;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(WATCH_PERIOD_MS));
+    }
+}
+
+#endif
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+
+
+// Watches directories (recursively) for modified files, on a background thread:
+// inotify on Linux, modification times elsewhere. The callbacks are run by Update
+// on the main thread, so they can safely recreate OpenGL objects. Watch and Unwatch
+// can be called from any thread (shader variants are linked on the render thread).
+class FileWatcher
+{
+ public:
+    static void Init(const std::vector<std::string> &directories);
+    static void Exit();
+
+    // `onChange` is called when `file` is modified. All the callbacks of `owner`
+    // are removed by Unwatch, and an owner is called at most once per Update.
+    static void Watch(const std::string &file, const void *owner, std::function<void()> onChange);
+    static void Unwatch(const void *owner);
+
+    // Runs the callbacks of the files changed since the last call
+    static void Update();
+
+ protected:
+    FileWatcher() = delete;
+    ~FileWatcher() = delete;
+
+ private:
+    struct Watcher
+    {
+        const void *owner;
+        std::function<void()> onChange;
+    };
+
+    static void WatchThread();
+    static void OnFileChanged(const std::string &file);
+    static std::string Normalize(const std::string &file);
+
+ private:
+    static std::unordered_multimap<std::string, Watcher> watchers;
+    static std::mutex watchersMutex;
+    static std::vector<std::string> directories;
+
+    static std::thread thread;
+    static std::atomic<bool> running;
+    static std::mutex changedMutex;
+    static std::unordered_set<std::string> changedFiles;
+};
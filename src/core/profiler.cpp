@@ -0,0 +1,209 @@
+#include "core/profiler.h"
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+
+std::atomic<bool> Profiler::recording(false);
+unsigned long long Profiler::frameIndex = 0;
+int64_t Profiler::frameBegin = 0;
+std::string Profiler::fileName;
+unsigned long long Profiler::lastFrame = 0;
+int64_t Profiler::captureBegin = 0;
+std::mutex Profiler::buffersMutex;
+std::vector<std::unique_ptr<Profiler::ThreadBuffer>> Profiler::buffers;
+thread_local Profiler::ThreadBuffer *Profiler::localBuffer = nullptr;
+unsigned int Profiler::requestedFrames = 0;
+
+
+static void WriteEscaped(FILE *file, const std::string &text)
+{
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+            fputc('\\', file);
+        fputc(c, file);
+    }
+}
+
+
+void Profiler::Capture(const std::string &fileName, unsigned int nrFrames)
+{
+#ifdef USE_PROFILER
+    if (IsCapturing())
+    {
+        std::cout << "Profiler: a capture is already in progress" << std::endl;
+        return;
+    }
+    if (nrFrames == 0)
+        return;
+
+    Profiler::fileName = fileName;
+    requestedFrames = nrFrames;
+#else
+    std::cout << "Profiler: compiled without USE_PROFILER, nothing to capture" << std::endl;
+#endif
+}
+
+
+bool Profiler::IsCapturing()
+{
+    return IsRecording() || requestedFrames > 0;
+}
+
+
+void Profiler::NextFrame()
+{
+    int64_t now = Now();
+    if (IsRecording())
+        Record("Frame", frameBegin, now);
+
+    frameIndex++;
+    frameBegin = now;
+
+    if (IsRecording() && frameIndex > lastFrame)
+    {
+        recording.store(false, std::memory_order_relaxed);
+        Write();
+    }
+
+    if (requestedFrames > 0)
+    {
+        captureBegin = now;
+        lastFrame = frameIndex + requestedFrames - 1;
+        requestedFrames = 0;
+        recording.store(true, std::memory_order_relaxed);
+    }
+}
+
+
+unsigned long long Profiler::GetFrameIndex()
+{
+    return frameIndex;
+}
+
+
+void Profiler::SetThreadName(const std::string &name)
+{
+    ThreadBuffer *buffer = GetThreadBuffer();
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    buffer->name = name;
+}
+
+
+void Profiler::Exit()
+{
+    requestedFrames = 0;
+    if (!IsRecording())
+        return;
+
+    recording.store(false, std::memory_order_relaxed);
+    Write();
+}
+
+
+int64_t Profiler::Now()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+
+void Profiler::Record(const char *name, int64_t begin, int64_t end)
+{
+    Push(GetThreadBuffer(), name, begin, end);
+}
+
+
+void Profiler::RecordTrack(const std::string &track, const char *name, int64_t begin, int64_t end)
+{
+    ThreadBuffer *buffer = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        for (const auto &candidate : buffers)
+        {
+            if (candidate->track && candidate->name == track)
+                buffer = candidate.get();
+        }
+    }
+    if (!buffer)
+    {
+        buffer = AddBuffer(track);
+        buffer->track = true;
+    }
+
+    Push(buffer, name, begin, end);
+}
+
+
+void Profiler::Push(ThreadBuffer *buffer, const char *name, int64_t begin, int64_t end)
+{
+    uint64_t head = buffer->head.load(std::memory_order_relaxed);
+    buffer->zones[head % ThreadBuffer::CAPACITY] = { name, begin, end };
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+
+Profiler::ThreadBuffer *Profiler::GetThreadBuffer()
+{
+    if (!localBuffer)
+        localBuffer = AddBuffer("");
+    return localBuffer;
+}
+
+
+Profiler::ThreadBuffer *Profiler::AddBuffer(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    buffers.emplace_back(new ThreadBuffer());
+    ThreadBuffer *buffer = buffers.back().get();
+    buffer->id = static_cast<unsigned int>(buffers.size() - 1);
+    buffer->name = name.empty() ? "Thread " + std::to_string(buffer->id) : name;
+    buffer->track = false;
+    buffer->head.store(0, std::memory_order_relaxed);
+    return buffer;
+}
+
+
+void Profiler::Write()
+{
+    FILE *file = fopen(fileName.c_str(), "w");
+    if (!file)
+    {
+        std::cout << "Profiler: cannot write " << fileName << std::endl;
+        return;
+    }
+
+    // Zones still open at the end of the capture are left out
+    int64_t captureEnd = Now();
+    size_t nrZones = 0;
+
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"gfxc\"}}");
+    for (const auto &buffer : buffers)
+    {
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"", buffer->id);
+        WriteEscaped(file, buffer->name);
+        fprintf(file, "\"}}");
+
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        uint64_t first = (head > ThreadBuffer::CAPACITY) ? head - ThreadBuffer::CAPACITY : 0;
+        for (uint64_t i = first; i < head; i++)
+        {
+            Zone zone = buffer->zones[i % ThreadBuffer::CAPACITY];
+            if (zone.begin < captureBegin || zone.end > captureEnd)
+                continue;
+
+            // Microseconds, from the start of the capture
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                    zone.name, buffer->id, (zone.begin - captureBegin) / 1000.0, (zone.end - zone.begin) / 1000.0);
+            nrZones++;
+        }
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    std::cout << "Profiler: " << nrZones << " zones written to " << fileName << std::endl;
+}
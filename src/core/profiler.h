@@ -0,0 +1,145 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+
+// Scoped CPU zones, for instance:
+//
+//     void World::LoopUpdate()
+//     {
+//         PROFILE_FUNCTION();
+//         ...
+//         {
+//             PROFILE_ZONE("Swap");
+//             window->SwapBuffers();
+//         }
+//
+// The zones are only compiled in with USE_PROFILER (defined in debug builds,
+// and in the others with the CMake option of the same name). Without it the
+// macros expand to nothing, and Capture only reports that.
+#define PROFILE_CONCAT_INNER(a, b)  a##b
+#define PROFILE_CONCAT(a, b)        PROFILE_CONCAT_INNER(a, b)
+
+#ifdef USE_PROFILER
+#   define PROFILE_ZONE(name)       ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#   define PROFILE_FUNCTION()       PROFILE_ZONE(__func__)
+#   define PROFILE_FRAME()          Profiler::NextFrame()
+#   define PROFILE_THREAD(name)     Profiler::SetThreadName(name)
+#else
+#   define PROFILE_ZONE(name)
+#   define PROFILE_FUNCTION()
+#   define PROFILE_FRAME()
+#   define PROFILE_THREAD(name)
+#endif
+
+
+// Records the zones of a range of frames, each thread into its own ring buffer
+// (written without locks, by that thread only), and writes them as Chrome trace
+// events, to be opened in Perfetto (ui.perfetto.dev) or chrome://tracing.
+// Outside of a capture, a zone costs one relaxed load.
+class Profiler
+{
+ public:
+    // Records the next `nrFrames` frames into `fileName`, written after the last one
+    static void Capture(const std::string &fileName, unsigned int nrFrames = 60);
+    static bool IsCapturing();
+
+    // Called at the start of every frame, by World
+    static void NextFrame();
+    static unsigned long long GetFrameIndex();
+
+    // How the calling thread shows up in the traces
+    static void SetThreadName(const std::string &name);
+
+    // Writes the capture in progress, if any
+    static void Exit();
+
+    // Nanoseconds, on a steady clock
+    static int64_t Now();
+    static void Record(const char *name, int64_t begin, int64_t end);
+    // For zones not measured on the CPU (see GPUProfiler), shown as a thread named
+    // `track`. A track must only be written by one thread at a time.
+    static void RecordTrack(const std::string &track, const char *name, int64_t begin, int64_t end);
+
+    static bool IsRecording()
+    {
+        return recording.load(std::memory_order_relaxed);
+    }
+
+ protected:
+    Profiler() = delete;
+    ~Profiler() = delete;
+
+ private:
+    struct Zone
+    {
+        const char *name;
+        int64_t begin;
+        int64_t end;
+    };
+
+    struct ThreadBuffer
+    {
+        // Zones past the last CAPACITY of a capture are dropped, oldest first
+        static const uint64_t CAPACITY = 1 << 15;
+
+        unsigned int id;
+        std::string name;
+        // Not owned by a thread, see RecordTrack
+        bool track;
+        // Only the owner writes, the zones under `head` are complete
+        std::atomic<uint64_t> head;
+        Zone zones[CAPACITY];
+    };
+
+    static ThreadBuffer *GetThreadBuffer();
+    static ThreadBuffer *AddBuffer(const std::string &name);
+    static void Push(ThreadBuffer *buffer, const char *name, int64_t begin, int64_t end);
+    static void Write();
+
+ private:
+    static std::atomic<bool> recording;
+    static unsigned long long frameIndex;
+    static int64_t frameBegin;
+
+    // Capture in progress, or requested and starting with the next frame
+    static std::string fileName;
+    static unsigned int requestedFrames;
+    static unsigned long long lastFrame;
+    static int64_t captureBegin;
+
+    // Every thread that recorded something; the buffers outlive their threads
+    static std::mutex buffersMutex;
+    static std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    static thread_local ThreadBuffer *localBuffer;
+};
+
+
+// Records the time between its construction and its destruction, when started
+// during a capture. Meant to be used through PROFILE_ZONE.
+class ProfileZone
+{
+ public:
+    explicit ProfileZone(const char *name)
+        : name(name), begin(Profiler::IsRecording() ? Profiler::Now() : -1)
+    {
+    }
+
+    ~ProfileZone()
+    {
+        if (begin >= 0)
+            Profiler::Record(name, begin, Profiler::Now());
+    }
+
+    ProfileZone(const ProfileZone &) = delete;
+    ProfileZone &operator=(const ProfileZone &) = delete;
+
+ private:
+    const char *name;
+    int64_t begin;
+};
@@ -0,0 +1,92 @@
+#include "core/render_thread.h"
+
+#include "core/profiler.h"
+
+
+RenderThread::RenderThread(WindowObject *window)
+{
+    this->window = window;
+    pending = nullptr;
+    busy = false;
+    stopping = false;
+    swapPending = false;
+
+    thread = std::thread(&RenderThread::ThreadLoop, this);
+}
+
+
+RenderThread::~RenderThread()
+{
+    Stop();
+}
+
+
+void RenderThread::Submit(const RenderCommandList *commands)
+{
+    window->ReleaseContext();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this]() { return !busy; });
+    pending = commands;
+    busy = true;
+    changed.notify_all();
+}
+
+
+void RenderThread::Wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this]() { return !busy; });
+}
+
+
+void RenderThread::Stop()
+{
+    if (!thread.joinable())
+        return;
+
+    window->ReleaseContext();
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this]() { return !busy; });
+        stopping = true;
+        changed.notify_all();
+    }
+    thread.join();
+}
+
+
+void RenderThread::ThreadLoop()
+{
+    PROFILE_THREAD("Render thread");
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        changed.wait(lock, [this]() { return busy || stopping; });
+        const RenderCommandList *commands = pending;
+        lock.unlock();
+
+        window->MakeCurrentContext();
+        if (swapPending)
+        {
+            PROFILE_ZONE("SwapBuffers");
+            window->SwapBuffers();
+        }
+        if (commands)
+        {
+            PROFILE_ZONE("Execute commands");
+            commands->Execute();
+        }
+        swapPending = commands != nullptr;
+        window->ReleaseContext();
+
+        lock.lock();
+        if (!commands)
+            return;
+
+        pending = nullptr;
+        busy = false;
+        changed.notify_all();
+    }
+}
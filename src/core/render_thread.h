@@ -0,0 +1,47 @@
+#pragma once
+
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#include "core/gpu/render_commands.h"
+#include "core/window/window_object.h"
+
+
+// Replays the recorded frames on a thread of its own, so that the main thread
+// can simulate and record the next frame in the meantime. The OpenGL context is
+// current on this thread only while it replays, and there is at most one frame
+// in flight.
+//
+// A frame is swapped to the screen right before the next one is replayed (or on
+// Stop), so between Wait and the next Submit its back buffer can still be read.
+class RenderThread
+{
+ public:
+    explicit RenderThread(WindowObject *window);
+    ~RenderThread();
+
+    // Releases the context, if current on the calling thread, and replays
+    // `commands`, which must not change until Wait returns
+    void Submit(const RenderCommandList *commands);
+    // Until the last frame submitted is replayed. The context is then
+    // current on no thread.
+    void Wait();
+    // Swaps the last frame and ends the thread
+    void Stop();
+
+ private:
+    void ThreadLoop();
+
+ private:
+    WindowObject *window;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable changed;
+
+    const RenderCommandList *pending;
+    bool busy;
+    bool stopping;
+    // Only used by the thread
+    bool swapPending;
+};
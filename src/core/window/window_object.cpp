@@ -398,6 +398,14 @@ void WindowObject::MakeCurrentContext() const
 }
 
 
+void WindowObject::ReleaseContext() const
+{
+    // Only the thread the context is current on can release it
+    if (glfwGetCurrentContext() == window->handle)
+        glfwMakeContextCurrent(nullptr);
+}
+
+
 void WindowObject::SetSize(int width, int height)
 {
     int frameBufferWidth, frameBufferHeight;
@@ -69,6 +69,8 @@ class WindowObject
     bool ToggleVSync();
 
     void MakeCurrentContext() const;
+    // Lets another thread make the context current
+    void ReleaseContext() const;
 
     // Window Information
     void SetSize(int width, int height);
@@ -1,7 +1,26 @@
 #include "core/world.h"
 
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <utility>
+#include <iostream>
+
 #include "core/engine.h"
+#include "core/frame_stats.h"
+#include "core/input_log.h"
+#include "core/profiler.h"
+#include "core/render_thread.h"
+#include "core/gpu/frame_capture.h"
+#include "core/gpu/gpu_profiler.h"
+#include "core/gpu/gpu_readback.h"
+#include "core/gpu/mesh.h"
+#include "core/gpu/render_commands.h"
+#include "core/gpu/render_target_pool.h"
+#include "core/gpu/shader.h"
+#include "core/managers/file_watcher.h"
 #include "components/camera_input.h"
+#include "components/profiler_overlay.h"
 #include "components/transform.h"
 
 
@@ -10,13 +29,38 @@ World::World()
     previousTime = 0;
     elapsedTime = 0;
     deltaTime = 0;
+    fixedTimestep = 0;
+    maxFixedSteps = 5;
+    accumulator = 0;
+    threadedRendering = false;
+    renderThread = nullptr;
+    commands = new RenderCommandList();
+    replayedCommands = new RenderCommandList();
+    showProfilerOverlay = false;
+    profilerOverlay = nullptr;
     paused = false;
     shouldClose = false;
+    inputRecorder = nullptr;
+    replay = nullptr;
+    replayFrame = 0;
+    replayRender = true;
+    replayBegin = 0;
 
     window = Engine::GetWindow();
 }
 
 
+World::~World()
+{
+    StopRenderThread();
+    delete commands;
+    delete replayedCommands;
+    delete profilerOverlay;
+    delete inputRecorder;
+    delete replay;
+}
+
+
 void World::Run()
 {
     if (!window)
@@ -26,6 +70,15 @@ void World::Run()
     {
         LoopUpdate();
     }
+
+    // What comes after the loop expects the context on the main thread
+    StopRenderThread();
+
+    if (inputRecorder)
+    {
+        std::cout << "Recorded " << inputRecorder->GetFrameCount() << " frames of input" << std::endl;
+        inputRecorder->Close();
+    }
 }
 
 
@@ -48,6 +101,112 @@ double World::GetLastFrameTime()
 }
 
 
+void World::SetFixedTimestep(double stepSeconds, unsigned int maxStepsPerFrame)
+{
+    fixedTimestep = stepSeconds > 0 ? stepSeconds : 0;
+    maxFixedSteps = maxStepsPerFrame ? maxStepsPerFrame : 1;
+    accumulator = 0;
+}
+
+
+double World::GetFixedTimestep() const
+{
+    return fixedTimestep;
+}
+
+
+float World::GetInterpolationFactor() const
+{
+    return fixedTimestep > 0 ? static_cast<float>(accumulator / fixedTimestep) : 1.0f;
+}
+
+
+void World::SetThreadedRendering(bool enabled)
+{
+    // The thread is started by the first frame submitted to it
+    threadedRendering = enabled;
+    if (!enabled)
+        StopRenderThread();
+}
+
+
+bool World::IsThreadedRendering() const
+{
+    return threadedRendering;
+}
+
+
+void World::RunWithContext(std::function<void()> task)
+{
+    contextTasks.push_back(std::move(task));
+}
+
+
+void World::SetProfilerOverlay(bool enabled)
+{
+    showProfilerOverlay = enabled;
+    GPUProfiler::SetEnabled(enabled);
+}
+
+
+bool World::IsProfilerOverlayShown() const
+{
+    return showProfilerOverlay;
+}
+
+
+bool World::RecordInput(const std::string &fileName, uint32_t seed)
+{
+    if (!inputRecorder)
+        inputRecorder = new InputRecorder();
+    return inputRecorder->Open(fileName, { seed, window->GetResolution() });
+}
+
+
+bool World::ReplayInput(const std::string &fileName, bool render)
+{
+    InputLog *log = new InputLog();
+    if (!log->Load(fileName) || log->GetFrameCount() == 0)
+    {
+        std::cout << "Nothing to replay in " << fileName << std::endl;
+        delete log;
+        return false;
+    }
+
+    // The mouse positions are in pixels: the scene only maps them back
+    // to the same spots in a window of the recorded size
+    glm::ivec2 resolution = window->GetResolution();
+    if (resolution != log->GetHeader().resolution)
+    {
+        std::cout << "Replaying a recording of a " << log->GetHeader().resolution.x << "x"
+                  << log->GetHeader().resolution.y << " window in a " << resolution.x << "x"
+                  << resolution.y << " one, the mouse will be off" << std::endl;
+    }
+
+    delete replay;
+    replay = log;
+    replayFrame = 0;
+    replayRender = render;
+    replayBegin = Engine::GetElapsedTime();
+
+    // Only the recorded input reaches the world from now on
+    SetActive(false);
+    return true;
+}
+
+
+bool World::IsReplaying() const
+{
+    return replay != nullptr;
+}
+
+
+RenderCommandList &World::GetRenderCommands()
+{
+    return *commands;
+}
+
+
 void World::ComputeFrameDeltaTime()
 {
     elapsedTime = Engine::GetElapsedTime();
@@ -56,24 +215,234 @@ void World::ComputeFrameDeltaTime()
 }
 
 
+void World::RunFixedSteps()
+{
+    accumulator += deltaTime;
+
+    unsigned int steps = 0;
+    while (accumulator >= fixedTimestep && steps < maxFixedSteps)
+    {
+        FixedUpdate(static_cast<float>(fixedTimestep));
+        accumulator -= fixedTimestep;
+        steps++;
+    }
+
+    // Falling behind: catching up would only make the next frames longer
+    if (accumulator >= fixedTimestep)
+        accumulator = std::fmod(accumulator, fixedTimestep);
+}
+
+
 void World::LoopUpdate()
 {
+    PROFILE_FRAME();
+    PROFILE_FUNCTION();
+
     // Polls and buffers the events
-    window->PollEvents();
+    {
+        PROFILE_ZONE("PollEvents");
+        window->PollEvents();
+    }
 
     // Computes frame deltaTime in seconds
     ComputeFrameDeltaTime();
 
+    // The counters of the previous frame, which took deltaTime
+    FrameStats::EndFrame(deltaTime);
+
     // Calls the methods of the instance of InputController in the following order
     // OnWindowResize, OnMouseMove, OnMouseBtnPress, OnMouseBtnRelease, OnMouseScroll, OnKeyPress, OnMouseScroll, OnInputUpdate
     // OnInputUpdate will be called each frame, the other functions are called only if an event is registered
-    window->UpdateObservers();
+    {
+        PROFILE_ZONE("UpdateObservers");
+        window->UpdateObservers();
+    }
+
+    // The recorded input replaces the live one, and the recorded frame times the
+    // measured ones, for the simulation only: the statistics keep the real times
+    if (replay)
+        ReplayFrame();
+    else if (inputRecorder)
+        inputRecorder->EndFrame(deltaTime);
+
+    if (!threadedRendering)
+    {
+        // Hot reload: rebuilds the resources whose files changed, then swaps in the
+        // meshes imported and the shaders that finished compiling in the background
+        RunContextTasks();
+        FileWatcher::Update();
+        Mesh::FinishReloads();
+        Shader::FinishAll(false);
+
+        // Hands out the GPU data read back in the previous frames
+        GPUReadback::Update();
+    }
+
+    // Simulation steps, if fixed, then frame processing, recorded into the render commands
+    if (fixedTimestep > 0)
+    {
+        PROFILE_ZONE("FixedUpdate");
+        RunFixedSteps();
+    }
+    {
+        PROFILE_ZONE("Update");
+        commands->BeginGPURange("Frame");
+        FrameStart();
+        Update(static_cast<float>(deltaTime));
+        FrameEnd();
+        commands->EndGPURange();
+    }
+
+    if (replay && !replayRender)
+    {
+        commands->Reset();
+        return;
+    }
+
+    if (showProfilerOverlay)
+    {
+        glm::ivec2 resolution = window->GetResolution();
+        double frameSeconds = deltaTime;
+        commands->Run([this, resolution, frameSeconds]() {
+            if (!profilerOverlay)
+                profilerOverlay = new gfxc::ProfilerOverlay(window->props.selfDir);
+            profilerOverlay->Draw(resolution, frameSeconds);
+        });
+    }
+    if (GPUProfiler::IsEnabled())
+        commands->Run(GPUProfiler::EndFrame);
+
+    if (threadedRendering)
+    {
+        SubmitFrame();
+        return;
+    }
+
+    {
+        PROFILE_ZONE("Execute commands");
+        commands->Execute();
+        commands->Reset();
+    }
 
-    // Frame processing
-    FrameStart();
-    Update(static_cast<float>(deltaTime));
-    FrameEnd();
+    // Queues the reads of the frames being captured, before they are swapped out
+    FrameCapture::Update(window->GetResolution());
+    RenderTargetPool::EndFrame();
 
     // Swap front and back buffers - image will be displayed to the screen
+    PROFILE_ZONE("SwapBuffers");
     window->SwapBuffers();
 }
+
+
+void World::SubmitFrame()
+{
+    if (!renderThread)
+    {
+        renderThread = new RenderThread(window);
+    }
+    else
+    {
+        // The previous frame is replayed, but not swapped yet. Until the next
+        // one is submitted, the context is back on the main thread.
+        {
+            PROFILE_ZONE("Wait for render thread");
+            renderThread->Wait();
+        }
+        window->MakeCurrentContext();
+        FrameCapture::Update(window->GetResolution());
+    }
+    RenderTargetPool::EndFrame();
+
+    // Same as in the single threaded frames, only later in the frame
+    RunContextTasks();
+    FileWatcher::Update();
+    Mesh::FinishReloads();
+    Shader::FinishAll(false);
+    GPUReadback::Update();
+
+    renderThread->Submit(commands);
+    std::swap(commands, replayedCommands);
+    commands->Reset();
+}
+
+
+void World::RunContextTasks()
+{
+    // A task may queue another, for the next frame
+    std::vector<std::function<void()>> tasks;
+    tasks.swap(contextTasks);
+    for (auto &task : tasks)
+        task();
+}
+
+
+void World::StopRenderThread()
+{
+    if (!renderThread)
+        return;
+
+    renderThread->Stop();
+    delete renderThread;
+    renderThread = nullptr;
+    window->MakeCurrentContext();
+}
+
+
+void World::ReplayFrame()
+{
+    if (replayFrame >= replay->GetFrameCount())
+    {
+        deltaTime = 0;
+        return;
+    }
+
+    const InputLog::Frame &frame = replay->GetFrame(replayFrame++);
+    deltaTime = frame.deltaTime;
+
+    for (uint32_t i = 0; i < frame.nrEvents; i++)
+    {
+        const InputLog::Event &event = replay->GetEvent(frame.firstEvent + i);
+        const int32_t *args = event.args;
+        switch (event.type)
+        {
+        case InputLog::WINDOW_RESIZE:
+            OnWindowResize(args[0], args[1]);
+            break;
+        case InputLog::MOUSE_MOVE:
+            OnMouseMove(args[0], args[1], args[2], args[3]);
+            break;
+        case InputLog::MOUSE_BTN_PRESS:
+            OnMouseBtnPress(args[0], args[1], args[2], args[3]);
+            break;
+        case InputLog::MOUSE_BTN_RELEASE:
+            OnMouseBtnRelease(args[0], args[1], args[2], args[3]);
+            break;
+        case InputLog::MOUSE_SCROLL:
+            OnMouseScroll(args[0], args[1], args[2], args[3]);
+            break;
+        case InputLog::KEY_PRESS:
+            OnKeyPress(args[0], args[1]);
+            break;
+        case InputLog::KEY_RELEASE:
+            OnKeyRelease(args[0], args[1]);
+            break;
+        case InputLog::INPUT_UPDATE:
+        {
+            float inputDeltaTime;
+            memcpy(&inputDeltaTime, &args[0], sizeof(inputDeltaTime));
+            OnInputUpdate(inputDeltaTime, args[1]);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    if (replayFrame == replay->GetFrameCount())
+    {
+        double seconds = Engine::GetElapsedTime() - replayBegin;
+        std::cout << "Replayed " << replayFrame << " frames in " << seconds << " s ("
+                  << seconds * 1000 / std::max<size_t>(replayFrame, 1) << " ms per frame)" << std::endl;
+        Exit();
+    }
+}
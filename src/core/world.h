@@ -1,15 +1,29 @@
 #pragma once
 
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+
 #include "window/input_controller.h"
 
 
+class InputLog;
+class InputRecorder;
+class RenderCommandList;
+class RenderThread;
+namespace gfxc { class ProfilerOverlay; }
+
+
 class World : public InputController
 {
  public:
     World();
-    virtual ~World() {}
+    virtual ~World();
     virtual void Init() {}
     virtual void FrameStart() {}
+    // Only called with a fixed timestep, zero or more times per frame, before FrameStart
+    virtual void FixedUpdate(float fixedDeltaTimeSeconds) {}
     virtual void Update(float deltaTimeSeconds) {}
     virtual void FrameEnd() {}
 
@@ -19,14 +33,74 @@ class World : public InputController
 
     double GetLastFrameTime();
 
+    // Runs the simulation in steps of `stepSeconds` (0 turns them off), at most
+    // `maxStepsPerFrame` per frame: slower frames drop the time left over
+    void SetFixedTimestep(double stepSeconds, unsigned int maxStepsPerFrame = 5);
+    double GetFixedTimestep() const;
+    // How far the frame is between the last two fixed steps, in [0, 1),
+    // for drawing the simulated objects in between their states
+    float GetInterpolationFactor() const;
+
+    // Replays the frames on a render thread, while the main thread simulates the
+    // next one. Only what is drawn through the render commands is shown then, and
+    // the input shows up one frame later.
+    void SetThreadedRendering(bool enabled);
+    bool IsThreadedRendering() const;
+    // Runs `task` later in the frame, on the main thread with the context current
+    // (the input observers run without it while the frames are threaded), for
+    // GL work that cannot go through the render commands, such as shader reloads
+    void RunWithContext(std::function<void()> task);
+
+    // Draws the frame time and the GPU timings over the frame (see GPUProfiler,
+    // which it enables)
+    void SetProfilerOverlay(bool enabled);
+    bool IsProfilerOverlayShown() const;
+
+    // Writes the input and the frame times into `fileName` (see InputLog), from the
+    // next frame until the world closes, along with `seed`, the one the random
+    // numbers of the world were drawn from
+    bool RecordInput(const std::string &fileName, uint32_t seed);
+    // Plays such a recording back instead of the live input, with its frame times,
+    // as fast as the frames go, then closes the window. Without `render`, the frames
+    // are simulated but not drawn. The world must start from the recorded seed.
+    bool ReplayInput(const std::string &fileName, bool render = true);
+    bool IsReplaying() const;
+
+ protected:
+    // The commands of the frame being recorded. Scenes draw through them
+    // instead of calling OpenGL, so that the frames can be threaded.
+    RenderCommandList &GetRenderCommands();
+
  private:
     void ComputeFrameDeltaTime();
+    void RunFixedSteps();
     void LoopUpdate();
+    void SubmitFrame();
+    void StopRenderThread();
+    void RunContextTasks();
+    // Dispatches the events of the next recorded frame, and steps by its time
+    void ReplayFrame();
 
  private:
     double previousTime;
     double elapsedTime;
     double deltaTime;
+    double fixedTimestep;
+    unsigned int maxFixedSteps;
+    double accumulator;
+    bool threadedRendering;
+    RenderThread *renderThread;
+    RenderCommandList *commands;
+    RenderCommandList *replayedCommands;
+    std::vector<std::function<void()>> contextTasks;
+    bool showProfilerOverlay;
+    gfxc::ProfilerOverlay *profilerOverlay;
     bool paused;
     bool shouldClose;
+
+    InputRecorder *inputRecorder;
+    InputLog *replay;
+    size_t replayFrame;
+    bool replayRender;
+    double replayBegin;
 };
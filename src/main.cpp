@@ -1,7 +1,11 @@
 #include <ctime>
+#include <random>
 #include <iostream>
 
 #include "core/engine.h"
+#include "core/frame_stats.h"
+#include "core/input_log.h"
+#include "core/gpu/frame_capture.h"
 #include "components/simple_scene.h"
 
 #include "main/headers_list.h"
@@ -23,19 +27,60 @@ int main(int argc, char **argv)
 {
     srand((unsigned int)time(NULL));
 
+    // --stats <file>: the per frame counters, written on exit (CSV or JSON, by extension)
+    // --record <file>: the input, the frame times and the seed of the game, see InputLog
+    // --replay <file>: plays such a recording back, as fast as it goes
+    // --headless: with --replay, in a hidden window, without drawing the frames
+    // --capture <prefix>: every frame drawn, into the raw video stream <prefix>.rgba
+    std::string recordFile, replayFile, captureFile;
+    bool headless = false;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--stats" && i + 1 < argc)
+            FrameStats::SetDumpFile(argv[++i]);
+        else if (arg == "--record" && i + 1 < argc)
+            recordFile = argv[++i];
+        else if (arg == "--replay" && i + 1 < argc)
+            replayFile = argv[++i];
+        else if (arg == "--headless")
+            headless = true;
+        else if (arg == "--capture" && i + 1 < argc)
+            captureFile = argv[++i];
+    }
+
+    InputLog::Header replayHeader;
+    if (!replayFile.empty() && !InputLog::ReadHeader(replayFile, replayHeader))
+    {
+        std::cout << "Cannot replay " << replayFile << std::endl;
+        return 1;
+    }
+    bool replaying = !replayFile.empty();
+    uint32_t seed = replaying ? replayHeader.seed : std::random_device()();
+
     // Create a window property structure
     WindowProperties wp;
-    wp.resolution = glm::ivec2(1280, 720);
-    wp.vSync = true;
+    wp.resolution = replaying ? replayHeader.resolution : glm::ivec2(1280, 720);
+    wp.vSync = !replaying;
+    wp.visible = !(replaying && headless);
     wp.selfDir = GetParentDir(std::string(argv[0]));
 
     // Init the Engine and create a new window with the defined properties
     (void)Engine::Init(wp);
 
     // Create a new 3D world and start running it
-    World* world = new game::Game();
+    World* world = new game::Game(seed);
 
     world->Init();
+    if (replaying && !world->ReplayInput(replayFile, !headless))
+    {
+        Engine::Exit();
+        return 1;
+    }
+    if (!replaying && !recordFile.empty())
+        world->RecordInput(recordFile, seed);
+    if (!captureFile.empty())
+        FrameCapture::StartRecording(captureFile, FrameCapture::Format::RAW);
     world->Run();
 
     // Signals to the Engine to release the OpenGL context
@@ -1,7 +1,9 @@
+#include <cmath>
 #include <iostream>
 #include "controlledscene2d.h"
 #include "transform2d.h"
 #include "../wisteria_engine/material.h"
+#include "core/profiler.h"
 
 using namespace engine;
 
@@ -26,7 +28,7 @@ void ControlledScene2D::LoadShader(const std::string &name, const std::string &v
     Shader *shader = new Shader(name.c_str());
     shader->AddShader(PATH_JOIN(window->props.selfDir, SOURCE_PATH::MAIN, vertexShader.c_str()), GL_VERTEX_SHADER);
     shader->AddShader(PATH_JOIN(window->props.selfDir, SOURCE_PATH::MAIN, fragmentShader.c_str()), GL_FRAGMENT_SHADER);
-    shader->CreateAndLink();
+    shader->Submit();
     shaders[shader->GetName()] = shader;
 }
 
@@ -72,15 +74,14 @@ glm::vec2 ControlledScene2D::ScreenCoordsToLogicCoords(int screenX, int screenY)
 
 void ControlledScene2D::SetViewportArea(const ViewportSpace &viewSpace, glm::vec3 clearColor, bool clear)
 {
-    glViewport(viewSpace.x, viewSpace.y, viewSpace.width, viewSpace.height);
-
-    glEnable(GL_SCISSOR_TEST);
-    glScissor(viewSpace.x, viewSpace.y, viewSpace.width, viewSpace.height);
+    RenderCommandList &commands = GetRenderCommands();
+    glm::ivec4 area(viewSpace.x, viewSpace.y, viewSpace.width, viewSpace.height);
+    commands.SetViewport(area);
 
     // Clears the color buffer (using the previously set color) and depth buffer
-    glClearColor(clearColor.r, clearColor.g, clearColor.b, 1);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glDisable(GL_SCISSOR_TEST);
+    commands.SetScissor(true, area);
+    commands.Clear(glm::vec4(clearColor, 1));
+    commands.SetScissor(false);
 
     GetSceneCamera()->SetOrthographic((float)viewSpace.x, (float)(viewSpace.x + viewSpace.width), (float)viewSpace.y, (float)(viewSpace.y + viewSpace.height), 0.1f, 400);
     GetSceneCamera()->Update();
@@ -89,12 +90,11 @@ void ControlledScene2D::SetViewportArea(const ViewportSpace &viewSpace, glm::vec
 void ControlledScene2D::FrameStart()
 {
     // Clears the color buffer (using the previously set color) and depth buffer
-    glClearColor(0, 0, 0, 1);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    RenderCommandList &commands = GetRenderCommands();
+    commands.Clear(glm::vec4(0, 0, 0, 1));
 
     // Enable blending so that we can have transparent colors
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    commands.SetBlending(true);
 }
 
 void ControlledScene2D::Init()
@@ -123,22 +123,71 @@ void ControlledScene2D::Destroy(GameObject2D *gameObject)
     toDestroy.insert(gameObject);
 }
 
+void ControlledScene2D::FixedUpdate(float fixedDeltaTimeSeconds)
+{
+    PROFILE_FUNCTION();
+    deltaTime = fixedDeltaTimeSeconds * timeScale;
+    unscaledDeltaTime = fixedDeltaTimeSeconds;
+
+    GameObject2D::inFixedStep = true;
+    for (auto gameObject : gameObjects) {
+        MoveGameObject(gameObject, true);
+    }
+    for (auto &pair : transparentGameObjects) {
+        MoveGameObject(pair.second, true);
+    }
+
+    {
+        PROFILE_ZONE("Tick");
+        Tick();
+    }
+    GameObject2D::inFixedStep = false;
+    DestroyPending();
+}
+
 void ControlledScene2D::Update(float deltaTimeSeconds)
 {
-    deltaTime = deltaTimeSeconds * timeScale;
-    unscaledDeltaTime = deltaTimeSeconds;
+    PROFILE_FUNCTION();
+    // with a fixed timestep, the simulation already ran in FixedUpdate
+    bool fixedStep = GetFixedTimestep() > 0;
+    float interpolation = fixedStep ? GetInterpolationFactor() : 1;
+    if (!fixedStep) {
+        deltaTime = deltaTimeSeconds * timeScale;
+        unscaledDeltaTime = deltaTimeSeconds;
+    }
 
     // Draw the objects from the scene
-    glEnable(GL_DEPTH_TEST);
+    RenderCommandList &commands = GetRenderCommands();
+    commands.BeginGPURange("Scene");
+    commands.SetDepthTest(true);
+    for (auto gameObject : gameObjects) {
+        DrawGameObject(gameObject, glm::mat3(1), interpolation);
+    }
+    for (auto &pair : transparentGameObjects) {
+        DrawGameObject(pair.second, glm::mat3(1), interpolation);
+    }
+    commands.SetDepthTest(false);
+    commands.EndGPURange();
+
+    if (fixedStep)
+        return;
+
     for (auto gameObject : gameObjects) {
-        DrawGameObject(gameObject, glm::mat3(1));
+        MoveGameObject(gameObject, false);
     }
     for (auto &pair : transparentGameObjects) {
-        DrawGameObject(pair.second, glm::mat3(1));
+        MoveGameObject(pair.second, false);
+    }
+
+    {
+        PROFILE_ZONE("Tick");
+        Tick();
     }
-    glDisable(GL_DEPTH_TEST);
+    DestroyPending();
+}
 
-    Tick();
+void ControlledScene2D::DestroyPending()
+{
     for (auto gameObject : toDestroy) {
         if (gameObjects.find(gameObject) != gameObjects.end())
             gameObjects.erase(gameObject);
@@ -155,31 +204,74 @@ void ControlledScene2D::Update(float deltaTimeSeconds)
     toDestroy.clear();
 }
 
-void ControlledScene2D::RenderMeshCustomMaterial(Mesh *mesh, Material material, const glm::mat3 &modelViewMatrix)
+void ControlledScene2D::DrawMesh(Mesh *mesh, Shader *shader, const glm::mat3 &modelViewMatrix,
+                                 const Material *material)
 {
-    if (!mesh || !material.shader || !material.shader->GetProgramID())
+    if (!mesh || !shader)
         return;
 
-    material.Use();
-    // RenderMesh2D already sets MVP matrices and binds the VAO
-    RenderMesh2D(mesh, material.shader, modelViewMatrix);
+    // same as SimpleScene::RenderMesh2D, the 2D matrix is lifted to 3D, keeping z
+    const glm::mat3 &mm = modelViewMatrix;
+    DrawCommand draw;
+    draw.mesh = mesh;
+    draw.shader = shader;
+    draw.model = glm::mat4(
+        mm[0][0], mm[0][1], mm[0][2], 0.f,
+        mm[1][0], mm[1][1], mm[1][2], 0.f,
+        0.f, 0.f, mm[2][2], 0.f,
+        mm[2][0], mm[2][1], 0.f, 1.f);
+    draw.view = GetSceneCamera()->GetViewMatrix();
+    draw.projection = GetSceneCamera()->GetProjectionMatrix();
+
+    RenderCommandList &commands = GetRenderCommands();
+    if (material) {
+        draw.texture = material->texture;
+        draw.wireframe = material->wireframe;
+        commands.Draw(draw);
+        material->Record(commands);
+    } else {
+        commands.Draw(draw);
+    }
 }
 
-void ControlledScene2D::DrawGameObject(GameObject2D *gameObject, glm::mat3 parentModelMatrix)
+void ControlledScene2D::DrawGameObject(GameObject2D *gameObject, glm::mat3 parentModelMatrix, float interpolation)
 {
+    PROFILE_FUNCTION();
+    glm::vec2 position = gameObject->GetLocalPosition();
+    glm::vec2 scale = gameObject->GetLocalScale();
+    float rotation = gameObject->GetLocalRotation();
+    if (interpolation < 1) {
+        position = glm::mix(gameObject->GetPreviousLocalPosition(), position, interpolation);
+        scale = glm::mix(gameObject->GetPreviousLocalScale(), scale, interpolation);
+        // the short way round, the angles are not kept in [0, 2pi)
+        float previousRotation = gameObject->GetPreviousLocalRotation();
+        float turn = std::remainder(rotation - previousRotation, glm::two_pi<float>());
+        rotation = previousRotation + turn * interpolation;
+    }
+
     glm::mat3 modelMatrix = parentModelMatrix * 
-        transform2D::Translate(gameObject->GetLocalPosition().x, gameObject->GetLocalPosition().y) *
-        transform2D::Rotate(gameObject->GetLocalRotation()) *
-        transform2D::Scale(gameObject->GetLocalScale().x, gameObject->GetLocalScale().y);
+        transform2D::Translate(position.x, position.y) *
+        transform2D::Rotate(rotation) *
+        transform2D::Scale(scale.x, scale.y);
 
     if (gameObject->mesh) {
         if (gameObject->material.shader) {
-            RenderMeshCustomMaterial(gameObject->mesh, gameObject->material, visMatrix * modelMatrix);
+            DrawMesh(gameObject->mesh, gameObject->material.shader, visMatrix * modelMatrix, &gameObject->material);
         } else {
-            RenderMesh2D(gameObject->mesh, shaders["VertexColor"], visMatrix * modelMatrix);
+            DrawMesh(gameObject->mesh, shaders["VertexColor"], visMatrix * modelMatrix);
         }
     }
 
+    for (auto &child : gameObject->GetChildren()) {
+        DrawGameObject(child, modelMatrix, interpolation);
+    }
+}
+
+void ControlledScene2D::MoveGameObject(GameObject2D *gameObject, bool savePreviousTransform)
+{
+    if (savePreviousTransform)
+        gameObject->SavePreviousTransform();
+
     float objectDeltaTime = gameObject->useUnscaledTime ? unscaledDeltaTime : deltaTime;
     if (gameObject->velocity != glm::vec2(0)) {
         glm::vec2 position = gameObject->GetLocalPosition();
@@ -193,7 +285,7 @@ void ControlledScene2D::DrawGameObject(GameObject2D *gameObject, glm::mat3 paren
     }
 
     for (auto &child : gameObject->GetChildren()) {
-        DrawGameObject(child, modelMatrix);
+        MoveGameObject(child, savePreviousTransform);
     }
 }
 
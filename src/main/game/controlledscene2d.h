@@ -5,6 +5,7 @@
 #include "gameobject2d.h"
 
 #include "components/simple_scene.h"
+#include "core/gpu/render_commands.h"
 
 namespace engine
 {
@@ -49,6 +50,7 @@ namespace engine
 
     private:
         void FrameStart() override;
+        void FixedUpdate(float fixedDeltaTimeSeconds) override;
         void Update(float deltaTimeSeconds) override;
         // void FrameEnd() override;
 
@@ -60,8 +62,13 @@ namespace engine
 
         // Set the scene
         void SetViewportArea(const ViewportSpace &viewSpace, glm::vec3 colorColor, bool clear);
-        void RenderMeshCustomMaterial(Mesh *mesh, Material material, const glm::mat3 &modelViewMatrix);
-        void DrawGameObject(GameObject2D *gameObject, glm::mat3 parentModelMatrix);
+        // records the draw, with the texture, uniforms and wireframe mode of `material` if given
+        void DrawMesh(Mesh *mesh, Shader *shader, const glm::mat3 &modelViewMatrix,
+                      const Material *material = nullptr);
+        // `interpolation` goes from the previous transforms (0) to the current ones (1)
+        void DrawGameObject(GameObject2D *gameObject, glm::mat3 parentModelMatrix, float interpolation);
+        void MoveGameObject(GameObject2D *gameObject, bool savePreviousTransform);
+        void DestroyPending();
 
     protected:
         ViewportSpace viewSpace;
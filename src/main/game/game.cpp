@@ -8,7 +8,9 @@
 using namespace game;
 using namespace engine;
 
-Game::Game()
+Game::Game() : Game(std::random_device()()) {}
+
+Game::Game(uint32_t seed)
 {
     grid.assign(3, std::vector<std::pair<GameObject2D *, RhombusGun *>>(3));
     meshes["background"] = shapes::CreateSquare("background", glm::vec3(0.9, 0.9, 0.8), -10);
@@ -27,8 +29,7 @@ Game::Game()
     HexagonEnemy::InitMeshes();
     ProjectileStar::InitMeshes();
 
-    std::random_device rd;
-    rng = std::mt19937(rd());
+    rng = std::mt19937(seed);
     starXGenerator = std::uniform_real_distribution<float>(4, logicSpace.width - 4);
     starYGenerator = std::uniform_real_distribution<float>(4, logicSpace.height - 4);
     secondsGeneratorStars = std::binomial_distribution<int>(8, 0.5);
@@ -69,6 +70,13 @@ Game::~Game()
 
 void Game::Initialize()
 {
+    // projectiles move up to 28 units per second, fixed steps keep them from
+    // skipping over hexagons during long frames
+    SetFixedTimestep(1.0 / 60);
+    // everything is drawn through the render commands, so the frames can be
+    // replayed on the render thread while the next one is simulated
+    SetThreadedRendering(true);
+
     // Setup permanent objects in the scene
     gameObjects.insert(new GameObject2D(
         meshes["background"], 
@@ -311,8 +319,12 @@ void Game::AddHexagons()
             livesObjects.pop_back();
             DestroyHexagon(hexagon);
             if (lives == 0) {
+                // closes the window after this frame, so that the render thread is stopped
+                // before the statics go; the other hexagons stay put until then
                 std::cout << "Game over!\n";
-                exit(0);
+                paused = true;
+                Exit();
+                return;
             }
         }
         for (auto &cannonGameObject : grid[hexagon->laneNumber]) {
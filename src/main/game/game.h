@@ -4,6 +4,7 @@
 #include <queue>
 #include <stack>
 #include <random>
+#include <cstdint>
 #include "controlledscene2d.h"
 #include "gameobject2d.h"
 #include "coloreditem.h"
@@ -16,6 +17,9 @@ namespace game
     {
     public:
         Game();
+        // the random numbers of the game are drawn from `seed`, so that a
+        // recording of the input plays the same game back (see World::ReplayInput)
+        explicit Game(uint32_t seed);
         ~Game();
 
     private:
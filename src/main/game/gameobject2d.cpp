@@ -4,13 +4,17 @@
 #include "hitarea2d.h"
 #include "gameobject2d.h"
 #include "transform2d.h"
+#include "core/frame_stats.h"
 
 using namespace engine;
 
+bool GameObject2D::inFixedStep = false;
+
 // private constructor
 GameObject2D::GameObject2D(GameObject2D *parent, Mesh *mesh, glm::vec2 position, 
                                         glm::vec2 scale, float rotation)
 {
+    FrameStats::Add(FrameStats::GAME_OBJECTS_2D);
     this->mesh = mesh;
     this->parent = parent;
     if (parent != nullptr)
@@ -19,10 +23,12 @@ GameObject2D::GameObject2D(GameObject2D *parent, Mesh *mesh, glm::vec2 position,
     SetLocalPosition(position);
     SetLocalScale(scale);
     SetLocalRotation(rotation);
+    SavePreviousTransform();
 }
 
 GameObject2D::GameObject2D()
 {
+    FrameStats::Add(FrameStats::GAME_OBJECTS_2D);
     position = glm::vec2(0);
     localPosition = glm::vec2(0);
     rotation = 0;
@@ -31,6 +37,7 @@ GameObject2D::GameObject2D()
     localScale = glm::vec2(1);
     parent = nullptr;
     mesh = nullptr;
+    SavePreviousTransform();
 }
 
 GameObject2D::GameObject2D(Mesh *mesh, glm::vec2 position, glm::vec2 scale, float rotation)
@@ -41,6 +48,7 @@ GameObject2D::GameObject2D(glm::vec2 position, glm::vec2 scale, float rotation)
 
 GameObject2D::~GameObject2D()
 {
+    FrameStats::Add(FrameStats::GAME_OBJECTS_2D, -1);
     if (parent != nullptr && !willBeDetached) {
         parent->DetachChild(this);
     }
@@ -101,9 +109,22 @@ glm::vec2 GameObject2D::GetLocalScale() { return localScale; }
 glm::vec2 GameObject2D::GetPosition() { return position; }
 float GameObject2D::GetRotation() { return rotation; }
 glm::vec2 GameObject2D::GetPseudoScale() { return pseudoScale; }
+glm::vec2 GameObject2D::GetPreviousLocalPosition() { return previousLocalPosition; }
+glm::vec2 GameObject2D::GetPreviousLocalScale() { return previousLocalScale; }
+float GameObject2D::GetPreviousLocalRotation() { return previousLocalRotation; }
+
+void GameObject2D::SavePreviousTransform()
+{
+    previousLocalPosition = localPosition;
+    previousLocalScale = localScale;
+    previousLocalRotation = localRotation;
+}
 
 void GameObject2D::SetLocalPosition(glm::vec2 newLocalPos)
 {
+    // the children are set again with their own local values, which keeps their interpolation
+    if (!inFixedStep && newLocalPos != localPosition)
+        previousLocalPosition = newLocalPos;
     localPosition = newLocalPos;
     if (parent == nullptr) {
         position = newLocalPos;
@@ -125,6 +146,7 @@ void GameObject2D::SetLocalPosition(glm::vec2 newLocalPos)
 
 void GameObject2D::SetPosition(glm::vec2 newPosition)
 {
+    glm::vec2 oldLocalPosition = localPosition;
     position = newPosition;
     if (parent == nullptr) {
         localPosition = newPosition;
@@ -135,6 +157,8 @@ void GameObject2D::SetPosition(glm::vec2 newPosition)
         disp.y = disp.x * glm::sin(angle) + disp.y * glm::cos(angle);
         localPosition = disp / parent->pseudoScale;
     }
+    if (!inFixedStep && localPosition != oldLocalPosition)
+        previousLocalPosition = localPosition;
 
     for (auto child : children)
     {
@@ -146,6 +170,8 @@ void GameObject2D::SetPosition(glm::vec2 newPosition)
 
 void GameObject2D::SetLocalScale(glm::vec2 newLocalScale)
 {
+    if (!inFixedStep && newLocalScale != localScale)
+        previousLocalScale = newLocalScale;
     localScale = newLocalScale;
     pseudoScale = (parent == nullptr) ? newLocalScale : newLocalScale * parent->pseudoScale;
     for (auto child : children)
@@ -157,7 +183,10 @@ void GameObject2D::SetLocalScale(glm::vec2 newLocalScale)
 void GameObject2D::SetPseudoScale(glm::vec2 newPseudoScale)
 {
     pseudoScale = newPseudoScale;
-    localScale = (parent == nullptr) ? newPseudoScale : newPseudoScale / parent->pseudoScale;
+    glm::vec2 newLocalScale = (parent == nullptr) ? newPseudoScale : newPseudoScale / parent->pseudoScale;
+    if (!inFixedStep && newLocalScale != localScale)
+        previousLocalScale = newLocalScale;
+    localScale = newLocalScale;
     for (auto child : children)
     {
         child->SetPseudoScale(child->pseudoScale);
@@ -166,6 +195,8 @@ void GameObject2D::SetPseudoScale(glm::vec2 newPseudoScale)
 
 void GameObject2D::SetLocalRotation(float newLocalRotation)
 {
+    if (!inFixedStep && newLocalRotation != localRotation)
+        previousLocalRotation = newLocalRotation;
     localRotation = newLocalRotation;
     rotation = (parent == nullptr) ? newLocalRotation : parent->rotation + newLocalRotation;
     for (auto child : children)
@@ -180,7 +211,10 @@ void GameObject2D::SetLocalRotation(float newLocalRotation)
 void GameObject2D::SetRotation(float newRotation)
 {
     rotation = newRotation;
-    localRotation = (parent == nullptr) ? newRotation : newRotation - parent->rotation;
+    float newLocalRotation = (parent == nullptr) ? newRotation : newRotation - parent->rotation;
+    if (!inFixedStep && newLocalRotation != localRotation)
+        previousLocalRotation = newLocalRotation;
+    localRotation = newLocalRotation;
     for (auto child : children)
     {
         if (child->fixedRotation)
@@ -261,8 +295,12 @@ bool GameObject2D::Collides(GameObject2D *other)
     if (hitArea.support == nullptr || other->hitArea.support == nullptr)
         return false;
 
-    return hitArea.shape->CollidesWith(other->hitArea.shape, hitArea.support, 
-                                       other->hitArea.support);
+    FrameStats::Add(FrameStats::COLLISION_PAIRS_TESTED);
+    bool collided = hitArea.shape->CollidesWith(other->hitArea.shape, hitArea.support,
+                                                other->hitArea.support);
+    if (collided)
+        FrameStats::Add(FrameStats::COLLISIONS);
+    return collided;
 }
 
 void GameObject2D::SetRectHitArea(float width, float height, glm::vec2 offset, 
@@ -59,6 +59,16 @@ namespace engine
         float GetLocalRotation();
         void SetLocalRotation(float rotation);
 
+        // local transform at the start of the last fixed step, drawing
+        // interpolates between it and the current one
+        // outside the fixed steps (e.g. from the input callbacks) the setters
+        // also move the previous transform, so such objects are drawn where they are
+        static bool inFixedStep;
+        void SavePreviousTransform();
+        glm::vec2 GetPreviousLocalPosition();
+        glm::vec2 GetPreviousLocalScale();
+        float GetPreviousLocalRotation();
+
         // world transformations
         glm::mat3 ObjectToWorldMatrix();
         glm::mat3 WorldToObjectMatrix();
@@ -88,6 +98,9 @@ namespace engine
         glm::vec2 position;
         float rotation;
         glm::vec2 pseudoScale;
+        glm::vec2 previousLocalPosition;
+        glm::vec2 previousLocalScale;
+        float previousLocalRotation;
         bool willBeDetached = false;
 
         GameObject2D *parent = nullptr;
@@ -7,5 +7,6 @@ std::string Assets::lookupDirectory;
 std::unordered_map<std::string, Mesh *> Assets::meshes;
 std::unordered_map<std::string, std::string> Assets::paths;
 std::unordered_map<std::string, Shader *> Assets::shaders;
+std::unordered_set<Shader *> Assets::variantShaders;
 std::unordered_map<std::string, engine::Material> Assets::materials;
 std::unordered_map<std::string, Texture2D *> Assets::textures;
\ No newline at end of file
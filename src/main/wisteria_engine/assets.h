@@ -2,8 +2,10 @@
 #include <iostream>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include "core/gpu/mesh.h"
 #include "core/gpu/shader.h"
+#include "core/profiler.h"
 #include "meshplusplus.h"
 #include "material.h"
 
@@ -17,9 +19,13 @@ namespace engine
     class Assets
     {
     public:
-        static void LoadMesh(const std::string &name, const std::string &fileLocation, const std::string &fileName)
+        // Packed meshes take about half the memory, and are decoded by the engine's shaders
+        static void LoadMesh(const std::string &name, const std::string &fileLocation, const std::string &fileName,
+                             bool packed = false)
         {
+            PROFILE_FUNCTION();
             MeshPlusPlus *mesh = new MeshPlusPlus(name);
+            mesh->UsePackedVertices(packed);
             mesh->LoadMesh(PATH_JOIN(lookupDirectory, fileLocation.c_str()), fileName.c_str());
             meshes[name] = mesh;
         }
@@ -29,13 +35,24 @@ namespace engine
             paths[name] = PATH_JOIN(lookupDirectory, path.c_str());
         }
 
+        // Shaders are only submitted for compilation here, and finished at the end of the
+        // scene's Init (or when a Material is created with them). Shaders loaded with
+        // variants are not compiled at all: materials compile the variant they need
+        // (see ShaderVariant) the first time they are drawn.
         static void LoadShader(const std::string &name, const std::string &vertexShader,
-                               const std::string &fragmentShader)
+                               const std::string &fragmentShader, bool variants = false,
+                               const ShaderDefines &defines = ShaderDefines())
         {
+            PROFILE_FUNCTION();
             Shader *shader = new Shader(name);
             shader->AddShader(paths[vertexShader], GL_VERTEX_SHADER);
             shader->AddShader(paths[fragmentShader], GL_FRAGMENT_SHADER);
-            shader->CreateAndLink();
+            for (const auto &[define, value] : defines)
+                shader->SetDefine(define, value);
+            if (variants)
+                variantShaders.insert(shader);
+            else
+                shader->Submit();
             shaders[name] = shader;
         }
 
@@ -52,6 +69,7 @@ namespace engine
         static void LoadTexture(const std::string &name, const std::string &fileLocation, 
                                 const std::string &fileName)
         {
+            PROFILE_FUNCTION();
             Texture2D *texture = new Texture2D();
             texture->Load2D(PATH_JOIN(lookupDirectory, fileLocation.c_str(), fileName).c_str());
             textures[name] = texture;
@@ -61,6 +79,7 @@ namespace engine
         static std::unordered_map<std::string, Mesh *> meshes;
         static std::unordered_map<std::string, std::string> paths;
         static std::unordered_map<std::string, Shader *> shaders;
+        static std::unordered_set<Shader *> variantShaders;
         static std::unordered_map<std::string, Material> materials;
         static std::unordered_map<std::string, Texture2D *> textures;
     };
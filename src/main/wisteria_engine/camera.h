@@ -26,8 +26,9 @@ namespace engine
             projectionMatrix = glm::ortho(left, right, bottom, top, near, far);
         }
 
-        glm::mat4 GetViewMatrix() const
+        glm::mat4 GetViewMatrix()
         {
+            ResolveTransform();
             return viewMatrix;
         }
 
@@ -38,14 +39,14 @@ namespace engine
 
         void RotateAround(float distance, float angle, glm::vec3 localAxis)
         {
-            Translate(distance * forward);
+            Translate(distance * GetForward());
             Rotate(glm::angleAxis(angle, localAxis));
-            Translate(-distance * forward);
+            Translate(-distance * GetForward());
         }
 
         void RotateAround(float distance, float angle)
         {
-            RotateAround(distance, angle, up);
+            RotateAround(distance, angle, GetUp());
         }
 
         void OnTransformChange() override
@@ -75,8 +76,9 @@ namespace engine
             viewportHeight = height;
         }
 
-        glm::vec4 GetPositionGeneralized() const
+        glm::vec4 GetPositionGeneralized()
         {
+            ResolveTransform();
             return glm::vec4(isOrthographic ? forward : position, !isOrthographic);
         }
 
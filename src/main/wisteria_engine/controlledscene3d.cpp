@@ -1,15 +1,23 @@
 #include <iostream>
+#include <algorithm>
+#include <string>
 #include "controlledscene3d.h"
 #include "transform3d.h"
 #include "camera.h"
 #include "material.h"
 #include "assets.h"
+#include "core/frame_stats.h"
+#include "core/job_system.h"
+#include "core/profiler.h"
 
 #define CAMERA_INIT_FOVY 60
 #define DEFAULT_WINDOW_WIDTH 1280
 #define DEFAULT_WINDOW_HEIGHT 720
 #define CAMERA_INIT_ZNEAR 0.01f
 #define CAMERA_INIT_ZFAR 300.0f
+#define MAX_SCENE_LIGHTS 8
+// objects per job when resolving a level of the transform hierarchy
+#define TRANSFORM_BATCH_SIZE 128
 
 using namespace engine;
 
@@ -50,12 +58,71 @@ ControlledScene3D::~ControlledScene3D()
     cameras.clear();
 }
 
-void ControlledScene3D::RenderMesh(Mesh *mesh, Shader *shader, const glm::mat4 &modelMatrix)
+void ControlledScene3D::DrawMesh(Mesh *mesh, Shader *shader, const glm::mat4 &modelMatrix, unsigned int lod,
+                                 const Material *material)
 {
-    if (!mesh || !shader || !shader->program)
+    if (!mesh || !shader)
         return;
 
-    // Render an object using the specified shader and the specified position
+    DrawCommand draw;
+    draw.mesh = mesh;
+    draw.shader = shader;
+    draw.lod = lod;
+    draw.model = modelMatrix;
+    draw.view = mainCamera->GetViewMatrix();
+    draw.projection = mainCamera->GetProjectionMatrix();
+    draw.setup = GetDrawSetup(material, mesh->GetBuffers()->m_arena == gpu_utils::PACKED_VERTEX_FORMAT_ARENA);
+
+    RenderCommandList &commands = GetRenderCommands();
+    if (material) {
+        draw.texture = material->texture;
+        draw.wireframe = material->wireframe;
+        commands.Draw(draw);
+        material->Record(commands);
+    } else {
+        commands.Draw(draw);
+    }
+}
+
+int ControlledScene3D::GetDrawSetup(const Material *material, bool packedVertices)
+{
+    // shaders loaded with variants are specialized for the number of lights
+    bool variant = material && Assets::variantShaders.find(material->shader) != Assets::variantShaders.end();
+    int key = 0;
+    if (variant)
+        key = 1 + ((material->texture != nullptr) | material->vertexColor << 1 | material->uvTransform << 2);
+    key = key * 2 + packedVertices;
+    if (drawSetups[key] >= 0)
+        return drawSetups[key];
+
+    DrawSetup setup;
+    setup.viewMatrix = mainCamera->GetViewMatrix();
+    setup.projectionMatrix = mainCamera->GetProjectionMatrix();
+    setup.eyePosition = mainCamera->GetPositionGeneralized();
+    setup.lights.assign(lights.begin(), lights.begin() + std::min<size_t>(lights.size(), MAX_SCENE_LIGHTS));
+    setup.sceneAmbient = sceneAmbient;
+    setup.clusteredLights = !pointLights.empty();
+    setup.variant = variant || packedVertices;
+    setup.packedVertices = packedVertices;
+    if (variant)
+        setup.defines = material->GetVariant((int)setup.lights.size(), setup.clusteredLights, false, packedVertices).GetDefines();
+    else if (packedVertices)
+        setup.defines["WIST_PACKED_VERTICES"] = "1";
+
+    drawSetups[key] = GetRenderCommands().AddSetup([this, setup](Shader *shader, const DrawCommand &draw) {
+        return SetupDraw(setup, shader, draw);
+    });
+    return drawSetups[key];
+}
+
+Shader *ControlledScene3D::SetupDraw(const DrawSetup &setup, Shader *shader, const DrawCommand &draw)
+{
+    // runs on the thread replaying the frame, which also compiles the variants on first use
+    if (setup.variant)
+        shader = shader->GetVariant(setup.defines);
+    if (!shader || !shader->program)
+        return shader;
+
     shader->Use();
     GLuint loc_view_matrix = glGetUniformLocation(shader->program, "WIST_VIEW_MATRIX");
     GLuint loc_projection_matrix = glGetUniformLocation(shader->program, "WIST_PROJECTION_MATRIX");
@@ -63,36 +130,43 @@ void ControlledScene3D::RenderMesh(Mesh *mesh, Shader *shader, const glm::mat4 &
     GLuint loc_mvp_matrix = glGetUniformLocation(shader->program, "WIST_MVP");
     GLuint loc_eye_pos = glGetUniformLocation(shader->program, "WIST_EYE_POSITION");
 
-    glUniformMatrix4fv(loc_view_matrix, 1, GL_FALSE, glm::value_ptr(mainCamera->GetViewMatrix()));
-    glUniformMatrix4fv(loc_projection_matrix, 1, GL_FALSE, glm::value_ptr(mainCamera->GetProjectionMatrix()));
-    glUniformMatrix4fv(loc_model_matrix, 1, GL_FALSE, glm::value_ptr(modelMatrix));
+    glUniformMatrix4fv(loc_view_matrix, 1, GL_FALSE, glm::value_ptr(setup.viewMatrix));
+    glUniformMatrix4fv(loc_projection_matrix, 1, GL_FALSE, glm::value_ptr(setup.projectionMatrix));
+    glUniformMatrix4fv(loc_model_matrix, 1, GL_FALSE, glm::value_ptr(draw.model));
     if (loc_mvp_matrix != -1) {
         // only compute the MVP matrix if the shader uses it
-        glm::mat4 mvp = mainCamera->GetProjectionMatrix() * mainCamera->GetViewMatrix() * modelMatrix;
+        glm::mat4 mvp = setup.projectionMatrix * setup.viewMatrix * draw.model;
         glUniformMatrix4fv(loc_mvp_matrix, 1, GL_FALSE, glm::value_ptr(mvp));
     }
     if (loc_eye_pos != -1) {
-        glUniform4fv(loc_eye_pos, 1, glm::value_ptr(mainCamera->GetPositionGeneralized()));
+        glUniform4fv(loc_eye_pos, 1, glm::value_ptr(setup.eyePosition));
     }
 
-    mesh->UseMaterials(false); // To whoever wrote gfxc: I hate you for this. Took me 3 days to figure out why my textures weren't working!!
-    mesh->Render();
-}
+    // lighting, for the variants compiled with WIST_LIGHT_COUNT > 0
+    GLint loc_lights = glGetUniformLocation(shader->program, "WIST_LIGHTS");
+    if (loc_lights != -1 && !setup.lights.empty()) {
+        glUniform4fv(loc_lights, (GLsizei)setup.lights.size(), glm::value_ptr(setup.lights[0]));
+    }
+    glUniform1f(glGetUniformLocation(shader->program, "WIST_SCENE_AMBIENT"), setup.sceneAmbient);
+    if (setup.clusteredLights) {
+        lightClusters.Bind(shader);
+    }
 
-void ControlledScene3D::RenderMeshCustomMaterial(Mesh *mesh, Material material, const glm::mat4 &modelMatrix)
-{
-    if (!mesh || !material.shader || !material.shader->GetProgramID())
-        return;
+    // packed meshes store quantized positions and octahedral normals, see PackedVertexFormat
+    if (setup.packedVertices) {
+        const GPUBuffers *buffers = draw.mesh->GetBuffers();
+        glUniform3fv(glGetUniformLocation(shader->program, "WIST_POSITION_OFFSET"), 1, glm::value_ptr(buffers->m_positionOffset));
+        glUniform3fv(glGetUniformLocation(shader->program, "WIST_POSITION_SCALE"), 1, glm::value_ptr(buffers->m_positionScale));
+    }
 
-    material.Use();
-    RenderMesh(mesh, material.shader, modelMatrix);
+    draw.mesh->UseMaterials(false); // To whoever wrote gfxc: I hate you for this. Took me 3 days to figure out why my textures weren't working!!
+    return shader;
 }
 
 void ControlledScene3D::FrameStart()
 {
     // Clears the color buffer (using the previously set color) and depth buffer
-    glClearColor(clearColor.r, clearColor.g, clearColor.b, clearColor.a);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    GetRenderCommands().Clear(clearColor);
 }
 
 void ControlledScene3D::Init()
@@ -116,20 +190,26 @@ void ControlledScene3D::Init()
     Assets::AddPath("Default.VertexColor.FS", "Default.VertexColor.FS.glsl");
     Assets::AddPath("PlainColor.FS", "PlainColor.FS.glsl");
     Assets::AddPath("Default.Texture.FS", "Default.Texture.FS.glsl");
-    Assets::AddPath("Transform.Texture.VS", "Transform.Texture.VS.glsl");
+    Assets::AddPath("Lit.FS", "Lit.FS.glsl");
 
     Assets::LoadShader("VertexColor", "Default.VS", "Default.VertexColor.FS");
     Assets::LoadShader("PlainColor", "Default.VS", "PlainColor.FS");
     Assets::LoadShader("Texture", "Default.VS", "Default.Texture.FS");
-    Assets::LoadShader("TransformTexture", "Transform.Texture.VS", "Default.Texture.FS");
+    Assets::LoadShader("TransformTexture", "Default.VS", "Default.Texture.FS", false, {{"WIST_UV_TRANSFORM", "1"}});
+    Assets::LoadShader("Lit", "Default.VS", "Lit.FS", true);
     Assets::lookupDirectory = window->props.selfDir;
     this->Initialize();
+
+    // the shaders loaded until now were compiled in parallel, wait for all of them
+    Shader::FinishAll(true);
 }
 
 void ControlledScene3D::AddToScene(GameObject *gameObject)
 {
     gameObjects.insert(gameObject);
     gameObject->scene = this;
+    if (gameObject->transformDirty)
+        QueueTransformUpdate(gameObject);
     for (auto &child : gameObject->GetChildren()) {
         AddToScene(child);
     }
@@ -169,27 +249,52 @@ struct pair_hash {
 
 void ControlledScene3D::Update(float deltaTimeSeconds)
 {
+    PROFILE_FUNCTION();
     deltaTime = deltaTimeSeconds * timeScale;
     unscaledDeltaTime = deltaTimeSeconds;
 
-    for (auto &camera : cameras) {
+    // whatever moved since the last update, e.g. in the input callbacks
+    UpdateTransforms();
+
+    for (cameraIndex = 0; cameraIndex < cameras.size(); ++cameraIndex) {
         // if (!camera->active)
         //     continue;
-        mainCamera = camera;
+        mainCamera = cameras[cameraIndex];
         // std::cout << "drawArea: (" << drawAreaX << ", " << drawAreaY << ", " << drawAreaWidth << ", " << drawAreaHeight << ")\n";
         // std::cout << "viewport: (" << (int)(mainCamera->viewportX * drawAreaWidth) << ", " << (int)(mainCamera->viewportY * drawAreaHeight) << ", " << (int)(mainCamera->viewportWidth * drawAreaWidth) << ", " << (int)(mainCamera->viewportHeight * drawAreaHeight) << ")\n";
-        glViewport(drawAreaX + (int)(mainCamera->viewportX * drawAreaWidth), 
-                   drawAreaY + (int)(mainCamera->viewportY * drawAreaHeight),
-                   (int)(mainCamera->viewportWidth * drawAreaWidth), 
-                   (int)(mainCamera->viewportHeight * drawAreaHeight));
+        glm::ivec4 viewport(drawAreaX + (int)(mainCamera->viewportX * drawAreaWidth),
+                            drawAreaY + (int)(mainCamera->viewportY * drawAreaHeight),
+                            (int)(mainCamera->viewportWidth * drawAreaWidth),
+                            (int)(mainCamera->viewportHeight * drawAreaHeight));
+        RenderCommandList &commands = GetRenderCommands();
+        commands.BeginGPURange("Camera " + std::to_string(cameraIndex));
+        commands.SetViewport(viewport);
+        if (!pointLights.empty()) {
+            // the clusters are rebuilt when the frame is replayed, in between the draws of the cameras
+            glm::mat4 viewMatrix = mainCamera->GetViewMatrix();
+            glm::mat4 projectionMatrix = mainCamera->GetProjectionMatrix();
+            commands.Run([this, pointLights = pointLights, viewMatrix, projectionMatrix, viewport]() {
+                lightClusters.Update(pointLights, viewMatrix, projectionMatrix, glm::vec4(viewport));
+            });
+        }
+        std::fill(std::begin(drawSetups), std::end(drawSetups), -1);
         for (auto gameObject : gameObjects) {
             DrawGameObject(gameObject);
         }
+        commands.EndGPURange();
     }
     mainCamera = cameras[0];
 
-    Tick();
+    for (auto gameObject : gameObjects) {
+        MoveGameObject(gameObject);
+    }
 
+    {
+        PROFILE_ZONE("Tick");
+        Tick();
+    }
+
+    UpdateTransforms();
     CheckCollisions();
     
     for (auto gameObject : toDestroy) {
@@ -207,6 +312,7 @@ void ControlledScene3D::Update(float deltaTimeSeconds)
 
 void ControlledScene3D::CheckCollisions()
 {
+    PROFILE_FUNCTION();
     std::unordered_set<std::pair<GameObject *, GameObject *>, pair_hash> pairs;
     for (int layer1 = 0; layer1 < 32; ++layer1) {
         for (int layer2 = layer1; layer2 < 32; ++layer2) {
@@ -220,7 +326,9 @@ void ControlledScene3D::CheckCollisions()
                     
                     std::unique_ptr<CollisionEvent> event1, event2;
                     pairs.insert(std::make_pair(gameObject1, gameObject2));
+                    FrameStats::Add(FrameStats::COLLISION_PAIRS_TESTED);
                     if (gameObject1->Collides(gameObject2, event1, event2)) {
+                        FrameStats::Add(FrameStats::COLLISIONS);
                         event1->Dispatch(gameObject1);
                         event2->Dispatch(gameObject2);
                     }
@@ -232,15 +340,24 @@ void ControlledScene3D::CheckCollisions()
 
 void ControlledScene3D::DrawGameObject(GameObject *gameObject)
 {
+    PROFILE_FUNCTION();
     if (gameObject->mesh) {
         glm::mat4 modelMatrix = gameObject->ObjectToWorldMatrix();
+        unsigned int lod = SelectLOD(gameObject, modelMatrix);
         if (gameObject->material.shader) {
-            RenderMeshCustomMaterial(gameObject->mesh, gameObject->material, modelMatrix);
+            DrawMesh(gameObject->mesh, gameObject->material.shader, modelMatrix, lod, &gameObject->material);
         } else {
-            RenderMesh(gameObject->mesh, Assets::shaders["VertexColor"], modelMatrix);
+            DrawMesh(gameObject->mesh, Assets::shaders["VertexColor"], modelMatrix, lod);
         }
     }
 
+    for (auto &child : gameObject->GetChildren()) {
+        DrawGameObject(child);
+    }
+}
+
+void ControlledScene3D::MoveGameObject(GameObject *gameObject)
+{
     float objectDeltaTime = gameObject->useUnscaledTime ? unscaledDeltaTime : deltaTime;
     if (gameObject->acceleration != glm::vec3(0)) {
         gameObject->velocity += gameObject->acceleration * objectDeltaTime;
@@ -258,11 +375,132 @@ void ControlledScene3D::DrawGameObject(GameObject *gameObject)
         gameObject->SetLocalRotation(rotation);
     }
 
+    // the children added to the scene are moved by Update itself, once
     for (auto &child : gameObject->GetChildren()) {
-        DrawGameObject(child);
+        if (gameObjects.find(child) == gameObjects.end())
+            MoveGameObject(child);
     }
 }
 
+void ControlledScene3D::QueueTransformUpdate(GameObject *gameObject)
+{
+    if (gameObject->transformQueued)
+        return;
+    gameObject->transformQueued = true;
+    dirtyTransforms.push_back(gameObject);
+}
+
+void ControlledScene3D::DequeueTransformUpdate(GameObject *gameObject)
+{
+    auto it = std::find(dirtyTransforms.begin(), dirtyTransforms.end(), gameObject);
+    if (it != dirtyTransforms.end())
+        dirtyTransforms.erase(it);
+    gameObject->transformQueued = false;
+}
+
+void ControlledScene3D::UpdateTransforms()
+{
+    PROFILE_FUNCTION();
+    auto addNode = [this](GameObject *gameObject, int parent) {
+        transformNodes.push_back({ gameObject, parent, gameObject->localPosition, gameObject->localRotation,
+                                   gameObject->localScale, gameObject->fixedRotation, gameObject->rotation,
+                                   GameObject::WorldTransform() });
+    };
+
+    // the roots: the queued objects still dirty, under a clean parent. Those under a dirty
+    // parent are in the subtree of another root, or resolved when read
+    transformNodes.clear();
+    rootParents.clear();
+    for (auto gameObject : dirtyTransforms) {
+        gameObject->transformQueued = false;
+        GameObject *parent = gameObject->parent;
+        if (!gameObject->transformDirty || (parent != nullptr && parent->transformDirty))
+            continue;
+
+        rootParents.push_back(parent != nullptr ? parent->GetWorldTransform() : GameObject::WorldTransform());
+        addNode(gameObject, -1);
+    }
+    dirtyTransforms.clear();
+
+    // one level at a time: its objects are composed in parallel, then their children make the next one
+    size_t begin = 0;
+    while (begin < transformNodes.size()) {
+        size_t end = transformNodes.size();
+        JobSystem::ParallelFor((unsigned int)(end - begin), TRANSFORM_BATCH_SIZE,
+                               [this, begin](unsigned int first, unsigned int last) {
+            for (size_t i = begin + first; i < begin + last; i++) {
+                TransformNode &node = transformNodes[i];
+                const GameObject::WorldTransform &parent =
+                    (node.parent < 0) ? rootParents[i] : transformNodes[node.parent].world;
+                if (node.fixedRotation)
+                    node.localRotation = glm::inverse(parent.rotation) * node.fixedWorldRotation;
+                node.world = GameObject::ComposeTransform(parent, node.localPosition,
+                                                          node.localRotation, node.localScale);
+            }
+        });
+
+        for (size_t i = begin; i < end; i++) {
+            for (auto child : transformNodes[i].gameObject->children)
+                addNode(child, (int)i);
+        }
+        begin = end;
+    }
+
+    // every node is a different object, so they can be written back in any order
+    JobSystem::ParallelFor((unsigned int)transformNodes.size(), TRANSFORM_BATCH_SIZE,
+                           [this](unsigned int first, unsigned int last) {
+        for (unsigned int i = first; i < last; i++) {
+            TransformNode &node = transformNodes[i];
+            if (node.fixedRotation)
+                node.gameObject->localRotation = node.localRotation;
+            node.gameObject->SetWorldTransform(node.world);
+        }
+    });
+
+    // the callbacks may touch anything, parents before children
+    for (auto &node : transformNodes)
+        node.gameObject->OnTransformChange();
+}
+
+unsigned int ControlledScene3D::SelectLOD(GameObject *gameObject, const glm::mat4 &modelMatrix)
+{
+    Mesh *mesh = gameObject->mesh;
+    unsigned int lodCount = mesh->GetLODCount();
+    if (lodCount <= 1)
+        return 0;
+
+    // project the bounding sphere: its radius relative to half the viewport height
+    glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(mesh->GetBoundingCenter(), 1));
+    float scale = glm::max(glm::length(glm::vec3(modelMatrix[0])),
+                           glm::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+    float radius = mesh->GetBoundingRadius() * scale;
+
+    glm::mat4 projection = mainCamera->GetProjectionMatrix();
+    float screenSize = radius * projection[1][1];
+    if (projection[3][3] == 0) {
+        // perspective projection, the size falls off with the distance
+        float distance = -(mainCamera->GetViewMatrix() * glm::vec4(center, 1)).z;
+        if (distance <= radius)
+            screenSize = std::numeric_limits<float>::max();
+        else
+            screenSize /= distance;
+    }
+
+    if (gameObject->lodPerCamera.size() <= cameraIndex)
+        gameObject->lodPerCamera.resize(cameraIndex + 1, 0);
+    unsigned int &lod = gameObject->lodPerCamera[cameraIndex];
+    unsigned int maxLOD = std::min<unsigned int>(lodCount, (unsigned int)lodScreenSizes.size() + 1) - 1;
+    lod = std::min(lod, maxLOD);
+
+    // only step past a threshold once the size is clearly on its other side
+    while (lod < maxLOD && screenSize < lodScreenSizes[lod] * (1 - lodHysteresis))
+        ++lod;
+    while (lod > 0 && screenSize > lodScreenSizes[lod - 1] * (1 + lodHysteresis))
+        --lod;
+
+    return lod;
+}
+
 void ControlledScene3D::OnInputUpdate(float deltaTime, int mods)
 {
     this->OnInputUpdate(mods);
@@ -297,6 +535,6 @@ void ControlledScene3D::OnWindowResize(int width, int height)
 {
     windowResolution = window->GetResolution();
     ResizeDrawArea();
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    GetRenderCommands().Clear(clearColor);
     OnResizeWindow();
 }
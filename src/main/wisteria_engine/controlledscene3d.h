@@ -5,6 +5,7 @@
 #include "gameobject3d.h"
 #include "camera.h"
 #include "meshplusplus.h"
+#include "lightclusters.h"
 
 #include "components/simple_scene.h"
 
@@ -12,6 +13,8 @@ namespace engine
 {
     class ControlledScene3D : public gfxc::SimpleScene
     {
+        friend class GameObject;
+
     public:
         ControlledScene3D();
         ~ControlledScene3D();
@@ -28,21 +31,66 @@ namespace engine
         virtual void OnResizeWindow() {};
         virtual void OnInputUpdate(int mods) {};
 
+        // tests every pair of objects on layers whose masks let them collide, and
+        // dispatches the events. Called by Update, after the objects moved
+        void CheckCollisions();
+
         // glm::vec2 ScreenCoordsToLogicCoords(int screenX, int screenY);
 
     private:
         void FrameStart() override;
         void Update(float deltaTimeSeconds) override;
-        void CheckCollisions();
+        void MoveGameObject(GameObject *gameObject);
         void OnInputUpdate(float deltaTime, int mods) override;
         // void FrameEnd() override;
 
         void ResizeDrawArea();
         void OnWindowResize(int width, int height) override;
         
-        void RenderMesh(Mesh *mesh, Shader *shader, const glm::mat4 &modelMatrix);
-        void RenderMeshCustomMaterial(Mesh *mesh, Material material, const glm::mat4 &modelMatrix);
+        // what the draws of a camera share, set when the frame is replayed
+        struct DrawSetup
+        {
+            glm::mat4 viewMatrix;
+            glm::mat4 projectionMatrix;
+            glm::vec4 eyePosition;
+            std::vector<glm::vec4> lights;
+            float sceneAmbient;
+            bool clusteredLights;
+            // whether to draw with the variant of the shader given by `defines`
+            bool variant;
+            ShaderDefines defines;
+            // packed meshes are drawn with the WIST_PACKED_VERTICES variant, of any shader
+            bool packedVertices;
+        };
+
+        // records the draw, with the texture, uniforms and wireframe mode of `material` if given
+        void DrawMesh(Mesh *mesh, Shader *shader, const glm::mat4 &modelMatrix, unsigned int lod = 0,
+                      const Material *material = nullptr);
+        int GetDrawSetup(const Material *material, bool packedVertices);
+        Shader *SetupDraw(const DrawSetup &setup, Shader *shader, const DrawCommand &draw);
         void DrawGameObject(GameObject *gameObject);
+        unsigned int SelectLOD(GameObject *gameObject, const glm::mat4 &modelMatrix);
+
+        // the tops of the dirty subtrees, whose world transforms UpdateTransforms recomputes
+        void QueueTransformUpdate(GameObject *gameObject);
+        void DequeueTransformUpdate(GameObject *gameObject);
+        // resolves the queued subtrees at once: flattened breadth first, so that the
+        // objects of a level only depend on the level before, then each level in parallel
+        void UpdateTransforms();
+
+        struct TransformNode
+        {
+            GameObject *gameObject;
+            // index in transformNodes, -1 for the roots of the update
+            int parent;
+            glm::vec3 localPosition;
+            glm::quat localRotation;
+            glm::vec3 localScale;
+            // see GameObject::fixedRotation; the world rotation to keep
+            bool fixedRotation;
+            glm::quat fixedWorldRotation;
+            GameObject::WorldTransform world;
+        };
 
     protected:
         glm::vec4 clearColor = glm::vec4(0, 0, 0, 1);
@@ -58,8 +106,30 @@ namespace engine
 
         std::vector<int> collisionMasks;
 
+        // positional (w = 1) or directional (w = 0) lights, used by the shaders loaded
+        // with variants. Only the first MAX_SCENE_LIGHTS are taken into account
+        std::vector<glm::vec4> lights;
+        float sceneAmbient = 0.2f;
+        // any number of point lights, each one only shades the froxels it reaches
+        std::vector<PointLight> pointLights;
+
+        // a mesh switches to LOD i + 1 when the radius of its bounding sphere goes
+        // under lodScreenSizes[i] (relative to half the height of the viewport).
+        // lodHysteresis widens each threshold, so meshes don't flicker between levels
+        std::vector<float> lodScreenSizes = {0.25f, 0.1f, 0.04f};
+        float lodHysteresis = 0.15f;
+
     private:
+        size_t cameraIndex = 0;
+        // the setups recorded for the current camera: draws without variants, then one per material
+        // variant, each for unpacked and packed meshes
+        int drawSetups[18];
+        LightClusters lightClusters;
         std::unordered_set<GameObject *> toDestroy;
+        std::vector<GameObject *> dirtyTransforms;
+        // for the roots, the world transform of their parent
+        std::vector<GameObject::WorldTransform> rootParents;
+        std::vector<TransformNode> transformNodes;
         std::vector<std::unordered_set<GameObject *>> layers;
     };
 } // namespace engine
\ No newline at end of file
@@ -3,7 +3,8 @@
 #include <unordered_set>
 #include "hitarea3d.h"
 #include "gameobject3d.h"
-#include "transform3d.h"
+#include "controlledscene3d.h"
+#include "core/frame_stats.h"
 
 using namespace engine;
 
@@ -11,20 +12,22 @@ using namespace engine;
 GameObject::GameObject(GameObject *parent, Mesh *mesh, glm::vec3 position, 
                        glm::vec3 scale, glm::quat rotation)
 {
+    FrameStats::Add(FrameStats::GAME_OBJECTS_3D);
     this->mesh = mesh;
     this->parent = parent;
     if (parent != nullptr)
         parent->children.insert(this);
 
-    SetLocalPositionDirty(position);
-    SetLocalScaleDirty(scale);
-    SetLocalRotationDirty(rotation);
-
-    RecalculateMatrix();
+    localPosition = position;
+    localScale = scale;
+    localRotation = rotation;
+    transformDirty = true;
+    ResolveTransform();
 }
 
 GameObject::GameObject()
 {
+    FrameStats::Add(FrameStats::GAME_OBJECTS_3D);
     position = glm::vec3(0);
     localPosition = glm::vec3(0);
     rotation = QUAT1;
@@ -43,6 +46,9 @@ GameObject::GameObject(glm::vec3 position, glm::vec3 scale, glm::quat rotation)
 
 GameObject::~GameObject()
 {
+    FrameStats::Add(FrameStats::GAME_OBJECTS_3D, -1);
+    if (transformQueued && scene != nullptr)
+        scene->DequeueTransformUpdate(this);
     if (parent != nullptr) {
         parent->DetachChild(this);
     }
@@ -71,6 +77,7 @@ std::unordered_set<GameObject *> &GameObject::GetChildren()
 
 void GameObject::AddChild(GameObject *child, bool keepWorldPosition)
 {
+    WorldTransform childWorld = child->GetWorldTransform();
     if (child->parent != nullptr)
         child->parent->DetachChild(child);
 
@@ -78,17 +85,15 @@ void GameObject::AddChild(GameObject *child, bool keepWorldPosition)
 
     child->parent = this;
     if (keepWorldPosition) {
-        // trigger a recalculation of the child's local position and rotation
-        child->SetPositionDirty(child->position);
-        child->SetRotationDirty(child->rotation);
-        child->SetPseudoScaleDirty(child->pseudoScale);
-    } else {
-        // trigger a recalculation of the child's world position and rotation
-        child->SetLocalPositionDirty(child->localPosition);
-        child->SetLocalRotationDirty(child->localRotation);
-        child->SetLocalScaleDirty(child->localScale);
+        // recalculate the child's local transform, relative to this
+        WorldTransform world = GetWorldTransform();
+        glm::quat inverseRotation = glm::inverse(world.rotation);
+        child->localPosition = inverseRotation * (childWorld.position - world.position) / world.pseudoScale;
+        child->localRotation = inverseRotation * childWorld.rotation;
+        child->localScale = childWorld.pseudoScale / world.pseudoScale;
     }
-    RecalculateMatrix();
+    // the child's world transform follows, on the next read or scene update
+    child->MarkTransformDirty();
 }
 
 void GameObject::DetachChild(GameObject *child)
@@ -100,143 +105,129 @@ void GameObject::DetachChild(GameObject *child)
 glm::vec3 GameObject::GetLocalPosition() { return localPosition; }
 glm::quat GameObject::GetLocalRotation() { return localRotation; }
 glm::vec3 GameObject::GetLocalScale() { return localScale; }
-glm::vec3 GameObject::GetPosition() { return position; }
-glm::quat GameObject::GetRotation() { return rotation; }
-glm::vec3 GameObject::GetPseudoScale() { return pseudoScale; }
-
-void GameObject::SetLocalPositionDirty(glm::vec3 newLocalPos)
-{
-    localPosition = newLocalPos;
-    if (parent == nullptr) {
-        position = newLocalPos;
-    } else {
-        glm::vec3 disp = parent->pseudoScale * newLocalPos;
-        disp = parent->rotation * disp;
-        position = parent->position + disp;
-    }
+glm::vec3 GameObject::GetPosition() { ResolveTransform(); return position; }
+glm::quat GameObject::GetRotation() { ResolveTransform(); return rotation; }
+glm::vec3 GameObject::GetPseudoScale() { ResolveTransform(); return pseudoScale; }
 
-    for (auto child : children)
-    {
-        child->SetLocalPositionDirty(child->localPosition);
-    }
-}
 void GameObject::SetLocalPosition(glm::vec3 newLocalPos)
 {
-    SetLocalPositionDirty(newLocalPos);
-    RecalculateMatrix();
+    localPosition = newLocalPos;
+    MarkTransformDirty();
 }
 
-void GameObject::SetPositionDirty(glm::vec3 newPosition)
-{
-    position = newPosition;
-    if (parent == nullptr) {
-        localPosition = newPosition;
-    } else {
-        glm::vec3 disp = newPosition - parent->position;
-        disp = glm::inverse(parent->rotation) * disp;
-        localPosition = disp / parent->pseudoScale;
-    }
-
-    for (auto child : children)
-    {
-        child->SetLocalPositionDirty(child->localPosition);
-    }
-}
 void GameObject::SetPosition(glm::vec3 newPosition)
 {
-    SetPositionDirty(newPosition);
-    RecalculateMatrix();
+    WorldTransform parentWorld = parent ? parent->GetWorldTransform() : WorldTransform();
+    glm::vec3 disp = newPosition - parentWorld.position;
+    disp = glm::inverse(parentWorld.rotation) * disp;
+    localPosition = disp / parentWorld.pseudoScale;
+    MarkTransformDirty();
 }
 
-void GameObject::SetLocalScaleDirty(glm::vec3 newLocalScale)
-{
-    localScale = newLocalScale;
-    pseudoScale = (parent == nullptr) ? newLocalScale : newLocalScale * parent->pseudoScale;
-    for (auto child : children)
-    {
-        child->SetLocalScaleDirty(child->localScale);
-    }
-}
 void GameObject::SetLocalScale(glm::vec3 newLocalScale)
 {
-    SetLocalScaleDirty(newLocalScale);
-    RecalculateMatrix();
+    localScale = newLocalScale;
+    MarkTransformDirty();
 }
 
-void GameObject::SetPseudoScaleDirty(glm::vec3 newPseudoScale)
+void GameObject::SetPseudoScale(glm::vec3 newPseudoScale)
 {
-    pseudoScale = newPseudoScale;
-    localScale = (parent == nullptr) ? newPseudoScale : newPseudoScale / parent->pseudoScale;
+    // the children keep their world scale
     for (auto child : children)
     {
-        child->SetPseudoScaleDirty(child->pseudoScale);
+        child->localScale = child->GetPseudoScale() / newPseudoScale;
     }
+    localScale = (parent == nullptr) ? newPseudoScale : newPseudoScale / parent->GetPseudoScale();
+    MarkTransformDirty();
 }
-void GameObject::SetPseudoScale(glm::vec3 newPseudoScale)
+
+void GameObject::SetLocalRotation(glm::quat newLocalRotation)
 {
-    SetPseudoScaleDirty(newPseudoScale);
-    RecalculateMatrix();
+    localRotation = newLocalRotation;
+    // the world rotation of fixed rotation objects is the one kept when the parent rotates
+    if (fixedRotation)
+        rotation = ((parent == nullptr) ? QUAT1 : parent->GetRotation()) * newLocalRotation;
+    MarkTransformDirty();
 }
 
-void GameObject::SetLocalRotationDirty(glm::quat newLocalRotation)
+void GameObject::SetRotation(glm::quat newRotation)
 {
-    localRotation = newLocalRotation;
-    rotation = ((parent == nullptr) ? QUAT1 : parent->rotation) * newLocalRotation;
-    forward = rotation * glm::vec3_forward;
-    right = rotation * glm::vec3_right;
-    up = rotation * glm::vec3_up;
+    localRotation = ((parent == nullptr) ? QUAT1 : glm::inverse(parent->GetRotation())) * newRotation;
+    if (fixedRotation)
+        rotation = newRotation;
+    MarkTransformDirty();
+}
+
+glm::vec3 GameObject::GetForward() { ResolveTransform(); return forward; }
+glm::vec3 GameObject::GetRight() { ResolveTransform(); return right; }
+glm::vec3 GameObject::GetUp() { ResolveTransform(); return up; }
+
+void GameObject::MarkTransformDirty()
+{
+    // the subtree of a dirty object is already dirty
+    if (transformDirty)
+        return;
+
+    // and the ancestors of a clean one are clean, so this is the top of a dirty subtree
+    if (scene != nullptr)
+        scene->QueueTransformUpdate(this);
+
+    transformDirty = true;
     for (auto child : children)
-    {
-        if (child->fixedRotation)
-            child->SetRotationDirty(child->rotation);
-        else
-            child->SetLocalRotationDirty(child->localRotation);
-        child->SetLocalPositionDirty(child->localPosition);
-    }
+        child->MarkTransformDirty();
 }
-void GameObject::SetLocalRotation(glm::quat newLocalRotation)
+
+void GameObject::ResolveTransform()
 {
-    SetLocalRotationDirty(newLocalRotation);
-    RecalculateMatrix();
+    if (!transformDirty)
+        return;
+
+    WorldTransform parentWorld;
+    if (parent != nullptr) {
+        parent->ResolveTransform();
+        parentWorld = parent->GetWorldTransform();
+    }
+    if (fixedRotation)
+        localRotation = glm::inverse(parentWorld.rotation) * rotation;
+
+    SetWorldTransform(ComposeTransform(parentWorld, localPosition, localRotation, localScale));
+    OnTransformChange();
+
+    // the children are still dirty, and now the tops of their dirty subtrees
+    for (auto child : children) {
+        if (child->scene != nullptr)
+            child->scene->QueueTransformUpdate(child);
+    }
 }
 
-void GameObject::SetRotationDirty(glm::quat newRotation)
+void GameObject::SetWorldTransform(const WorldTransform &world)
 {
-    rotation = newRotation;
-    localRotation = ((parent == nullptr) ? QUAT1 : glm::inverse(parent->rotation)) * newRotation;
+    position = world.position;
+    rotation = world.rotation;
+    pseudoScale = world.pseudoScale;
+    objectToWorldMatrix = world.matrix;
     forward = rotation * glm::vec3_forward;
     right = rotation * glm::vec3_right;
     up = rotation * glm::vec3_up;
-    for (auto child : children)
-    {
-        if (child->fixedRotation)
-            child->SetRotationDirty(child->rotation);
-        else
-            child->SetLocalRotationDirty(child->localRotation);
-        child->SetLocalPositionDirty(child->localPosition);
-    }
-}
-void GameObject::SetRotation(glm::quat newRotation)
-{
-    SetRotationDirty(newRotation);
-    RecalculateMatrix();
+    transformDirty = false;
 }
 
-glm::vec3 GameObject::GetForward() { return forward; }
-glm::vec3 GameObject::GetRight() { return right; }
-glm::vec3 GameObject::GetUp() { return up; }
-
-void GameObject::RecalculateMatrix()
+GameObject::WorldTransform GameObject::ComposeTransform(const WorldTransform &parent, const glm::vec3 &localPosition,
+                                                        const glm::quat &localRotation, const glm::vec3 &localScale)
 {
-    objectToWorldMatrix = (parent == nullptr ? glm::mat4(1) : parent->objectToWorldMatrix) *
-        transform::Translate(localPosition) * 
-        transform::Rotate(localRotation) * 
-        transform::Scale(localScale);
-
-    OnTransformChange();
+    WorldTransform world;
+    world.rotation = parent.rotation * localRotation;
+    world.pseudoScale = localScale * parent.pseudoScale;
+    world.position = parent.position + parent.rotation * (parent.pseudoScale * localPosition);
 
-    for (auto child : children)
-        child->RecalculateMatrix();
+    // Translate(localPosition) * Rotate(localRotation) * Scale(localScale), without the products
+    glm::mat3 r = glm::mat3_cast(localRotation);
+    glm::mat4 local(glm::vec4(r[0] * localScale.x, 0),
+                    glm::vec4(r[1] * localScale.y, 0),
+                    glm::vec4(r[2] * localScale.z, 0),
+                    glm::vec4(localPosition, 1));
+    world.matrix = parent.matrix * local;
+    return world;
 }
 
 void GameObject::Translate(glm::vec3 translation, bool local)
@@ -244,7 +235,7 @@ void GameObject::Translate(glm::vec3 translation, bool local)
     if (local)
         SetLocalPosition(localPosition + translation);
     else
-        SetPosition(position + translation);
+        SetPosition(GetPosition() + translation);
 }
 
 void GameObject::Rotate(glm::quat rotation, bool local)
@@ -252,7 +243,7 @@ void GameObject::Rotate(glm::quat rotation, bool local)
     if (local)
         SetLocalRotation(rotation * this->localRotation);
     else {
-        SetRotation(rotation * this->rotation);
+        SetRotation(rotation * GetRotation());
     }
 }
 
@@ -266,21 +257,27 @@ void GameObject::Scale(glm::vec3 scale, bool local)
     if (local)
         SetLocalScale(localScale * scale);
     else
-        SetPseudoScale(pseudoScale * scale);
+        SetPseudoScale(GetPseudoScale() * scale);
+}
+
+GameObject::WorldTransform GameObject::GetWorldTransform()
+{
+    ResolveTransform();
+    return { position, rotation, pseudoScale, objectToWorldMatrix };
 }
 
-glm::mat4 GameObject::ObjectToWorldMatrix() { return objectToWorldMatrix; }
+glm::mat4 GameObject::ObjectToWorldMatrix() { ResolveTransform(); return objectToWorldMatrix; }
 
 glm::mat4 GameObject::WorldToObjectMatrix()
 {
     // since this operation is not very used, we can afford to compute it on demand
-    return glm::inverse(objectToWorldMatrix);
+    return glm::inverse(ObjectToWorldMatrix());
 }
 
 // added for completeness; not used
 glm::vec3 GameObject::ObjectToWorldPosition(glm::vec3 point)
 {
-    return objectToWorldMatrix * glm::vec4(point, 1);
+    return ObjectToWorldMatrix() * glm::vec4(point, 1);
 }
 
 glm::vec3 GameObject::WorldToObjectPosition(glm::vec3 point)
@@ -338,7 +335,7 @@ void GameObject::SetSphereHitArea(float radius, glm::vec3 offset)
 GameObject *GameObject::InertDeepCopy(bool keepWorldPosition)
 {
     GameObject *copy = keepWorldPosition ? 
-        new GameObject(mesh, position, localScale, rotation) : 
+        new GameObject(mesh, GetPosition(), localScale, GetRotation()) : 
         new GameObject(mesh, localPosition, localScale, localRotation);
 
     for (auto child : children)
@@ -13,9 +13,22 @@
 
 namespace engine
 {
+    class ControlledScene3D;
+
     class GameObject
     {
+        friend class ControlledScene3D;
+
     public:
+        // where an object ends up in the world, after the transformations of its parents
+        struct WorldTransform
+        {
+            glm::vec3 position = glm::vec3(0);
+            glm::quat rotation = QUAT1;
+            glm::vec3 pseudoScale = glm::vec3(1);
+            glm::mat4 matrix = glm::mat4(1);
+        };
+
         GameObject();
         GameObject(Mesh *mesh, glm::vec3 position, glm::vec3 scale = glm::vec3(1),
                    glm::quat rotation = QUAT1);
@@ -64,6 +77,7 @@ namespace engine
         glm::vec3 GetUp();
 
         // world transformations
+        WorldTransform GetWorldTransform();
         glm::mat4 ObjectToWorldMatrix();
         glm::mat4 WorldToObjectMatrix();
         glm::vec3 ObjectToWorldPosition(glm::vec3 point);
@@ -97,17 +111,22 @@ namespace engine
         // its parent gameobject is transformed
         bool fixedRotation = false;
 
+        // level of detail of the mesh last drawn by each camera of the scene
+        std::vector<unsigned int> lodPerCamera;
+
     protected:
         GameObject(GameObject *parent, Mesh *mesh, glm::vec3 position, 
                    glm::vec3 scale = glm::vec3(1), glm::quat rotation = QUAT1);
 
-        void SetLocalPositionDirty(glm::vec3 position);
-        void SetLocalRotationDirty(glm::quat rotation);
-        void SetLocalScaleDirty(glm::vec3 scale);
-        void SetPositionDirty(glm::vec3 position);
-        void SetRotationDirty(glm::quat rotation);
-        void SetPseudoScaleDirty(glm::vec3 scale);
-        void RecalculateMatrix();
+        // the setters only change the local transform and mark the subtree dirty. The world
+        // transforms are recomputed when read, or for the whole scene at once by
+        // ControlledScene3D::UpdateTransforms. The ancestors of a clean object are clean.
+        void MarkTransformDirty();
+        void ResolveTransform();
+        void SetWorldTransform(const WorldTransform &world);
+        // world = parent * local
+        static WorldTransform ComposeTransform(const WorldTransform &parent, const glm::vec3 &localPosition,
+                                               const glm::quat &localRotation, const glm::vec3 &localScale);
 
         glm::vec3 localPosition = glm::vec3(0);
         glm::vec3 localScale = glm::vec3(1);
@@ -119,6 +138,9 @@ namespace engine
         glm::vec3 right = glm::vec3_right;
         glm::vec3 up = glm::vec3_up;
         glm::mat4 objectToWorldMatrix = glm::mat4(1);
+        bool transformDirty = false;
+        // whether the scene has it among the objects to update
+        bool transformQueued = false;
 
         GameObject *parent = nullptr;
         HitArea *hitArea;
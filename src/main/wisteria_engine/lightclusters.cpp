@@ -0,0 +1,197 @@
+#include <cmath>
+#include <algorithm>
+#include "lightclusters.h"
+#include "core/job_system.h"
+
+// below this many lights, spreading the assignment over jobs costs more than it saves
+#define PARALLEL_LIGHTS_THRESHOLD 32
+// depth slices start here, so that orthographic cameras (near <= 0) work too
+#define MIN_SLICE_DEPTH 0.05f
+
+using namespace engine;
+
+LightClusters::LightClusters(glm::ivec3 dimensions) : dimensions(dimensions)
+{
+    zNear = MIN_SLICE_DEPTH;
+    zFar = 1;
+    viewport = glm::vec4(0, 0, 1, 1);
+
+    const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+    glGenBuffers(3, buffers);
+    glGenTextures(3, textures);
+    for (int i = 0; i < 3; i++) {
+        Upload(buffers[i], nullptr, 0);
+        glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+        glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+    }
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+LightClusters::~LightClusters()
+{
+    glDeleteTextures(3, textures);
+    glDeleteBuffers(3, buffers);
+}
+
+void LightClusters::Update(const std::vector<PointLight> &lights, const glm::mat4 &viewMatrix,
+                           const glm::mat4 &projectionMatrix, const glm::vec4 &viewport)
+{
+    this->viewMatrix = viewMatrix;
+    this->projectionMatrix = projectionMatrix;
+    this->viewport = viewport;
+
+    // recover the clipping planes from the projection matrix
+    const glm::mat4 &p = projectionMatrix;
+    if (p[3][3] == 0) {
+        zNear = p[3][2] / (p[2][2] - 1);
+        zFar = p[3][2] / (p[2][2] + 1);
+    } else {
+        zNear = (p[3][2] + 1) / p[2][2];
+        zFar = (p[3][2] - 1) / p[2][2];
+    }
+
+    size_t nrLights = lights.size();
+    bounds.resize(nrLights);
+    lightData.resize(2 * nrLights);
+    for (size_t i = 0; i < nrLights; i++) {
+        if (!ComputeBounds(lights[i], bounds[i])) {
+            // outside the frustum, matches no slice
+            bounds[i].min = glm::ivec3(1);
+            bounds[i].max = glm::ivec3(0);
+        }
+        lightData[2 * i] = glm::vec4(lights[i].position, lights[i].radius);
+        lightData[2 * i + 1] = glm::vec4(lights[i].color, 0);
+    }
+
+    // every job fills its own depth slices, so they never write the same data
+    grid.assign((size_t)dimensions.x * dimensions.y * dimensions.z, glm::uvec2(0));
+    sliceIndices.resize(dimensions.z);
+    unsigned int slicesPerJob = dimensions.z;
+    if (nrLights >= PARALLEL_LIGHTS_THRESHOLD)
+        slicesPerJob = 1;
+
+    JobSystem::ParallelFor(dimensions.z, slicesPerJob, [this](unsigned int first, unsigned int last) {
+        AssignSlices(first, last);
+    });
+
+    // the offsets in the grid are relative to their slice until the lists are joined
+    indices.clear();
+    size_t clustersPerSlice = (size_t)dimensions.x * dimensions.y;
+    for (int z = 0; z < dimensions.z; z++) {
+        GLuint base = (GLuint)indices.size();
+        for (size_t i = 0; i < clustersPerSlice; i++)
+            grid[z * clustersPerSlice + i].x += base;
+        indices.insert(indices.end(), sliceIndices[z].begin(), sliceIndices[z].end());
+    }
+
+    Upload(buffers[0], lightData.data(), lightData.size() * sizeof(glm::vec4));
+    Upload(buffers[1], grid.data(), grid.size() * sizeof(glm::uvec2));
+    Upload(buffers[2], indices.data(), indices.size() * sizeof(GLuint));
+}
+
+void LightClusters::Bind(Shader *shader) const
+{
+    GLint loc_lights = glGetUniformLocation(shader->program, "WIST_CLUSTER_LIGHTS");
+    if (loc_lights == -1)
+        return;
+
+    for (int i = 0; i < 3; i++) {
+        glActiveTexture(GL_TEXTURE0 + WIST_CLUSTER_TEXTURE_UNIT + i);
+        glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+    }
+    glActiveTexture(GL_TEXTURE0);
+
+    glUniform1i(loc_lights, WIST_CLUSTER_TEXTURE_UNIT);
+    glUniform1i(glGetUniformLocation(shader->program, "WIST_CLUSTER_GRID"), WIST_CLUSTER_TEXTURE_UNIT + 1);
+    glUniform1i(glGetUniformLocation(shader->program, "WIST_CLUSTER_INDICES"), WIST_CLUSTER_TEXTURE_UNIT + 2);
+    glUniform3iv(glGetUniformLocation(shader->program, "WIST_CLUSTER_DIMENSIONS"), 1, glm::value_ptr(dimensions));
+
+    glm::vec2 slicing = GetDepthSlicing();
+    glUniform2f(glGetUniformLocation(shader->program, "WIST_CLUSTER_DEPTH"), slicing.x, slicing.y);
+    glUniform4fv(glGetUniformLocation(shader->program, "WIST_VIEWPORT"), 1, glm::value_ptr(viewport));
+}
+
+bool LightClusters::ComputeBounds(const PointLight &light, LightBounds &bounds) const
+{
+    glm::vec3 center = glm::vec3(viewMatrix * glm::vec4(light.position, 1));
+    float minDepth = -center.z - light.radius;
+    float maxDepth = -center.z + light.radius;
+    if (maxDepth < zNear || minDepth > zFar)
+        return false;
+
+    // the extremes of the projected box are at its corners, once the
+    // box is clipped to the part in front of the near plane
+    glm::vec2 ndcMin(std::numeric_limits<float>::max());
+    glm::vec2 ndcMax(-std::numeric_limits<float>::max());
+    for (int i = 0; i < 8; i++) {
+        glm::vec3 corner = center + light.radius * glm::vec3(i & 1 ? 1 : -1, i & 2 ? 1 : -1, i & 4 ? 1 : -1);
+        corner.z = std::min(corner.z, -zNear);
+        glm::vec4 clip = projectionMatrix * glm::vec4(corner, 1);
+        glm::vec2 ndc = glm::vec2(clip) / clip.w;
+        ndcMin = glm::min(ndcMin, ndc);
+        ndcMax = glm::max(ndcMax, ndc);
+    }
+    if (ndcMin.x > 1 || ndcMin.y > 1 || ndcMax.x < -1 || ndcMax.y < -1)
+        return false;
+
+    glm::vec2 tiles = glm::vec2(dimensions.x, dimensions.y);
+    glm::ivec2 tileMax = glm::ivec2(dimensions.x - 1, dimensions.y - 1);
+    bounds.min = glm::ivec3(glm::clamp(glm::ivec2(glm::floor((ndcMin * 0.5f + 0.5f) * tiles)), glm::ivec2(0), tileMax), 0);
+    bounds.max = glm::ivec3(glm::clamp(glm::ivec2(glm::floor((ndcMax * 0.5f + 0.5f) * tiles)), glm::ivec2(0), tileMax), 0);
+
+    // same mapping as wist_applyClusteredLights
+    glm::vec2 slicing = GetDepthSlicing();
+    auto slice = [&](float depth) {
+        int z = (int)(std::log(std::max(depth, slicing.x) / slicing.x) * slicing.y);
+        return std::clamp(z, 0, dimensions.z - 1);
+    };
+    bounds.min.z = slice(minDepth);
+    bounds.max.z = slice(maxDepth);
+    return true;
+}
+
+glm::vec2 LightClusters::GetDepthSlicing() const
+{
+    // slice z starts at depth near * (far / near) ^ (z / slices)
+    float sliceNear = std::max(zNear, MIN_SLICE_DEPTH);
+    float sliceScale = dimensions.z / std::log(std::max(zFar, sliceNear * 2) / sliceNear);
+    return glm::vec2(sliceNear, sliceScale);
+}
+
+void LightClusters::AssignSlices(int firstSlice, int lastSlice)
+{
+    std::vector<GLuint> sliceLights;
+    for (int z = firstSlice; z < lastSlice; z++) {
+        sliceLights.clear();
+        for (size_t i = 0; i < bounds.size(); i++) {
+            if (bounds[i].min.z <= z && z <= bounds[i].max.z)
+                sliceLights.push_back((GLuint)i);
+        }
+
+        std::vector<GLuint> &out = sliceIndices[z];
+        out.clear();
+        for (int y = 0; y < dimensions.y; y++) {
+            for (int x = 0; x < dimensions.x; x++) {
+                GLuint first = (GLuint)out.size();
+                for (GLuint light : sliceLights) {
+                    const LightBounds &b = bounds[light];
+                    if (b.min.x <= x && x <= b.max.x && b.min.y <= y && y <= b.max.y)
+                        out.push_back(light);
+                }
+                grid[((size_t)z * dimensions.y + y) * dimensions.x + x] = glm::uvec2(first, (GLuint)out.size() - first);
+            }
+        }
+    }
+}
+
+void LightClusters::Upload(GLuint buffer, const void *data, size_t size)
+{
+    // a fresh store every time, so the driver doesn't wait for the previous frame
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    if (size == 0) {
+        glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+    } else {
+        glBufferData(GL_TEXTURE_BUFFER, size, data, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <vector>
+#include "core/gpu/shader.h"
+#include "utils/glm_utils.h"
+
+// the cluster data is bound to the last texture units, materials use the first ones
+#define WIST_CLUSTER_TEXTURE_UNIT 13
+
+namespace engine
+{
+    struct PointLight
+    {
+        glm::vec3 position;
+        float radius;
+        glm::vec3 color = glm::vec3(1);
+    };
+
+    // Clustered forward lighting: the view frustum is split into a grid of froxels
+    // (screen tiles x exponential depth slices) and every froxel gets the list of
+    // point lights that reach it. Fragments only shade the lights of their froxel.
+    // The lists live in texture buffers, so they work with OpenGL 3.3.
+    class LightClusters
+    {
+    public:
+        LightClusters(glm::ivec3 dimensions = glm::ivec3(16, 9, 24));
+        ~LightClusters();
+
+        // rebuilds the lists for a camera; `viewport` is in pixels (x, y, width, height)
+        void Update(const std::vector<PointLight> &lights, const glm::mat4 &viewMatrix,
+                    const glm::mat4 &projectionMatrix, const glm::vec4 &viewport);
+        // binds the lists to the shaders compiled with WIST_CLUSTERED_LIGHTS
+        void Bind(Shader *shader) const;
+
+    private:
+        struct LightBounds
+        {
+            glm::ivec3 min;
+            glm::ivec3 max;
+        };
+
+        bool ComputeBounds(const PointLight &light, LightBounds &bounds) const;
+        // first slice depth, slices per unit of log(depth)
+        glm::vec2 GetDepthSlicing() const;
+        void AssignSlices(int firstSlice, int lastSlice);
+        void Upload(GLuint buffer, const void *data, size_t size);
+
+        glm::ivec3 dimensions;
+        glm::mat4 viewMatrix;
+        glm::mat4 projectionMatrix;
+        glm::vec4 viewport;
+        float zNear, zFar;
+
+        std::vector<LightBounds> bounds;
+        std::vector<glm::uvec2> grid;                    // per cluster: first index, count
+        std::vector<std::vector<GLuint>> sliceIndices;   // light indices, per depth slice
+        std::vector<GLuint> indices;
+        std::vector<glm::vec4> lightData;                // per light: position + radius, color
+
+        // lights, grid, indices
+        GLuint buffers[3];
+        GLuint textures[3];
+    };
+}
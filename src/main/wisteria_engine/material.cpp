@@ -1,12 +1,36 @@
 #include <iostream>
 
+#include "core/frame_stats.h"
 #include "core/managers/texture_manager.h"
 #include "material.h"
 
 using namespace engine;
 
+ShaderDefines ShaderVariant::GetDefines() const
+{
+    // only the enabled switches are defined, the shaders test them with #ifdef
+    ShaderDefines defines;
+    defines["WIST_LIGHT_COUNT"] = std::to_string(lightCount);
+    if (clusteredLights)
+        defines["WIST_CLUSTERED_LIGHTS"] = "1";
+    if (textured)
+        defines["WIST_TEXTURED"] = "1";
+    if (vertexColor)
+        defines["WIST_VERTEX_COLOR"] = "1";
+    if (instanced)
+        defines["WIST_INSTANCED"] = "1";
+    if (uvTransform)
+        defines["WIST_UV_TRANSFORM"] = "1";
+    if (packedVertices)
+        defines["WIST_PACKED_VERTICES"] = "1";
+    return defines;
+}
+
 Material::Material(Shader *shader): shader(shader) 
 {
+    // the shader may still be compiling, see Shader::Submit
+    if (shader)
+        shader->Finish();
     if (!shader || !shader->program)
         return;
     shader->Use();
@@ -63,9 +87,31 @@ void Material::SetMat4(std::string name, glm::mat4 value)
     uniforms[name] = std::make_pair(MAT4, uniformValue);
 }
 
-void Material::Use()
+ShaderVariant Material::GetVariant(int lightCount, bool clusteredLights, bool instanced,
+                                   bool packedVertices) const
 {
-    if (!shader || !shader->program)
+    ShaderVariant variant;
+    variant.lightCount = lightCount;
+    variant.clusteredLights = clusteredLights;
+    variant.textured = texture != nullptr;
+    variant.vertexColor = vertexColor;
+    variant.instanced = instanced;
+    variant.uvTransform = uvTransform;
+    variant.packedVertices = packedVertices;
+    return variant;
+}
+
+void Material::SetUVTransform(const glm::mat3 &transform)
+{
+    // the shader only needs the lengths of transformed vectors: |T v|^2 = v^T (T^T T) v
+    SetMat3("WIST_UV_METRIC", glm::transpose(transform) * transform);
+    uvTransform = true;
+}
+
+void Material::Use(Shader *variant)
+{
+    Shader *program = variant ? variant : shader;
+    if (!program || !program->program)
         return;
 
     if (wireframe) {
@@ -75,17 +121,19 @@ void Material::Use()
         glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
     }
 
-    shader->Use();
+    program->Use();
 
     if (texture) {
         texture->BindToTextureUnit(GL_TEXTURE0);
-        GLuint loc_texture = glGetUniformLocation(shader->program, "WIST_TEXTURE_0");
+        GLuint loc_texture = glGetUniformLocation(program->program, "WIST_TEXTURE_0");
         glUniform1i(loc_texture, 0);
+        FrameStats::Add(FrameStats::UNIFORM_UPLOADS);
     }
+    FrameStats::Add(FrameStats::UNIFORM_UPLOADS, static_cast<int64_t>(uniforms.size()));
 
     for (auto [name, uniform] : uniforms) {
         auto [type, value] = uniform;
-        GLint location = glGetUniformLocation(shader->program, name.c_str());
+        GLint location = glGetUniformLocation(program->program, name.c_str());
         if (type == INT) {
             glUniform1i(location, value.intValue);
         } else if (type == FLOAT) {
@@ -102,5 +150,28 @@ void Material::Use()
     }
 }
 
+void Material::Record(RenderCommandList &commands) const
+{
+    if (texture)
+        commands.SetUniform("WIST_TEXTURE_0", 0);
+
+    for (auto &[name, uniform] : uniforms) {
+        auto &[type, value] = uniform;
+        if (type == INT) {
+            commands.SetUniform(name, value.intValue);
+        } else if (type == FLOAT) {
+            commands.SetUniform(name, value.floatValue);
+        } else if (type == VEC2) {
+            commands.SetUniform(name, value.vec2Value);
+        } else if (type == VEC3) {
+            commands.SetUniform(name, value.vec3Value);
+        } else if (type == MAT3) {
+            commands.SetUniform(name, value.mat3Value);
+        } else if (type == MAT4) {
+            commands.SetUniform(name, value.mat4Value);
+        }
+    }
+}
+
 
 
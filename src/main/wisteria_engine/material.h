@@ -1,11 +1,28 @@
 #pragma once
 
+#include "core/gpu/render_commands.h"
 #include "core/gpu/shader.h"
 #include "core/gpu/texture2D.h"
 #include "utils/glm_utils.h"
 
 namespace engine
 {
+    // Compile time switches of the shaders loaded with variants (see Assets::LoadShader).
+    // Each combination in use is compiled once, on first use.
+    struct ShaderVariant
+    {
+        int lightCount = 0;
+        bool clusteredLights = false;
+        bool textured = false;
+        bool vertexColor = false;
+        bool instanced = false;
+        bool uvTransform = false;
+        // of the mesh, see PackedVertexFormat
+        bool packedVertices = false;
+
+        ShaderDefines GetDefines() const;
+    };
+
     class Material
     {
     public:
@@ -20,11 +37,24 @@ namespace engine
         void SetMat3(std::string name, glm::mat3 value);
         void SetMat4(std::string name, glm::mat4 value);
 
-        void Use();
+        // Stretches the texture as if the mesh was transformed by `transform`,
+        // for the shaders compiled with WIST_UV_TRANSFORM
+        void SetUVTransform(const glm::mat3 &transform);
+
+        // The variant of `shader` that matches this material, the number of lights and the mesh
+        ShaderVariant GetVariant(int lightCount, bool clusteredLights = false, bool instanced = false,
+                                 bool packedVertices = false) const;
+        // `variant` is the program to use instead of `shader`, if any
+        void Use(Shader *variant = nullptr);
+        // the uniforms set by Use, for the last draw of `commands`.
+        // The texture and the wireframe mode go in the DrawCommand itself
+        void Record(RenderCommandList &commands) const;
 
         Shader *shader;
         Texture2D *texture = nullptr;
         bool wireframe = false; 
+        bool vertexColor = false;
+        bool uvTransform = false;
 
     private:
         enum UniformType
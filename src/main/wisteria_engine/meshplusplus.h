@@ -2,24 +2,24 @@
 
 #include "components/simple_scene.h"
 
-#include "assimp/Importer.hpp"          // C++ importer interface
-#include "assimp/postprocess.h"         // Post processing flags
-
 // Mesh++ is a wrapper around Mesh that adds support for vertex colors
 // Just because the framework is poorly designed and I need to work around it
 // NOTICE: The following code is mostly copied from Mesh.h !!
-// I can't just inherit from it because of the way the framework is designed
-// The functions are not virtual and I can't override them
+// Only the steps of loading a scene are virtual, so the rest of it is Mesh's
 namespace engine
 {
     class MeshPlusPlus : public Mesh
     {
     private:
-        void InitMesh(const aiMesh* paiMesh)
+        mesh_optimizer::Report InitMesh(const aiMesh* paiMesh)
         {
             const aiVector3D Zero3D(0.0f, 0.0f, 0.0f);
             const aiColor4D White(1.0f, 1.0f, 1.0f, 1.0f);
 
+            std::vector<VertexFormat> meshVertices;
+            std::vector<unsigned int> meshIndices;
+            meshVertices.reserve(paiMesh->mNumVertices);
+
             // Create VertexFormats instead of populating different vectors
             // VertexFormat contains color information as well
             // Since most meshes have at most 1 set of vertex colors, we will only use the first one
@@ -33,24 +33,40 @@ namespace engine
                                     glm::vec3(pColor->r, pColor->g, pColor->b),
                                     glm::vec3(pNormal->x, pNormal->y, pNormal->z),
                                     glm::vec2(pTexCoord->x, pTexCoord->y));
-                vertices.push_back(vertex);
+                meshVertices.push_back(vertex);
             }
 
             // Init the index buffer
             for (unsigned int i = 0; i < paiMesh->mNumFaces; i++) {
                 const aiFace& Face = paiMesh->mFaces[i];
-                indices.push_back(Face.mIndices[0]);
-                indices.push_back(Face.mIndices[1]);
-                indices.push_back(Face.mIndices[2]);
+                meshIndices.push_back(Face.mIndices[0]);
+                meshIndices.push_back(Face.mIndices[1]);
+                meshIndices.push_back(Face.mIndices[2]);
                 if (Face.mNumIndices == 4)
-                    indices.push_back(Face.mIndices[3]);
+                    meshIndices.push_back(Face.mIndices[3]);
             }
+
+            // Same optimizations as Mesh::InitMesh, on the interleaved vertices
+            mesh_optimizer::Report report;
+            if (glDrawMode == GL_TRIANGLES && !meshVertices.empty())
+            {
+                std::vector<unsigned int> remap;
+                size_t nrVertices;
+                report = mesh_optimizer::OptimizeMesh(meshIndices,
+                    { { meshVertices.data(), sizeof(VertexFormat) } }, meshVertices.size(),
+                    { &meshVertices[0].position, sizeof(VertexFormat) }, remap, nrVertices);
+                mesh_optimizer::RemapVertexBuffer(meshVertices, remap, nrVertices);
+            }
+
+            vertices.insert(vertices.end(), meshVertices.begin(), meshVertices.end());
+            indices.insert(indices.end(), meshIndices.begin(), meshIndices.end());
+            return report;
         }
 
-        bool InitFromScene(const aiScene *pScene)
+    protected:
+        void ImportScene(const aiScene *pScene) override
         {
             meshEntries.resize(pScene->mNumMeshes);
-            materials.resize(pScene->mNumMaterials);
 
             unsigned int nrVertices = 0;
             unsigned int nrIndices = 0;
@@ -58,13 +74,8 @@ namespace engine
             // Count the number of vertices and indices
             for (unsigned int i = 0 ; i < pScene->mNumMeshes ; i++)
             {
-                meshEntries[i].materialIndex = pScene->mMeshes[i]->mMaterialIndex;
-                meshEntries[i].nrIndices = (pScene->mMeshes[i]->mNumFaces * (glDrawMode == GL_TRIANGLES ? 3 : 4));
-                meshEntries[i].baseVertex = nrVertices;
-                meshEntries[i].baseIndex = nrIndices;
-
                 nrVertices += pScene->mMeshes[i]->mNumVertices;
-                nrIndices  += meshEntries[i].nrIndices;
+                nrIndices  += pScene->mMeshes[i]->mNumFaces * (glDrawMode == GL_TRIANGLES ? 3 : 4);
             }
 
             // Reserve space in the vectors for the vertex attributes and indices
@@ -72,45 +83,46 @@ namespace engine
             indices.reserve(nrIndices);
 
             // Initialize the meshes in the scene one by one
+            mesh_optimizer::Report report;
             for (unsigned int i = 0 ; i < meshEntries.size() ; i++)
             {
                 const aiMesh* paiMesh = pScene->mMeshes[i];
-                InitMesh(paiMesh);
+                meshEntries[i].materialIndex = paiMesh->mMaterialIndex;
+                meshEntries[i].baseVertex = (unsigned int)vertices.size();
+                meshEntries[i].baseIndex = (unsigned int)indices.size();
+
+                report += InitMesh(paiMesh);
+                meshEntries[i].nrIndices = (unsigned int)indices.size() - meshEntries[i].baseIndex;
+
+                if (useLODs && glDrawMode == GL_TRIANGLES && meshEntries[i].nrIndices > 0)
+                {
+                    GenerateLODs(meshEntries[i], { &vertices[meshEntries[i].baseVertex].position, sizeof(VertexFormat) },
+                                 vertices.size() - meshEntries[i].baseVertex);
+                }
             }
 
+            optimizationReport = report;
+        }
+
+        bool UploadScene(const aiScene *pScene) override
+        {
+            materials.resize(pScene->mNumMaterials);
             if (useMaterial && !InitMaterials(pScene))
                 return false;
 
             buffers->ReleaseMemory();
-            *buffers = gpu_utils::UploadData(vertices, indices);
+            *buffers = gpu_utils::UploadData(vertices, indices, packedVertices);
+            OnDataUploaded();
             return buffers->m_VAO != 0;
         }
 
-    public:
-        MeshPlusPlus(const std::string &meshID) : Mesh(meshID) {}
-
-        bool LoadMesh(const std::string& fileLocation,
-                      const std::string& fileName)
+        // Mesh::LoadMesh (and its reloads) load into one of these
+        Mesh *CreateStaging() const override
         {
-            ClearData();
-            this->fileLocation = fileLocation;
-            std::string file = (fileLocation + '/' + fileName).c_str();
-
-            Assimp::Importer Importer;
-
-            unsigned int flags = aiProcess_GenSmoothNormals | aiProcess_FlipUVs;
-            if (glDrawMode == GL_TRIANGLES) flags |= aiProcess_Triangulate;
-
-            const aiScene* pScene = Importer.ReadFile(file, flags);
-
-            if (pScene) {
-                return InitFromScene(pScene);
-            }
-
-            // pScene is freed when returning because of Importer
-
-            printf("Error parsing '%s': '%s'\n", file.c_str(), Importer.GetErrorString());
-            return false;
+            return new MeshPlusPlus(GetMeshID());
         }
+
+    public:
+        MeshPlusPlus(const std::string &meshID) : Mesh(meshID) {}
     };
 }
\ No newline at end of file
@@ -4,20 +4,72 @@ layout(location = 0) in vec3 v_position;
 layout(location = 1) in vec3 v_normal;
 layout(location = 2) in vec2 v_texture_coord;
 layout(location = 3) in vec3 v_color;
+layout(location = 4) in vec3 v_tangent;
 
+// Instanced variants read the model matrix from a per-instance attribute
+#ifdef WIST_INSTANCED
+layout(location = 5) in mat4 v_model_matrix;
+#define MODEL_MATRIX v_model_matrix
+#else
 uniform mat4 WIST_MODEL_MATRIX;
+#define MODEL_MATRIX WIST_MODEL_MATRIX
+#endif
+
 uniform mat4 WIST_VIEW_MATRIX;
 uniform mat4 WIST_PROJECTION_MATRIX;
 
+// Variants with WIST_PACKED_VERTICES draw the meshes uploaded as PackedVertexFormat
+#ifdef WIST_PACKED_VERTICES
+uniform vec3 WIST_POSITION_OFFSET;
+uniform vec3 WIST_POSITION_SCALE;
+#endif
+
+// Variants with WIST_UV_TRANSFORM stretch the texture along with the linear
+// transformation T of the mesh. The engine sets transpose(T) * T, see Material
+#ifdef WIST_UV_TRANSFORM
+uniform mat3 WIST_UV_METRIC;
+#endif
+
+out vec3 frag_position;
 out vec3 frag_normal;
 out vec3 frag_color;
 out vec2 frag_tex_coord;
 
+vec3 DecodeOctahedral(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
 void main()
 {
-    frag_normal = mat3(WIST_MODEL_MATRIX) * v_normal;
+#ifdef WIST_PACKED_VERTICES
+    vec3 position = WIST_POSITION_OFFSET + WIST_POSITION_SCALE * v_position;
+    vec3 normal = DecodeOctahedral(v_normal.xy);
+#else
+    vec3 position = v_position;
+    vec3 normal = v_normal;
+#endif
+
+    vec4 world_position = MODEL_MATRIX * vec4(position, 1.0);
+    frag_position = world_position.xyz;
+    frag_normal = mat3(MODEL_MATRIX) * normal;
     frag_color = v_color;
     frag_tex_coord = v_texture_coord;
-    mat4 MVP = WIST_PROJECTION_MATRIX * WIST_VIEW_MATRIX * WIST_MODEL_MATRIX;
-    gl_Position = MVP * vec4(v_position, 1.0);
+
+#ifdef WIST_UV_TRANSFORM
+    // Scale the uvs by how much T stretches the surface along the tangent and
+    // the bitangent, i.e. the lengths of T * tangent and T * bitangent
+#ifdef WIST_PACKED_VERTICES
+    vec3 tangent = DecodeOctahedral(v_tangent.xy);
+#else
+    vec3 tangent = v_tangent;
+#endif
+    vec3 bitangent = cross(normal, tangent);
+    vec2 uv_scale = sqrt(vec2(dot(tangent, WIST_UV_METRIC * tangent), dot(bitangent, WIST_UV_METRIC * bitangent)));
+    frag_tex_coord = mat2(uv_scale.x, 0.0, 0.0, uv_scale.y) * v_texture_coord;
+#endif
+    gl_Position = WIST_PROJECTION_MATRIX * WIST_VIEW_MATRIX * world_position;
 }
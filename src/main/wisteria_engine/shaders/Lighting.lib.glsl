@@ -1,11 +1,29 @@
+// Number of lights in WIST_LIGHTS, set by the engine for each shader variant
+#ifndef WIST_LIGHT_COUNT
+#define WIST_LIGHT_COUNT 0
+#endif
+
 uniform float WIST_SCENE_AMBIENT;
-uniform vec4 WIST_LIGHTS[8];
+#if WIST_LIGHT_COUNT > 0
+uniform vec4 WIST_LIGHTS[WIST_LIGHT_COUNT];
+#endif
 uniform vec4 WIST_EYE_POSITION;
 
-uniform float WIST_MATERIAL_AMBIENT;
-uniform float WIST_MATERIAL_DIFFUSE;
-uniform float WIST_MATERIAL_SPECULAR;
-uniform float WIST_MATERIAL_SHININESS;
+uniform float WIST_MATERIAL_AMBIENT = 1.0;
+uniform float WIST_MATERIAL_DIFFUSE = 1.0;
+uniform float WIST_MATERIAL_SPECULAR = 0.5;
+uniform float WIST_MATERIAL_SHININESS = 32.0;
+
+// Point lights sorted into froxels on the CPU, see engine::LightClusters
+#ifdef WIST_CLUSTERED_LIGHTS
+uniform samplerBuffer WIST_CLUSTER_LIGHTS;      // per light: (position, radius), (color, 0)
+uniform usamplerBuffer WIST_CLUSTER_GRID;       // per cluster: first index, count
+uniform usamplerBuffer WIST_CLUSTER_INDICES;
+uniform ivec3 WIST_CLUSTER_DIMENSIONS;
+uniform vec2 WIST_CLUSTER_DEPTH;                // first slice depth, slices per unit of log(depth)
+uniform vec4 WIST_VIEWPORT;
+uniform mat4 WIST_VIEW_MATRIX;
+#endif
 
 vec3 lightDirection(vec4 light, vec3 frag_pos)
 {
@@ -18,30 +36,61 @@ vec3 eyeDirection(vec3 frag_pos)
                                       : normalize(WIST_EYE_POSITION.xyz - frag_pos);
 }
 
+// diffuse and specular contribution of one light
 vec3 wist_phongLighting(vec4 light, vec3 frag_pos, vec3 frag_normal, vec3 frag_color)
 {
     vec3 normal = normalize(frag_normal);
     vec3 light_dir = lightDirection(light, frag_pos);
     vec3 eye_dir = eyeDirection(frag_pos);
 
-    float ambient = WIST_SCENE_AMBIENT * WIST_MATERIAL_AMBIENT;
     float diffuse = max(dot(normal, light_dir), 0.0) * WIST_MATERIAL_DIFFUSE;
     vec3 median_dir = normalize(light_dir + eye_dir);
-    float specular = 0;
-    if (diffuse > 0)
+    float specular = 0.0;
+    if (diffuse > 0.0)
         specular = pow(max(dot(median_dir, normal), 0.0), WIST_MATERIAL_SHININESS) * WIST_MATERIAL_SPECULAR;
 
-    return vec4(frag_color * (ambient + diffuse + specular), 1.0);
+    return frag_color * (diffuse + specular);
 }
 
-vec3 wist_applyAllLights(vec3 frag_pos, vec3 frag_normal, vec3 frag_color)
+#ifdef WIST_CLUSTERED_LIGHTS
+vec3 wist_applyClusteredLights(vec3 frag_pos, vec3 frag_normal, vec3 frag_color)
 {
+    float depth = -(WIST_VIEW_MATRIX * vec4(frag_pos, 1.0)).z;
+    ivec3 cluster;
+    cluster.xy = ivec2((gl_FragCoord.xy - WIST_VIEWPORT.xy) / WIST_VIEWPORT.zw * vec2(WIST_CLUSTER_DIMENSIONS.xy));
+    cluster.z = int(log(max(depth, WIST_CLUSTER_DEPTH.x) / WIST_CLUSTER_DEPTH.x) * WIST_CLUSTER_DEPTH.y);
+    cluster = clamp(cluster, ivec3(0), WIST_CLUSTER_DIMENSIONS - 1);
+
+    int index = (cluster.z * WIST_CLUSTER_DIMENSIONS.y + cluster.y) * WIST_CLUSTER_DIMENSIONS.x + cluster.x;
+    uvec2 range = texelFetch(WIST_CLUSTER_GRID, index).xy;
+
     vec3 color = vec3(0.0);
-    for (int i = 0; i < 8; i++)
+    for (uint i = 0u; i < range.y; i++)
     {
-        if (WIST_LIGHTS[i].w == 0.0)
-            break;
-        color += wist_phongLighting(WIST_LIGHTS[i], frag_pos, frag_normal, frag_color);
+        int light = int(texelFetch(WIST_CLUSTER_INDICES, int(range.x + i)).r);
+        vec4 position_radius = texelFetch(WIST_CLUSTER_LIGHTS, 2 * light);
+        vec3 light_color = texelFetch(WIST_CLUSTER_LIGHTS, 2 * light + 1).rgb;
+
+        // smooth falloff, reaching 0 at the radius
+        float distance_ratio = length(position_radius.xyz - frag_pos) / position_radius.w;
+        float falloff = clamp(1.0 - distance_ratio * distance_ratio, 0.0, 1.0);
+        color += falloff * falloff * light_color
+               * wist_phongLighting(vec4(position_radius.xyz, 1.0), frag_pos, frag_normal, frag_color);
     }
     return color;
-}
\ No newline at end of file
+}
+#endif
+
+vec3 wist_applyAllLights(vec3 frag_pos, vec3 frag_normal, vec3 frag_color)
+{
+    vec3 color = frag_color * WIST_SCENE_AMBIENT * WIST_MATERIAL_AMBIENT;
+#if WIST_LIGHT_COUNT > 0
+    // the count is a compile time constant, so the loop is unrolled
+    for (int i = 0; i < WIST_LIGHT_COUNT; i++)
+        color += wist_phongLighting(WIST_LIGHTS[i], frag_pos, frag_normal, frag_color);
+#endif
+#ifdef WIST_CLUSTERED_LIGHTS
+    color += wist_applyClusteredLights(frag_pos, frag_normal, frag_color);
+#endif
+    return color;
+}
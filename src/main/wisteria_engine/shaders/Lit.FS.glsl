@@ -0,0 +1,38 @@
+#version 330
+
+// Uber shader of the engine, compiled per variant (see engine::ShaderVariant):
+// WIST_LIGHT_COUNT, WIST_CLUSTERED_LIGHTS, WIST_TEXTURED, WIST_VERTEX_COLOR
+#include "Lighting.lib.glsl"
+
+in vec3 frag_position;
+in vec3 frag_normal;
+in vec3 frag_color;
+in vec2 frag_tex_coord;
+
+#ifdef WIST_TEXTURED
+uniform sampler2D WIST_TEXTURE_0;
+#endif
+uniform vec3 WIST_COLOR = vec3(1.0);
+
+layout(location = 0) out vec4 out_color;
+
+
+void main()
+{
+    vec4 color = vec4(WIST_COLOR, 1.0);
+#ifdef WIST_TEXTURED
+    color *= texture(WIST_TEXTURE_0, frag_tex_coord);
+    if (color.a < 0.9)
+    {
+        discard;
+    }
+#endif
+#ifdef WIST_VERTEX_COLOR
+    color.rgb *= frag_color;
+#endif
+
+#if WIST_LIGHT_COUNT > 0 || defined(WIST_CLUSTERED_LIGHTS)
+    color.rgb = wist_applyAllLights(frag_position, frag_normal, color.rgb);
+#endif
+    out_color = color;
+}
@@ -23,3 +23,59 @@ std::string text_utils::Join(
 
     return os.str();
 }
+
+
+std::u32string text_utils::DecodeUTF8(const std::string &text)
+{
+    const char32_t replacement = 0xFFFD;
+    std::u32string result;
+    result.reserve(text.size());
+
+    for (size_t i = 0; i < text.size();)
+    {
+        unsigned char lead = static_cast<unsigned char>(text[i]);
+        size_t length = 0;
+        char32_t codepoint = 0;
+
+        if (lead < 0x80) {
+            length = 1;
+            codepoint = lead;
+        } else if ((lead & 0xE0) == 0xC0) {
+            length = 2;
+            codepoint = lead & 0x1F;
+        } else if ((lead & 0xF0) == 0xE0) {
+            length = 3;
+            codepoint = lead & 0x0F;
+        } else if ((lead & 0xF8) == 0xF0) {
+            length = 4;
+            codepoint = lead & 0x07;
+        } else {
+            result.push_back(replacement);
+            i++;
+            continue;
+        }
+
+        size_t j = 1;
+        for (; j < length && i + j < text.size(); j++) {
+            unsigned char next = static_cast<unsigned char>(text[i + j]);
+            if ((next & 0xC0) != 0x80) {
+                break;
+            }
+            codepoint = (codepoint << 6) | (next & 0x3F);
+        }
+
+        // Reject truncated, overlong and out of range sequences, as well as surrogates
+        static const char32_t minimum[] = { 0, 0, 0x80, 0x800, 0x10000 };
+        if (j != length || codepoint < minimum[length] || codepoint > 0x10FFFF ||
+            (codepoint >= 0xD800 && codepoint <= 0xDFFF)) {
+            result.push_back(replacement);
+            i += j;
+            continue;
+        }
+
+        result.push_back(codepoint);
+        i += length;
+    }
+
+    return result;
+}
@@ -20,5 +20,9 @@ namespace text_utils
         const std::vector<std::string> &elements,
         const std::string &separator);
 
+    // Decodes an UTF-8 string into codepoints. Invalid sequences
+    // are replaced by U+FFFD (the replacement character).
+    std::u32string DecodeUTF8(const std::string &text);
+
 #define PATH_JOIN(...) text_utils::Join(std::vector<std::string>{__VA_ARGS__}, std::string(1, PATH_SEPARATOR))
 }